@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ *
+ * This example measures the AES operations of the soft secure element: key
+ * setup, single block encryption, and a LoRaWAN MIC and payload encryption
+ * done the way soft-se.c does them. Build it with and without
+ * PICO_LORAWAN_FAST_AES to compare the two AES implementations.
+ *
+ * On the RP2040 the results are in CPU cycles, on the host in ns.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#if PICO_LORAWAN_HOST
+#include <time.h>
+#else
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "tusb.h"
+#endif
+
+#include "aes.h"
+#include "cmac.h"
+
+#define ITERATIONS 1000
+
+enum operation {
+    OPERATION_SET_KEY,
+    OPERATION_ENCRYPT,
+    OPERATION_MIC,
+    OPERATION_PAYLOAD
+};
+
+static const uint8_t keys[2][16] = {
+    { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c },
+    { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f }
+};
+
+static uint8_t frame[48];
+static uint8_t block[16];
+
+#if PICO_LORAWAN_HOST
+static const char* unit = "ns";
+
+static uint64_t now( void )
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static float to_unit( uint64_t elapsed )
+{
+    return (float)elapsed;
+}
+#else
+static const char* unit = "cycles";
+
+static uint64_t now( void )
+{
+    return time_us_64();
+}
+
+static float to_unit( uint64_t elapsed )
+{
+    return (float)elapsed * (clock_get_hz(clk_sys) / 1000000);
+}
+#endif
+
+static void run(enum operation operation, int i)
+{
+    // alternate between two keys, as the MAC does with its session keys
+    const uint8_t* key = keys[i & 1];
+    aes_context aes;
+    AES_CMAC_CTX cmac;
+
+    switch (operation) {
+        case OPERATION_SET_KEY:
+            aes_set_key(key, 16, &aes);
+            break;
+
+        case OPERATION_ENCRYPT:
+            aes_set_key(keys[0], 16, &aes);
+            for (int j = 0; j < 16; j++) {
+                aes_encrypt(block, block, &aes);
+            }
+            break;
+
+        case OPERATION_MIC:
+            // B0 block and a 32 byte frame
+            AES_CMAC_Init(&cmac);
+            AES_CMAC_SetKey(&cmac, key);
+            AES_CMAC_Update(&cmac, block, sizeof(block));
+            AES_CMAC_Update(&cmac, frame, 32);
+            AES_CMAC_Final(block, &cmac);
+            break;
+
+        case OPERATION_PAYLOAD:
+            // 48 byte FRMPayload, one key setup and a keystream block each 16 bytes
+            aes_set_key(key, 16, &aes);
+            for (int j = 0; j < sizeof(frame); j += 16) {
+                uint8_t keystream[16];
+
+                block[15] = j / 16 + 1;
+                aes_encrypt(block, keystream, &aes);
+
+                for (int k = 0; k < 16; k++) {
+                    frame[j + k] ^= keystream[k];
+                }
+            }
+            break;
+    }
+}
+
+static float benchmark(enum operation operation)
+{
+    uint64_t start;
+
+    // fill the key cache and tables outside of the measurement
+    run(operation, 0);
+    run(operation, 1);
+
+    start = now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        run(operation, i);
+    }
+
+    return to_unit(now() - start) / ITERATIONS;
+}
+
+int main( void )
+{
+    static const char* operations[] = { "aes_set_key", "aes_encrypt", "MIC (48 B)", "payload (48 B)" };
+    float results[4];
+
+#if !PICO_LORAWAN_HOST
+    // initialize stdio and wait for USB CDC connect
+    stdio_init_all();
+
+    while (!tud_cdc_connected()) {
+        tight_loop_contents();
+    }
+#endif
+    printf("Pico LoRaWAN - AES Benchmark\n\n");
+
+#if PICO_LORAWAN_FAST_AES
+    printf("AES: table driven, cached key schedules\n");
+#else
+    printf("AES: LoRaMac-node reference\n");
+#endif
+
+    for (int i = 0; i < sizeof(frame); i++) {
+        frame[i] = i * 7 + 1;
+    }
+
+    for (int operation = OPERATION_SET_KEY; operation <= OPERATION_PAYLOAD; operation++) {
+        results[operation] = benchmark(operation);
+    }
+
+    // the encrypt run is 16 blocks
+    results[OPERATION_ENCRYPT] = (results[OPERATION_ENCRYPT] - results[OPERATION_SET_KEY]) / 16;
+
+    printf("\n%-16s %12s\n", "operation", unit);
+
+    for (int operation = OPERATION_SET_KEY; operation <= OPERATION_PAYLOAD; operation++) {
+        printf("%-16s %12.1f\n", operations[operation], results[operation]);
+    }
+
+#if !PICO_LORAWAN_HOST
+    while (1) {
+        tight_loop_contents();
+    }
+#endif
+
+    return 0;
+}
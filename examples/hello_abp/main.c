@@ -84,14 +84,15 @@ int main( void )
 
     // loop forever
     while (1) {
-        // let the lorwan library process pending events
-        lorawan_process();
-
         // get the current time and see if 5 seconds have passed
         // since the last message was sent
         uint32_t now = to_ms_since_boot(get_absolute_time());
-        
-        if ((now - last_message_time) > 5000) {
+
+        if ((now - last_message_time) < 5000) {
+            // let the lorwan library process pending events, and sleep until
+            // there are more or the next message is due
+            lorawan_sleep_until_next_event(5000 - (now - last_message_time));
+        } else {
             const char* message = "hello world!";
 
             // try to send an unconfirmed uplink message
@@ -0,0 +1,332 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ * This example runs the library natively on the host against the simulated
+ * SX1276. It activates with ABP, sends a number of uplinks in virtual time
+ * and plays the network server for downlinks, answering every 10th uplink
+ * in the RX1 window. Build it with -DPICO_LORAWAN_HOST=ON, it is meant to
+ * be run under perf or valgrind.
+ *
+ * Usage: pico_lorawan_host_simulation [uplinks] [fcnt reservation]
+ *
+ * PICO_LORAWAN_HOST_PIO=1 runs the SX1276 bus on the PIO model, and
+ * PICO_LORAWAN_HOST_SPI_TRACE names a file to trace the bus transactions to.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hardware/clocks.h"
+#include "pico/lorawan.h"
+#include "pico/time.h"
+
+#include "aes.h"
+#include "cmac.h"
+#include "nvm-file.h"
+#include "pio-sim.h"
+#include "sim-clock.h"
+#include "spi-burst.h"
+#include "sx1276-sim.h"
+#include "sx1276/sx1276.h"
+
+#define LORAWAN_REGION                  LORAMAC_REGION_US915
+#define LORAWAN_DEV_ADDR                0x26011bda
+#define LORAWAN_DEV_ADDR_STR            "26011BDA"
+#define LORAWAN_NETWORK_SESSION_KEY     "2B7E151628AED2A6ABF7158809CF4F3C"
+#define LORAWAN_APP_SESSION_KEY         "3C4FCF098815F7ABA6D2AE2816157E2B"
+
+#define DOWNLINK_INTERVAL               10
+#define DOWNLINK_PORT                   10
+// the network server transmits at the start of RX1, 1 s after the uplink ends
+#define DOWNLINK_RX1_DELAY_US           1000000
+
+#define TELEMETRY_PORT                  2
+
+// the SX1276 model does not care about pins, any distinct numbers do
+struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = spi0,
+        .mosi = 19,
+        .miso = 16,
+        .sck  = 18,
+        .nss  = 8
+    },
+    .reset = 9,
+    .dio0  = 7,
+    .dio1  = 10
+};
+
+const struct lorawan_abp_settings abp_settings = {
+    .device_address = LORAWAN_DEV_ADDR_STR,
+    .network_session_key = LORAWAN_NETWORK_SESSION_KEY,
+    .app_session_key = LORAWAN_APP_SESSION_KEY,
+    .channel_mask = NULL
+};
+
+static uint8_t network_session_key[16];
+static uint8_t app_session_key[16];
+static uint32_t downlink_counter = 0;
+static uint32_t uplinks_seen = 0;
+
+static void parse_key(const char* str, uint8_t* key)
+{
+    for (int i = 0; i < 16; i++) {
+        unsigned int b;
+
+        sscanf(str + i * 2, "%2x", &b);
+
+        key[i] = b;
+    }
+}
+
+static void build_block(uint8_t* block, uint8_t type, uint32_t counter, uint8_t last)
+{
+    memset(block, 0x00, 16);
+
+    block[0] = type;
+    block[5] = 1; // downlink
+    block[6] = (LORAWAN_DEV_ADDR >> 0) & 0xff;
+    block[7] = (LORAWAN_DEV_ADDR >> 8) & 0xff;
+    block[8] = (LORAWAN_DEV_ADDR >> 16) & 0xff;
+    block[9] = (LORAWAN_DEV_ADDR >> 24) & 0xff;
+    block[10] = (counter >> 0) & 0xff;
+    block[11] = (counter >> 8) & 0xff;
+    block[12] = (counter >> 16) & 0xff;
+    block[13] = (counter >> 24) & 0xff;
+    block[15] = last;
+}
+
+// builds an unconfirmed LoRaWAN 1.0.x data downlink, like a network server would
+static uint8_t build_downlink(uint8_t* frame, uint8_t port, const uint8_t* payload, uint8_t size)
+{
+    aes_context aes;
+    AES_CMAC_CTX cmac;
+    uint8_t block[16];
+    uint8_t keystream[16];
+    uint8_t mic[16];
+    uint8_t length = 0;
+
+    frame[length++] = 0x60;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 0) & 0xff;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 8) & 0xff;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 16) & 0xff;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 24) & 0xff;
+    frame[length++] = 0x00;
+    frame[length++] = (downlink_counter >> 0) & 0xff;
+    frame[length++] = (downlink_counter >> 8) & 0xff;
+    frame[length++] = port;
+
+    aes_set_key(app_session_key, 16, &aes);
+
+    for (int i = 0; i < size; i++) {
+        if ((i % 16) == 0) {
+            build_block(block, 0x01, downlink_counter, (i / 16) + 1);
+            aes_encrypt(block, keystream, &aes);
+        }
+
+        frame[length++] = payload[i] ^ keystream[i % 16];
+    }
+
+    build_block(block, 0x49, downlink_counter, length);
+
+    AES_CMAC_Init(&cmac);
+    AES_CMAC_SetKey(&cmac, network_session_key);
+    AES_CMAC_Update(&cmac, block, sizeof(block));
+    AES_CMAC_Update(&cmac, frame, length);
+    AES_CMAC_Final(mic, &cmac);
+
+    memcpy(frame + length, mic, 4);
+    length += 4;
+
+    downlink_counter++;
+
+    return length;
+}
+
+static void on_uplink(const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context)
+{
+    uint8_t frame[64];
+    uint8_t payload[4];
+
+    // only look at data uplinks from our device
+    if (size < 12 || (buffer[0] & 0xe0) != 0x40) {
+        return;
+    }
+
+    uplinks_seen++;
+
+    if ((uplinks_seen % DOWNLINK_INTERVAL) == 0) {
+        memcpy(payload, &uplinks_seen, sizeof(payload));
+
+        SX1276SimQueueRxFrameAt(frame, build_downlink(frame, DOWNLINK_PORT, payload, sizeof(payload)), -60, 8,
+            SimClockNow() + DOWNLINK_RX1_DELAY_US);
+    }
+}
+
+static void on_pio_fault(const char* message, uint16_t instruction)
+{
+    printf("PIO model stopped: %s (0x%04x)!\n", message, instruction);
+    fflush(stdout);
+}
+
+static double wall_clock_s(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t frame_count = (argc > 1) ? strtoul(argv[1], NULL, 0) : 1000;
+    uint16_t fcnt_reservation = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0;
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    uint8_t receive_buffer[242];
+    uint8_t receive_port;
+    SX1276SimStats_t stats;
+    SpiBurstStats_t spi_stats;
+    PioSimStats_t pio_stats;
+    struct lorawan_nvm_stats nvm_stats;
+    struct lorawan_send_stats send_stats;
+    struct lorawan_uplink_queue_stats queue_stats;
+    struct lorawan_downlink_stats downlink_stats;
+    struct lorawan_rx_timing_stats rx_timing_stats;
+    double send_time = 0;
+    const char* trace_path = getenv("PICO_LORAWAN_HOST_SPI_TRACE");
+    const char* nvm_file_path = getenv("PICO_LORAWAN_HOST_NVM_FILE");
+    FILE* trace = NULL;
+
+    parse_key(LORAWAN_NETWORK_SESSION_KEY, network_session_key);
+    parse_key(LORAWAN_APP_SESSION_KEY, app_session_key);
+
+    SX1276SimSetTxHandler(on_uplink, NULL);
+
+    if (getenv("PICO_LORAWAN_HOST_PIO") != NULL && atoi(getenv("PICO_LORAWAN_HOST_PIO")) != 0) {
+        sx1276_settings.spi.pio = pio0;
+
+        PioSimSetFaultHandler(on_pio_fault);
+    }
+
+    if (trace_path != NULL) {
+        trace = fopen(trace_path, "w");
+
+        SX1276SimSetTrace(trace);
+    }
+
+    printf("Pico LoRaWAN - Host Simulation\n\n");
+
+    if (nvm_file_path != NULL) {
+        // FRAM-like NVM instead of the simulated internal flash
+        lorawan_nvm_set_backend(&lorawan_nvm_file, (void*)nvm_file_path);
+    }
+
+    if (lorawan_nvm_set_fcnt_reservation(fcnt_reservation) < 0) {
+        printf("invalid frame counter reservation!\n");
+        return 1;
+    }
+
+    if (lorawan_init_abp(&sx1276_settings, LORAWAN_REGION, &abp_settings) < 0) {
+        printf("failed to initialize LoRaWAN!\n");
+        return 1;
+    }
+
+    lorawan_join();
+
+    while (!lorawan_is_joined()) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    double start = wall_clock_s();
+    uint64_t virtual_start = to_us_since_boot(get_absolute_time());
+
+    while (sent < frame_count) {
+        double send_start = wall_clock_s();
+
+        if (lorawan_send_unconfirmed(&sent, sizeof(sent), TELEMETRY_PORT) == 0) {
+            send_time += wall_clock_s() - send_start;
+            sent++;
+        }
+
+        // run through the RX windows, or wait for the MAC to become free
+        lorawan_process_timeout_ms(3000);
+
+        while (lorawan_receive(receive_buffer, sizeof(receive_buffer), &receive_port) > -1) {
+            received++;
+        }
+    }
+
+    // drain what is still queued, every uplink offered then was either sent or dropped
+    lorawan_uplink_queue_get_stats(&queue_stats);
+
+    while (queue_stats.depth > 0) {
+        lorawan_process_timeout_ms(3000);
+        lorawan_uplink_queue_get_stats(&queue_stats);
+    }
+
+    double elapsed = wall_clock_s() - start;
+    double virtual_elapsed = (to_us_since_boot(get_absolute_time()) - virtual_start) / 1e6;
+
+    SX1276SimGetStats(&stats);
+    SpiBurstGetStats(&SX1276.Spi, &spi_stats);
+
+    printf("uplinks sent:          %u\n", sent);
+    lorawan_downlink_get_stats(&downlink_stats);
+
+    printf("downlinks received:    %u (%u dropped, max %u unread)\n", received, downlink_stats.dropped_full, downlink_stats.max_depth);
+    printf("virtual time:          %.1f s\n", virtual_elapsed);
+    printf("wall clock time:       %.3f s\n", elapsed);
+    printf("uplinks per second:    %.0f\n", sent / elapsed);
+    printf("SPI transactions:      %u (%.1f per uplink)\n", stats.SpiTransactions, (double)stats.SpiTransactions / stats.TxFrames);
+    printf("register shadow reads: %u (%.1f per uplink without the shadow)\n", spi_stats.ShadowTransactions,
+        (double)(stats.SpiTransactions + spi_stats.ShadowTransactions) / stats.TxFrames);
+    if (sx1276_settings.spi.pio != NULL) {
+        PioSimGetStats(sx1276_settings.spi.pio, 0, &pio_stats);
+
+        printf("PIO bus time:          %.1f us per uplink (%.1f instructions per byte)\n",
+            pio_stats.Cycles * 1e6 / clock_get_hz(clk_sys) / stats.TxFrames, (double)pio_stats.Instructions / stats.SpiBytes);
+    }
+    printf("radio TX on air:       %.1f s\n", stats.TxOnAirUs / 1e6);
+    printf("radio RX on:           %.1f s\n", stats.RxOnUs / 1e6);
+
+    lorawan_rx_timing_get_stats(&rx_timing_stats);
+
+    printf("RX window error:       %u ms (max open error %u us, max drift %u ppm)\n",
+        rx_timing_stats.rx_error_ms, rx_timing_stats.max_open_error_us, rx_timing_stats.max_drift_ppm);
+    printf("RX on saved:           %.2f ms per uplink (%u downlinks timed, %u missed)\n",
+        rx_timing_stats.uplinks ? rx_timing_stats.rx_on_saved_us / 1e3 / rx_timing_stats.uplinks : 0.0,
+        rx_timing_stats.downlinks, stats.RxMissed);
+
+    lorawan_nvm_get_stats(&nvm_stats);
+
+    printf("NVM flushes:           %u (%u skipped, nothing changed)\n", nvm_stats.flushes, nvm_stats.skipped_flushes);
+    printf("NVM sector erases:     %u (%u skipped, max %u per sector)\n", nvm_stats.erases, nvm_stats.skipped_erases, nvm_stats.max_sector_erases);
+    printf("NVM pages programmed:  %u\n", nvm_stats.pages_programmed);
+    printf("NVM flush latency:     %.2f ms avg, %.2f ms max\n",
+        (nvm_stats.flushes > nvm_stats.skipped_flushes) ? nvm_stats.total_flush_time_us / 1e3 / (nvm_stats.flushes - nvm_stats.skipped_flushes) : 0.0,
+        nvm_stats.max_flush_time_us / 1e3);
+    printf("max IRQ latency:       %.2f ms\n", nvm_stats.max_irq_latency_us / 1e3);
+    printf("NVM RAM:               %u bytes (%u max)\n", nvm_stats.ram_bytes, nvm_stats.max_ram_bytes);
+    printf("NVM per day:           %.0f flushes, %.0f erases, %.0f pages programmed, %.0f KB written\n",
+        nvm_stats.flushes * 86400 / virtual_elapsed, nvm_stats.erases * 86400 / virtual_elapsed,
+        nvm_stats.pages_programmed * 86400 / virtual_elapsed, nvm_stats.bytes_written * 86400 / virtual_elapsed / 1024);
+
+    lorawan_get_send_stats(&send_stats);
+
+    printf("send call:             %.1f us avg (wall clock)\n", sent ? send_time * 1e6 / sent : 0.0);
+    printf("send to radio TX:      %.1f us avg, %u us max (virtual)\n",
+        send_stats.sends ? (double)send_stats.total_latency_us / send_stats.sends : 0.0, send_stats.max_latency_us);
+    printf("AES precomputed:       %u blocks (%u used)\n", send_stats.precomputed_blocks, send_stats.precomputed_hits);
+
+    printf("uplinks queued:        %u (%u sent, max depth %u)\n", queue_stats.queued, queue_stats.sent, queue_stats.max_depth);
+    printf("uplinks dropped:       %u full, %u expired, %u rejected\n",
+        queue_stats.dropped_full, queue_stats.dropped_expired, queue_stats.dropped_rejected);
+
+    return 0;
+}
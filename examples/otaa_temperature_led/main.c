@@ -44,6 +44,9 @@ const struct lorawan_otaa_settings otaa_settings = {
     .channel_mask = LORAWAN_CHANNEL_MASK
 };
 
+// variables for sending data
+uint8_t max_len = 0;
+
 // variables for receiving data
 int receive_length = 0;
 uint8_t receive_buffer[242];
@@ -98,16 +101,34 @@ int main( void )
         // get the internal temperature
         int8_t adc_temperature_byte = internal_temperature_get();
 
-        // send the internal temperature as a (signed) byte in an unconfirmed uplink message
+        // send the internal temperature as a (signed) byte in an unconfirmed uplink message,
+        // written straight into the uplink buffer of the library
         printf("sending internal temperature: %d °C (0x%02x)... ", adc_temperature_byte, adc_temperature_byte);
-        if (lorawan_send_unconfirmed(&adc_temperature_byte, sizeof(adc_temperature_byte), 2) < 0) {
+        int8_t* payload = lorawan_tx_acquire(&max_len);
+
+        if (payload == NULL) {
+            printf("failed!!!\n");
+        } else if (max_len < sizeof(adc_temperature_byte)) {
+            // pending MAC commands leave no room at this datarate, an empty
+            // uplink still sends them, the temperature goes the next time around
+            if (lorawan_tx_commit(0, 2) < 0) {
+                lorawan_tx_release();
+            }
+
             printf("failed!!!\n");
         } else {
-            printf("success!\n");
+            payload[0] = adc_temperature_byte;
+
+            if (lorawan_tx_commit(sizeof(adc_temperature_byte), 2) < 0) {
+                lorawan_tx_release();
+                printf("failed!!!\n");
+            } else {
+                printf("success!\n");
+            }
         }
 
-        // wait for up to 30 seconds for an event
-        if (lorawan_process_timeout_ms(30000) == 0) {
+        // wait for up to 30 seconds for a downlink
+        if (lorawan_wait_event(LORAWAN_EVENT_RX, 30000)) {
             // check if a downlink message was received
             receive_length = lorawan_receive(receive_buffer, sizeof(receive_buffer), &receive_port);
             if (receive_length > -1) {
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ *
+ * This example measures the time taken by SX1276 FIFO transfers of 64, 128
+ * and 255 bytes, one SpiInOut( ) call per byte as the driver did before,
+ * framed into bursts by the board layer, and with the SpiBurst API.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/lorawan.h"
+#include "tusb.h"
+
+#include "spi-burst.h"
+#include "sx1276/sx1276.h"
+
+// pin configuration for SX1276 radio module
+const struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = PICO_DEFAULT_SPI_INSTANCE(),
+        .mosi = PICO_DEFAULT_SPI_TX_PIN,
+        .miso = PICO_DEFAULT_SPI_RX_PIN,
+        .sck  = PICO_DEFAULT_SPI_SCK_PIN,
+        .nss = 8
+    },
+    .reset = 9,
+    .dio0 = 7,
+    .dio1 = 10
+};
+
+// LoRaWAN region to use, full list of regions can be found at:
+//   http://stackforce.github.io/LoRaMac-doc/LoRaMac-doc-v4.5.1/group___l_o_r_a_m_a_c.html#ga3b9d54f0355b51e85df8b33fd1757eec
+#define LORAWAN_REGION LORAMAC_REGION_US915
+
+#define ITERATIONS 100
+
+enum path {
+    PATH_BYTE,
+    PATH_FRAMED,
+    PATH_BURST
+};
+
+static uint8_t tx_buffer[255];
+static uint8_t rx_buffer[255];
+
+static void fifo_write(enum path path, uint8_t size)
+{
+    if (path == PATH_BURST) {
+        SpiBurstWrite(&SX1276.Spi, REG_LR_FIFO, tx_buffer, size);
+    } else {
+        SX1276WriteBuffer(REG_LR_FIFO, tx_buffer, size);
+    }
+}
+
+static void fifo_read(enum path path, uint8_t size)
+{
+    if (path == PATH_BURST) {
+        SpiBurstRead(&SX1276.Spi, REG_LR_FIFO, rx_buffer, size);
+    } else {
+        SX1276ReadBuffer(REG_LR_FIFO, rx_buffer, size);
+    }
+}
+
+static void benchmark(enum path path, uint8_t size, float* write_us, float* read_us)
+{
+    uint64_t write_total = 0;
+    uint64_t read_total = 0;
+
+    SpiBurstSetEnabled(&SX1276.Spi, path != PATH_BYTE);
+
+    // the read ahead length, as set by the driver when a frame is received
+    SX1276.Settings.LoRaPacketHandler.Size = size;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint64_t start;
+
+        memset(rx_buffer, 0x00, size);
+
+        SX1276Write(REG_LR_FIFOADDRPTR, 0);
+        start = time_us_64();
+        fifo_write(path, size);
+        write_total += time_us_64() - start;
+
+        SX1276Write(REG_LR_FIFOADDRPTR, 0);
+        start = time_us_64();
+        fifo_read(path, size);
+        read_total += time_us_64() - start;
+
+        if (memcmp(tx_buffer, rx_buffer, size) != 0) {
+            printf("FIFO read back mismatch!\n");
+        }
+    }
+
+    *write_us = (float)write_total / ITERATIONS;
+    *read_us = (float)read_total / ITERATIONS;
+}
+
+int main( void )
+{
+    static const uint8_t sizes[] = { 64, 128, 255 };
+    static const char* paths[] = { "byte by byte", "framed burst", "SpiBurst API" };
+
+    // initialize stdio and wait for USB CDC connect
+    stdio_init_all();
+
+    while (!tud_cdc_connected()) {
+        tight_loop_contents();
+    }
+    printf("Pico LoRaWAN - SPI Benchmark\n\n");
+
+    // initialize the LoRaWAN stack
+    printf("Initilizating LoRaWAN ... ");
+    if (lorawan_init(&sx1276_settings, LORAWAN_REGION) < 0) {
+        printf("failed!!!\n");
+        while (1) {
+            tight_loop_contents();
+        }
+    } else {
+        printf("success!\n");
+    }
+
+    // the FIFO can not be accessed in sleep mode
+    SX1276SetModem(MODEM_LORA);
+    SX1276SetStby();
+
+    for (int i = 0; i < sizeof(tx_buffer); i++) {
+        tx_buffer[i] = i * 7 + 1;
+    }
+
+    printf("\n%-14s %5s %12s %12s\n", "path", "bytes", "write (us)", "read (us)");
+
+    for (int i = 0; i < sizeof(sizes); i++) {
+        for (int path = PATH_BYTE; path <= PATH_BURST; path++) {
+            float write_us;
+            float read_us;
+
+            benchmark(path, sizes[i], &write_us, &read_us);
+
+            printf("%-14s %5u %12.1f %12.1f\n", paths[path], sizes[i], write_us, read_us);
+        }
+    }
+
+    SpiBurstSetEnabled(&SX1276.Spi, true);
+
+    while (1) {
+        tight_loop_contents();
+    }
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _BOARD_IRQ_H_
+#define _BOARD_IRQ_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Interrupt handling around flash operations.
+ *
+ * By default, all interrupts are masked while flash is erased or programmed,
+ * as their handlers may run from flash. With PICO_LORAWAN_RAM_IRQ, the radio
+ * DIO and RTC alarm handlers run from RAM and stay enabled: if they fire
+ * during a flash operation, the work that needs flash is deferred until the
+ * operation completes.
+ */
+
+#if PICO_LORAWAN_RAM_IRQ
+#include "pico.h"
+
+#define BOARD_RAM_FUNC( func ) __not_in_flash_func( func )
+#else
+#define BOARD_RAM_FUNC( func ) func
+#endif
+
+typedef void ( BoardIrqDeferredHandler_t )( void* context );
+
+/*!
+ * \brief Enters a flash operation, XIP can not be used until
+ *        BoardFlashOperationEnd( ) is called
+ */
+void BoardFlashOperationBegin( void );
+
+/*!
+ * \brief Leaves a flash operation and runs the deferred interrupt handlers
+ */
+void BoardFlashOperationEnd( void );
+
+/*!
+ * \brief Keeps an interrupt enabled during flash operations, its handler
+ *        must run from RAM
+ *
+ * \param [IN] irq     Interrupt number
+ * \param [IN] sources Number of distinct handler and context pairs the
+ *                     interrupt passes to BoardIrqDefer( )
+ */
+void BoardIrqSetRamResident( uint32_t irq, uint32_t sources );
+
+/*!
+ * \brief Defers handler until the current flash operation completes, a
+ *        handler and context pair already pending is not queued again
+ *
+ * \retval true if deferred, false if no flash operation is in progress and
+ *         the caller must run the handler itself
+ */
+bool BoardIrqDefer( BoardIrqDeferredHandler_t* handler, void* context );
+
+/*!
+ * \brief Records how late an interrupt was serviced
+ */
+void BoardIrqRecordLatency( uint32_t latency );
+
+/*!
+ * \brief Gets the worst interrupt latency recorded since boot in us
+ */
+uint32_t BoardIrqGetMaxLatency( void );
+
+/*!
+ * \brief Gets the number of deferred handlers dropped since boot, for lack
+ *        of room in the deferred queue
+ */
+uint32_t BoardIrqGetDrops( void );
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _BOARD_SLEEP_H_
+#define _BOARD_SLEEP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Sleeping between events. The LoRaMac timer list keeps the RTC alarm set
+ * to its earliest timer, so the alarm is the next deadline of the MAC.
+ *
+ * With PICO_LORAWAN_DEEP_SLEEP, the RP2040 gates all clocks but the ones of
+ * the timer and the GPIO interrupts while sleeping.
+ */
+
+/*!
+ * \brief Gets the time the RTC alarm fires, in us since boot
+ *
+ * \retval false if the alarm is not armed
+ */
+bool RtcGetAlarmTime( uint64_t* time );
+
+/*!
+ * \brief Sleeps until an interrupt is pending or wakeTime is reached
+ *
+ * \remark Must be called with interrupts masked, pending interrupts are
+ *         serviced once they are unmasked again
+ *
+ * \param [IN] wakeTime In us since boot, 0 to only wake on an interrupt
+ */
+void BoardSleepUntil( uint64_t wakeTime );
+
+/*!
+ * \brief Lets time pass for a task waiting for an interrupt or wakeTime
+ *
+ * \remark Time passes by itself on the RP2040, the host port jumps its virtual
+ *         clock to the next simulated interrupt or to wakeTime instead
+ *
+ * \param [IN] wakeTime In us since boot, 0 to only wait for an interrupt
+ *
+ * \retval false if the task has to block to let time pass
+ */
+bool BoardAdvanceTime( uint64_t wakeTime );
+
+#endif
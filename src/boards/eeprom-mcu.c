@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+
+#include "pico/time.h"
+#include "pico/lorawan.h"
+
+#include "utilities.h"
+#include "eeprom-board.h"
+#include "eeprom-mcu.h"
+#include "nvm-channel-plan.h"
+
+static const struct lorawan_nvm_backend* eeprom_backend = &EepromMcuFlashBackend;
+static void* eeprom_context;
+
+static struct nvm_channel_plan* eeprom_channel_plan;
+
+static EepromMcuStats_t eeprom_stats;
+static EepromMcuWriteHook_t eeprom_write_hook;
+
+// spent in writes since the last flush, backends without a RAM copy write
+// through to the device
+static uint64_t eeprom_write_time_us;
+
+void EepromMcuSetBackend( const struct lorawan_nvm_backend* backend, void* context )
+{
+    eeprom_backend = (backend != NULL) ? backend : &EepromMcuFlashBackend;
+    eeprom_context = context;
+}
+
+void EepromMcuSetChannelPlan( struct nvm_channel_plan* plan )
+{
+    eeprom_channel_plan = plan;
+}
+
+uint8_t EepromMcuInit( uint16_t size )
+{
+    uint32_t backendSize = (eeprom_backend->size != NULL) ? eeprom_backend->size(eeprom_context) : EEPROM_MCU_IMAGE_SIZE;
+
+    // a smaller FRAM would fail the writes past its end, and only then
+    if (backendSize < size) {
+        return FAIL;
+    }
+
+    if (eeprom_backend->init(eeprom_context) != 0) {
+        return FAIL;
+    }
+
+    if (eeprom_channel_plan != NULL) {
+        eeprom_channel_plan->read = eeprom_backend->read;
+        eeprom_channel_plan->write = eeprom_backend->write;
+        eeprom_channel_plan->context = eeprom_context;
+
+        // the record is read again from the backend
+        if (nvm_channel_plan_init(eeprom_channel_plan) != 0) {
+            return FAIL;
+        }
+    }
+
+    return SUCCESS;
+}
+
+uint8_t EepromMcuReadBuffer( uint16_t addr, uint8_t *buffer, uint16_t size )
+{
+    if (eeprom_channel_plan != NULL) {
+        return (nvm_channel_plan_read(eeprom_channel_plan, addr, buffer, size) == 0) ? SUCCESS : FAIL;
+    }
+
+    return (eeprom_backend->read(eeprom_context, addr, buffer, size) == 0) ? SUCCESS : FAIL;
+}
+
+uint8_t EepromMcuWriteBuffer( uint16_t addr, uint8_t *buffer, uint16_t size )
+{
+    uint64_t start = to_us_since_boot(get_absolute_time());
+    uint32_t written = size;
+    int result;
+
+    if (eeprom_write_hook != NULL) {
+        buffer = eeprom_write_hook(addr, buffer, size);
+    }
+
+    if (eeprom_channel_plan != NULL) {
+        result = nvm_channel_plan_write(eeprom_channel_plan, addr, buffer, size, &written);
+    } else {
+        result = eeprom_backend->write(eeprom_context, addr, buffer, size);
+    }
+
+    eeprom_write_time_us += to_us_since_boot(get_absolute_time()) - start;
+    eeprom_stats.BytesWritten += written;
+
+    return (result == 0) ? SUCCESS : FAIL;
+}
+
+uint8_t EepromMcuFlush()
+{
+    uint64_t start = to_us_since_boot(get_absolute_time());
+    uint32_t elapsed;
+    int result;
+
+    eeprom_stats.Flushes++;
+
+    result = eeprom_backend->flush(eeprom_context);
+
+    if (result == 1) {
+        eeprom_stats.SkippedFlushes++;
+        eeprom_write_time_us = 0;
+
+        return SUCCESS;
+    }
+
+    elapsed = (uint32_t)(to_us_since_boot(get_absolute_time()) - start + eeprom_write_time_us);
+    eeprom_write_time_us = 0;
+
+    eeprom_stats.LastFlushTimeUs = elapsed;
+    eeprom_stats.TotalFlushTimeUs += elapsed;
+
+    if (elapsed > eeprom_stats.MaxFlushTimeUs) {
+        eeprom_stats.MaxFlushTimeUs = elapsed;
+    }
+
+    return (result == 0) ? SUCCESS : FAIL;
+}
+
+bool EepromMcuProcess()
+{
+    if (eeprom_backend->process == NULL) {
+        return false;
+    }
+
+    return eeprom_backend->process(eeprom_context);
+}
+
+void EepromMcuGetStats( EepromMcuStats_t* stats )
+{
+    *stats = eeprom_stats;
+
+    if (eeprom_backend == &EepromMcuFlashBackend) {
+        EepromMcuFlashGetStats(stats);
+    }
+}
+
+void EepromMcuSetWriteHook( EepromMcuWriteHook_t hook )
+{
+    eeprom_write_hook = hook;
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _EEPROM_MCU_H_
+#define _EEPROM_MCU_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct lorawan_nvm_backend;
+struct nvm_channel_plan;
+
+/*!
+ * NVM storage behind the LoRaMac-node eeprom-board.h API. The calls are
+ * passed on to a struct lorawan_nvm_backend, the internal flash one of the
+ * board port unless another one was set.
+ *
+ * The internal flash backend emulates an EEPROM. With
+ * PICO_LORAWAN_NVM_SECTORS set to 1, the image is kept in the last flash
+ * sector and only the pages that changed are written on a flush, the sector
+ * is erased only when a change sets bits. With more sectors, the image is
+ * journaled over a ring of that many sectors at the end of flash.
+ *
+ * Both keep a RAM copy of the image. With PICO_LORAWAN_NVM_LEAN, the single
+ * sector image is read from flash instead, and only the pages changed since
+ * the last flush are held in RAM, in buffers taken from the heap.
+ */
+
+/*!
+ * Size of the image of the internal flash backend, and of a backend that
+ * does not report its size
+ */
+#define EEPROM_MCU_IMAGE_SIZE   (4096)
+
+typedef struct EepromMcuStats_s
+{
+    uint32_t Flushes;
+    uint32_t SkippedFlushes;    // nothing changed, flash was not touched
+    uint32_t Erases;
+    uint32_t SkippedErases;     // changes only cleared bits, pages were programmed in place
+    uint32_t PagesProgrammed;
+    uint32_t MaxSectorErases;
+    uint32_t LastFlushTimeUs;
+    uint32_t MaxFlushTimeUs;
+    uint64_t TotalFlushTimeUs;
+    uint32_t RamBytes;          // of the image and page buffers held in RAM now
+    uint32_t MaxRamBytes;
+    uint32_t BytesWritten;      // handed to the backend
+} EepromMcuStats_t;
+
+/*!
+ * Internal flash backend of the board port
+ */
+extern const struct lorawan_nvm_backend EepromMcuFlashBackend;
+
+/*!
+ * \brief Called before data is written to the EEPROM image
+ *
+ * \param [IN] addr   EEPROM address of the write
+ * \param [IN] buffer Data to write
+ * \param [IN] size   Number of bytes to write
+ *
+ * \retval Data to write in place of buffer, or buffer itself
+ */
+typedef uint8_t* ( *EepromMcuWriteHook_t )( uint16_t addr, uint8_t* buffer, uint16_t size );
+
+/*!
+ * \brief Selects the backend, before EepromMcuInit(), NULL for internal flash
+ */
+void EepromMcuSetBackend( const struct lorawan_nvm_backend* backend, void* context );
+
+/*!
+ * \brief Stores the channel array of the LoRaMac-node region group as the
+ *        channels that differ from the region defaults, see
+ *        nvm-channel-plan.h, before EepromMcuInit()
+ *
+ * \param [IN] plan Layout and defaults of the array, NULL to store the array
+ *                  as it is
+ */
+void EepromMcuSetChannelPlan( struct nvm_channel_plan* plan );
+
+/*!
+ * \brief Initializes the backend
+ *
+ * \param [IN] size Number of bytes the stack stores, from address 0
+ *
+ * \retval status [SUCCESS, FAIL], FAIL if the backend holds less than size
+ */
+uint8_t EepromMcuInit( uint16_t size );
+
+/*!
+ * \brief Makes the changes written so far persistent
+ *
+ * \retval status [SUCCESS, FAIL]
+ */
+uint8_t EepromMcuFlush( void );
+
+/*!
+ * \brief Background maintenance, to be called when the stack is idle
+ *
+ * \retval true if flash was erased or programmed
+ */
+bool EepromMcuProcess( void );
+
+/*!
+ * \brief Gets the NVM usage counters since boot
+ */
+void EepromMcuGetStats( EepromMcuStats_t* stats );
+
+/*!
+ * \brief Gets the counters of the internal flash backend, erases, pages
+ *        programmed and RAM, the other fields are left untouched
+ */
+void EepromMcuFlashGetStats( EepromMcuStats_t* stats );
+
+/*!
+ * \brief Sets the hook called before every write, NULL to remove it
+ */
+void EepromMcuSetWriteHook( EepromMcuWriteHook_t hook );
+
+#endif
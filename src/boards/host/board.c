@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "board.h"
+#include "board-irq.h"
+#include "board-sleep.h"
+#include "sim-clock.h"
+
+/*!
+ * Unique ID reported by the simulated board
+ */
+static const uint8_t board_unique_id[8] = { 0xe6, 0x60, 0x58, 0x38, 0x83, 0x00, 0x00, 0x01 };
+
+static uint32_t board_max_irq_latency = 0;
+
+void BoardInitMcu( void )
+{
+}
+
+void BoardInitPeriph( void )
+{
+}
+
+void BoardLowPowerHandler( void )
+{
+    // sleeping is jumping ahead to the next "interrupt"
+    SimClockRunNext();
+}
+
+void BoardSleepUntil( uint64_t wakeTime )
+{
+    // "interrupts" are masked, the event that is due fires once they are not
+    BoardAdvanceTime(wakeTime);
+}
+
+bool BoardAdvanceTime( uint64_t wakeTime )
+{
+    uint64_t deadline;
+
+    if (SimClockNextDeadline(&deadline) && (wakeTime == 0 || deadline < wakeTime)) {
+        SimClockAdvanceTo(deadline);
+    } else if (wakeTime != 0) {
+        SimClockAdvanceTo(wakeTime);
+    } else {
+        // nothing would ever happen
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t BoardGetBatteryLevel( void )
+{
+    return 0;
+}
+
+uint32_t BoardGetRandomSeed( void )
+{
+    uint8_t id[8];
+
+    BoardGetUniqueId(id);
+
+    return (id[3] << 24) | (id[2] << 16) | (id[1] << 1) | id[0];
+}
+
+void BoardGetUniqueId( uint8_t *id )
+{
+    memcpy(id, board_unique_id, 8);
+}
+
+void BoardCriticalSectionBegin( uint32_t *mask )
+{
+    *mask = 0;
+
+    SimClockLock();
+}
+
+void BoardCriticalSectionEnd( uint32_t *mask )
+{
+    SimClockUnlock();
+}
+
+void BoardResetMcu( void )
+{
+}
+
+/*
+ * There is no XIP on the host, flash operations simply hold back the virtual
+ * time events like the default RP2040 build masks interrupts.
+ */
+void BoardFlashOperationBegin( void )
+{
+    SimClockLock();
+}
+
+void BoardFlashOperationEnd( void )
+{
+    SimClockUnlock();
+}
+
+void BoardIrqSetRamResident( uint32_t irq, uint32_t sources )
+{
+}
+
+bool BoardIrqDefer( BoardIrqDeferredHandler_t* handler, void* context )
+{
+    return false;
+}
+
+void BoardIrqRecordLatency( uint32_t latency )
+{
+    if (latency > board_max_irq_latency) {
+        board_max_irq_latency = latency;
+    }
+}
+
+uint32_t BoardIrqGetMaxLatency( void )
+{
+    return board_max_irq_latency;
+}
+
+uint32_t BoardIrqGetDrops( void )
+{
+    return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include "sim-clock.h"
+
+#include "delay-board.h"
+
+void DelayMsMcu( uint32_t ms )
+{
+    // "interrupts" keep firing while busy waiting
+    SimClockAdvanceTo(SimClockNow() + (uint64_t)ms * 1000);
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/lorawan.h"
+#include "sim-clock.h"
+
+#include "utilities.h"
+#include "board-irq.h"
+#include "eeprom-board.h"
+#include "eeprom-mcu.h"
+#include "nvm-cow.h"
+#include "nvm-journal.h"
+
+#ifndef PICO_LORAWAN_NVM_SECTORS
+#define PICO_LORAWAN_NVM_SECTORS (1)
+#endif
+
+#ifndef PICO_LORAWAN_NVM_LEAN
+#define PICO_LORAWAN_NVM_LEAN (0)
+#endif
+
+#define FLASH_SECTOR_SIZE   (4096)
+#define FLASH_PAGE_SIZE     (256)
+#define EEPROM_PAGES        (FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE)
+
+// typical timings of the W25Q16JV flash on the Pico
+#define FLASH_ERASE_TIME_US   (45000)
+#define FLASH_PROGRAM_TIME_US (400)
+
+#define EEPROM_SIZE         (FLASH_SECTOR_SIZE)
+#define EEPROM_DEFAULT_PATH "pico_lorawan_eeprom.bin"
+
+#if PICO_LORAWAN_NVM_LEAN
+// read from the simulated flash, only the pages being changed are held in RAM
+static struct nvm_cow eeprom_cow;
+#else
+static uint8_t eeprom_write_cache[EEPROM_SIZE];
+#endif
+
+/*!
+ * Simulated NOR flash holding the NVM sectors, programming can only clear
+ * bits and erasing sets a whole sector back to 0xff.
+ */
+static uint8_t eeprom_flash_data[FLASH_SECTOR_SIZE * PICO_LORAWAN_NVM_SECTORS];
+
+static EepromMcuStats_t eeprom_stats;
+static uint32_t eeprom_sector_erases[PICO_LORAWAN_NVM_SECTORS];
+
+/*!
+ * The flash contents are kept in a file, named by the PICO_LORAWAN_HOST_EEPROM
+ * environment variable, so state survives across runs like it does on
+ * the board.
+ */
+static const char* EepromMcuPath( void )
+{
+    const char* path = getenv("PICO_LORAWAN_HOST_EEPROM");
+
+    return (path != NULL) ? path : EEPROM_DEFAULT_PATH;
+}
+
+static void EepromMcuFlashLoad( void )
+{
+    FILE* file;
+    size_t size;
+
+    // erased flash reads as 0xff
+    memset(eeprom_flash_data, 0xff, sizeof(eeprom_flash_data));
+
+    file = fopen(EepromMcuPath(), "rb");
+    if (file == NULL) {
+        return;
+    }
+
+    size = fread(eeprom_flash_data, 1, sizeof(eeprom_flash_data), file);
+    fclose(file);
+
+    if (size == EEPROM_SIZE && size != sizeof(eeprom_flash_data)) {
+        // single sector file, it belongs in the last sector like on the board
+        memmove(eeprom_flash_data + sizeof(eeprom_flash_data) - EEPROM_SIZE, eeprom_flash_data, EEPROM_SIZE);
+        memset(eeprom_flash_data, 0xff, sizeof(eeprom_flash_data) - EEPROM_SIZE);
+    }
+}
+
+static uint8_t EepromMcuFlashSave( void )
+{
+    FILE* file = fopen(EepromMcuPath(), "wb");
+
+    if (file == NULL) {
+        return FAIL;
+    }
+
+    if (fwrite(eeprom_flash_data, 1, sizeof(eeprom_flash_data), file) != sizeof(eeprom_flash_data)) {
+        fclose(file);
+        return FAIL;
+    }
+
+    fclose(file);
+
+    return SUCCESS;
+}
+
+/*!
+ * Flash operations stall the CPU with interrupts masked on the board, do the
+ * same to virtual time.
+ */
+static void EepromMcuFlashBusy( uint32_t us )
+{
+    BoardFlashOperationBegin();
+    SimClockAdvanceTo(SimClockNow() + us);
+    BoardFlashOperationEnd();
+}
+
+static void EepromMcuFlashRead( void* context, uint32_t offset, void* data, uint32_t size )
+{
+    memcpy(data, eeprom_flash_data + offset, size);
+}
+
+static int EepromMcuFlashErase( void* context, uint32_t offset )
+{
+    uint32_t sector = offset / FLASH_SECTOR_SIZE;
+
+    memset(eeprom_flash_data + offset, 0xff, FLASH_SECTOR_SIZE);
+    EepromMcuFlashBusy(FLASH_ERASE_TIME_US);
+
+    eeprom_stats.Erases++;
+    eeprom_sector_erases[sector]++;
+
+    if (eeprom_sector_erases[sector] > eeprom_stats.MaxSectorErases) {
+        eeprom_stats.MaxSectorErases = eeprom_sector_erases[sector];
+    }
+
+    return 0;
+}
+
+static int EepromMcuFlashProgram( void* context, uint32_t offset, const void* data, uint32_t size )
+{
+    const uint8_t* bytes = data;
+
+    for (uint32_t i = 0; i < size; i++) {
+        eeprom_flash_data[offset + i] &= bytes[i];
+    }
+
+    EepromMcuFlashBusy(FLASH_PROGRAM_TIME_US * (size / FLASH_PAGE_SIZE));
+
+    eeprom_stats.PagesProgrammed += size / FLASH_PAGE_SIZE;
+
+    return 0;
+}
+
+void EepromMcuFlashGetStats( EepromMcuStats_t* stats )
+{
+    stats->Erases = eeprom_stats.Erases;
+    stats->SkippedErases = eeprom_stats.SkippedErases;
+    stats->PagesProgrammed = eeprom_stats.PagesProgrammed;
+    stats->MaxSectorErases = eeprom_stats.MaxSectorErases;
+
+#if PICO_LORAWAN_NVM_LEAN
+    stats->SkippedErases = eeprom_cow.stats.skipped_erases;
+    stats->RamBytes = eeprom_cow.stats.buffer_bytes;
+    stats->MaxRamBytes = eeprom_cow.stats.max_buffer_bytes;
+#else
+    stats->RamBytes = sizeof(eeprom_write_cache);
+    stats->MaxRamBytes = sizeof(eeprom_write_cache);
+#endif
+}
+
+#if PICO_LORAWAN_NVM_SECTORS > 1 || PICO_LORAWAN_NVM_LEAN
+
+static const struct nvm_journal_flash eeprom_flash = {
+    .sector_size = FLASH_SECTOR_SIZE,
+    .page_size = FLASH_PAGE_SIZE,
+    .sector_count = PICO_LORAWAN_NVM_SECTORS,
+    .context = NULL,
+    .read = EepromMcuFlashRead,
+    .erase = EepromMcuFlashErase,
+    .program = EepromMcuFlashProgram
+};
+
+#endif
+
+#if PICO_LORAWAN_NVM_LEAN
+
+static int EepromBackendInit( void* context )
+{
+    EepromMcuFlashLoad();
+
+    return nvm_cow_init(&eeprom_cow, &eeprom_flash);
+}
+
+static int EepromBackendRead( void* context, uint16_t addr, void* buffer, uint16_t size )
+{
+    nvm_cow_read(&eeprom_cow, addr, buffer, size);
+
+    return 0;
+}
+
+static int EepromBackendWrite( void* context, uint16_t addr, const void* buffer, uint16_t size )
+{
+    return nvm_cow_write(&eeprom_cow, addr, buffer, size);
+}
+
+static int EepromBackendFlush( void* context )
+{
+    int result;
+
+    if (!nvm_cow_is_dirty(&eeprom_cow)) {
+        return 1;
+    }
+
+    result = nvm_cow_flush(&eeprom_cow);
+
+    if (EepromMcuFlashSave() != SUCCESS) {
+        return -1;
+    }
+
+    return result;
+}
+
+static bool EepromBackendProcess( void* context )
+{
+    return false;
+}
+
+#else
+
+static int EepromBackendRead( void* context, uint16_t addr, void* buffer, uint16_t size )
+{
+    memcpy(buffer, eeprom_write_cache + addr, size);
+
+    return 0;
+}
+
+#if PICO_LORAWAN_NVM_SECTORS > 1
+
+static struct nvm_journal eeprom_journal;
+
+static int EepromBackendInit( void* context )
+{
+    EepromMcuFlashLoad();
+
+    memset(eeprom_write_cache, 0xff, sizeof(eeprom_write_cache));
+
+    if (nvm_journal_init(&eeprom_journal, &eeprom_flash, eeprom_write_cache, sizeof(eeprom_write_cache)) == 1) {
+        // no journal yet, import the image of the single sector layout
+        memcpy(eeprom_write_cache, eeprom_flash_data + sizeof(eeprom_flash_data) - EEPROM_SIZE, sizeof(eeprom_write_cache));
+
+        nvm_journal_mark_all(&eeprom_journal);
+    }
+
+    return 0;
+}
+
+static int EepromBackendWrite( void* context, uint16_t addr, const void* buffer, uint16_t size )
+{
+    nvm_journal_write(&eeprom_journal, addr, buffer, size);
+
+    return 0;
+}
+
+static int EepromBackendFlush( void* context )
+{
+    int result;
+
+    if (!nvm_journal_is_dirty(&eeprom_journal)) {
+        return 1;
+    }
+
+    result = nvm_journal_flush(&eeprom_journal);
+
+    if (EepromMcuFlashSave() != SUCCESS) {
+        return -1;
+    }
+
+    return result;
+}
+
+static bool EepromBackendProcess( void* context )
+{
+    if (!nvm_journal_process(&eeprom_journal)) {
+        return false;
+    }
+
+    EepromMcuFlashSave();
+
+    return true;
+}
+
+#else
+
+// pages of the cache that were written to since the last flush
+static uint32_t eeprom_dirty_pages;
+
+static int EepromBackendInit( void* context )
+{
+    EepromMcuFlashLoad();
+
+    memcpy(eeprom_write_cache, eeprom_flash_data, sizeof(eeprom_write_cache));
+
+    eeprom_dirty_pages = 0;
+
+    return 0;
+}
+
+static int EepromBackendWrite( void* context, uint16_t addr, const void* buffer, uint16_t size )
+{
+    const uint8_t* data = buffer;
+
+    for (uint16_t i = 0; i < size; i++) {
+        if (eeprom_write_cache[addr + i] != data[i]) {
+            eeprom_write_cache[addr + i] = data[i];
+            eeprom_dirty_pages |= (1u << ((addr + i) / FLASH_PAGE_SIZE));
+        }
+    }
+
+    return 0;
+}
+
+static int EepromBackendFlush( void* context )
+{
+    uint32_t pages = 0;
+    bool erase = false;
+
+    // compare the dirty pages against flash
+    for (uint32_t page = 0; page < EEPROM_PAGES; page++) {
+        const uint8_t* flash = eeprom_flash_data + page * FLASH_PAGE_SIZE;
+        const uint8_t* cache = eeprom_write_cache + page * FLASH_PAGE_SIZE;
+
+        if (!(eeprom_dirty_pages & (1u << page)) || memcmp(flash, cache, FLASH_PAGE_SIZE) == 0) {
+            continue;
+        }
+
+        pages |= (1u << page);
+
+        // programming can only clear bits
+        for (uint32_t i = 0; i < FLASH_PAGE_SIZE && !erase; i++) {
+            if ((flash[i] & cache[i]) != cache[i]) {
+                erase = true;
+            }
+        }
+    }
+
+    eeprom_dirty_pages = 0;
+
+    if (pages == 0) {
+        return 1;
+    }
+
+    if (erase) {
+        // after the erase, every page that isn't blank must be programmed again
+        pages = 0;
+
+        for (uint32_t page = 0; page < EEPROM_PAGES; page++) {
+            const uint8_t* cache = eeprom_write_cache + page * FLASH_PAGE_SIZE;
+
+            for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+                if (cache[i] != 0xff) {
+                    pages |= (1u << page);
+                    break;
+                }
+            }
+        }
+
+        EepromMcuFlashErase(NULL, 0);
+    } else {
+        eeprom_stats.SkippedErases++;
+    }
+
+    for (uint32_t page = 0; page < EEPROM_PAGES; page++) {
+        if (pages & (1u << page)) {
+            EepromMcuFlashProgram(NULL, page * FLASH_PAGE_SIZE, eeprom_write_cache + page * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+        }
+    }
+
+    return (EepromMcuFlashSave() == SUCCESS) ? 0 : -1;
+}
+
+static bool EepromBackendProcess( void* context )
+{
+    return false;
+}
+
+#endif
+
+#endif
+
+const struct lorawan_nvm_backend EepromMcuFlashBackend = {
+    .init = EepromBackendInit,
+    .read = EepromBackendRead,
+    .write = EepromBackendWrite,
+    .flush = EepromBackendFlush,
+    .process = EepromBackendProcess,
+    .size = NULL
+};
@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stddef.h>
+
+#include "sx1276-sim.h"
+
+#include "gpio-board.h"
+#include "spi-burst.h"
+
+#define GPIO_HOST_PIN_COUNT 32
+
+static uint32_t gpio_levels[GPIO_HOST_PIN_COUNT];
+
+void GpioMcuInit( Gpio_t *obj, PinNames pin, PinModes mode, PinConfigs config, PinTypes type, uint32_t value )
+{
+    obj->pin = pin;
+
+    if( pin == NC )
+    {
+        return;
+    }
+
+    if (mode == PIN_INPUT && type == PIN_PULL_UP && pin < GPIO_HOST_PIN_COUNT)
+    {
+        gpio_levels[pin] = 1;
+    }
+
+    if( mode == PIN_OUTPUT )
+    {
+        GpioMcuWrite( obj, value );
+    }
+}
+
+void GpioMcuSetContext( Gpio_t *obj, void* context )
+{
+    obj->Context = context;
+}
+
+void GpioMcuSetInterrupt( Gpio_t *obj, IrqModes irqMode, IrqPriorities irqPriority, GpioIrqHandler *irqHandler )
+{
+    // DIO interrupts are delivered by the SX1276 model, see sx1276-board.c
+}
+
+void GpioMcuRemoveInterrupt( Gpio_t *obj )
+{
+}
+
+void GpioMcuWrite( Gpio_t *obj, uint32_t value )
+{
+    if (obj->pin == NC) {
+        return;
+    }
+
+    // the NSS line of the radio is driven by the SPI burst layer
+    if (SpiBurstOnNssWrite(obj, value)) {
+        return;
+    }
+
+    if (obj->pin < GPIO_HOST_PIN_COUNT) {
+        gpio_levels[obj->pin] = value;
+    }
+
+    SX1276SimPinWrite(obj->pin, value);
+}
+
+void GpioMcuToggle( Gpio_t *obj )
+{
+    GpioMcuWrite(obj, GpioMcuRead(obj) ? 0 : 1);
+}
+
+uint32_t GpioMcuRead( Gpio_t *obj )
+{
+    uint32_t value = 0;
+
+    if (obj->pin == NC) {
+        return 0;
+    }
+
+    if (SX1276SimPinRead(obj->pin, &value)) {
+        return value;
+    }
+
+    if (obj->pin < GPIO_HOST_PIN_COUNT) {
+        value = gpio_levels[obj->pin];
+    }
+
+    return value;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HOST_HARDWARE_CLOCKS_H_
+#define _HOST_HARDWARE_CLOCKS_H_
+
+#include <stdint.h>
+
+/*!
+ * Minimal stand-in for the Pico SDK header, the simulated system clock runs
+ * at the RP2040 default of 125 MHz.
+ */
+enum clock_index {
+    clk_sys = 5
+};
+
+static inline uint32_t clock_get_hz(enum clock_index clk_index)
+{
+    return 125 * 1000 * 1000;
+}
+
+#endif
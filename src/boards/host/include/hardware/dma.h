@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HOST_HARDWARE_DMA_H_
+#define _HOST_HARDWARE_DMA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+/*!
+ * Minimal stand-in for the Pico SDK header. The host port has no DMA
+ * channels to claim, so the board code takes its CPU paths.
+ */
+enum dma_channel_transfer_size {
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+typedef struct {
+    uint32_t ctrl;
+} dma_channel_config;
+
+static inline int dma_claim_unused_channel(bool required)
+{
+    return -1;
+}
+
+static inline dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    dma_channel_config c = { 0 };
+
+    return c;
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size)
+{
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq)
+{
+}
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr)
+{
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr)
+{
+}
+
+static inline void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                                         const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+}
+
+static inline void dma_start_channel_mask(uint32_t chan_mask)
+{
+}
+
+static inline void dma_channel_wait_for_finish_blocking(uint channel)
+{
+}
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _HOST_HARDWARE_GPIO_H_
+#define _HOST_HARDWARE_GPIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Minimal stand-in for the Pico SDK header, enough for pico/lorawan.h to be
+ * used by the host port.
+ */
+typedef unsigned int uint;
+
+enum gpio_function {
+    GPIO_FUNC_SPI = 1,
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_PIO0 = 6,
+    GPIO_FUNC_PIO1 = 7,
+    GPIO_FUNC_NULL = 0x1f
+};
+
+/*!
+ * Only the pins handed to a PIO block are tracked, see pio-sim.c
+ */
+enum gpio_function gpio_get_function(uint gpio);
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HOST_HARDWARE_PIO_H_
+#define _HOST_HARDWARE_PIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+/*!
+ * Stand-in for the Pico SDK header, backed by the instruction level model
+ * of the PIO state machines in pio-sim.c. Instead of running alongside the
+ * CPU, a state machine runs whenever its FIFOs are accessed, until it
+ * stalls.
+ */
+#define NUM_PIO_STATE_MACHINES  4
+#define PIO_INSTRUCTION_COUNT   32
+
+typedef struct pio_program {
+    const uint16_t *instructions;
+    uint8_t length;
+    int8_t origin;
+} pio_program_t;
+
+typedef struct {
+    float clkdiv;
+    uint wrap_target;
+    uint wrap;
+    uint sideset_bit_count;
+    bool sideset_optional;
+    bool sideset_pindirs;
+    uint sideset_base;
+    uint out_base;
+    uint out_count;
+    uint set_base;
+    uint set_count;
+    uint in_base;
+    bool out_shift_right;
+    bool autopull;
+    uint pull_threshold;
+    bool in_shift_right;
+    bool autopush;
+    uint push_threshold;
+} pio_sm_config;
+
+typedef struct pio_hw {
+    uint8_t index;
+    uint32_t txf[NUM_PIO_STATE_MACHINES];   // only used as DMA addresses
+    uint32_t rxf[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t host_pio_hw[2];
+
+#define pio0 (&host_pio_hw[0])
+#define pio1 (&host_pio_hw[1])
+
+static inline uint pio_get_index(PIO pio)
+{
+    return pio->index;
+}
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx)
+{
+    return (pio->index * 8) + (is_tx ? 0 : 4) + sm;
+}
+
+static inline pio_sm_config pio_get_default_sm_config(void)
+{
+    pio_sm_config c = {
+        .clkdiv = 1.0f,
+        .wrap_target = 0,
+        .wrap = PIO_INSTRUCTION_COUNT - 1,
+        .out_count = 32,
+        .out_shift_right = true,
+        .pull_threshold = 32,
+        .in_shift_right = true,
+        .push_threshold = 32
+    };
+
+    return c;
+}
+
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap)
+{
+    c->wrap_target = wrap_target;
+    c->wrap = wrap;
+}
+
+static inline void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs)
+{
+    c->sideset_bit_count = bit_count;
+    c->sideset_optional = optional;
+    c->sideset_pindirs = pindirs;
+}
+
+static inline void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base)
+{
+    c->sideset_base = sideset_base;
+}
+
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count)
+{
+    c->out_base = out_base;
+    c->out_count = out_count;
+}
+
+static inline void sm_config_set_set_pins(pio_sm_config *c, uint set_base, uint set_count)
+{
+    c->set_base = set_base;
+    c->set_count = set_count;
+}
+
+static inline void sm_config_set_in_pins(pio_sm_config *c, uint in_base)
+{
+    c->in_base = in_base;
+}
+
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold)
+{
+    c->out_shift_right = shift_right;
+    c->autopull = autopull;
+    c->pull_threshold = pull_threshold ? pull_threshold : 32;
+}
+
+static inline void sm_config_set_in_shift(pio_sm_config *c, bool shift_right, bool autopush, uint push_threshold)
+{
+    c->in_shift_right = shift_right;
+    c->autopush = autopush;
+    c->push_threshold = push_threshold ? push_threshold : 32;
+}
+
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div)
+{
+    c->clkdiv = div;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+
+uint pio_add_program(PIO pio, const pio_program_t *program);
+
+int pio_claim_unused_sm(PIO pio, bool required);
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+
+void pio_sm_set_pins_with_mask(PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask);
+
+void pio_sm_set_pindirs_with_mask(PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask);
+
+void pio_gpio_init(PIO pio, uint pin);
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+
+uint32_t pio_sm_get(PIO pio, uint sm);
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _HOST_HARDWARE_SPI_H_
+#define _HOST_HARDWARE_SPI_H_
+
+#include <stdint.h>
+
+#include "hardware/gpio.h"
+
+/*!
+ * Minimal stand-in for the Pico SDK header, the SPI instances only select
+ * the simulated bus.
+ */
+typedef struct spi_inst {
+    uint8_t index;
+} spi_inst_t;
+
+extern spi_inst_t host_spi_inst[2];
+
+#define spi0 (&host_spi_inst[0])
+#define spi1 (&host_spi_inst[1])
+
+#endif
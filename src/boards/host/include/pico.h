@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _HOST_PICO_H_
+#define _HOST_PICO_H_
+
+/*!
+ * Stand-in for the Pico SDK header, code and data placement attributes have
+ * no meaning on the host.
+ */
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+
+#endif
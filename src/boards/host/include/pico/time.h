@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _HOST_PICO_TIME_H_
+#define _HOST_PICO_TIME_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim-clock.h"
+
+/*!
+ * Subset of the Pico SDK time API backed by the virtual clock of the host
+ * port. Waiting does not take wall clock time, it jumps ahead to the next
+ * simulated interrupt.
+ */
+typedef uint64_t absolute_time_t;
+
+static const absolute_time_t at_the_end_of_time = INT64_MAX;
+
+static inline absolute_time_t get_absolute_time(void)
+{
+    return SimClockNow();
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t)
+{
+    return t;
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us)
+{
+    return us;
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return (uint32_t)(t / 1000);
+}
+
+static inline absolute_time_t delayed_by_us(const absolute_time_t t, uint64_t us)
+{
+    return t + us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+    return SimClockNow() + (uint64_t)ms * 1000;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+static inline bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp)
+{
+    uint64_t deadline;
+
+    if (SimClockNextDeadline(&deadline) && deadline < timeout_timestamp) {
+        SimClockRunNext();
+
+        return false;
+    }
+
+    SimClockAdvanceTo(timeout_timestamp);
+
+    return true;
+}
+
+static inline void sleep_until(absolute_time_t t)
+{
+    SimClockAdvanceTo(t);
+}
+
+static inline void sleep_ms(uint32_t ms)
+{
+    sleep_until(make_timeout_time_ms(ms));
+}
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sim-clock.h"
+
+#include "nvm-file.h"
+
+#define NVM_FILE_SIZE       (4096)
+
+// SPI clock of the FRAM being modelled
+#define NVM_FILE_SPI_HZ     (10 * 1000 * 1000)
+
+// a command byte and two address bytes lead every read and write
+#define NVM_FILE_HEADER     (3)
+
+static FILE* nvm_file;
+
+// writes since the last flush, they are already in the file
+static bool nvm_file_dirty;
+
+static void nvm_file_busy(uint32_t bytes)
+{
+    SimClockAdvanceTo(SimClockNow() + ((uint64_t)bytes * 8 * 1000000 + NVM_FILE_SPI_HZ - 1) / NVM_FILE_SPI_HZ);
+}
+
+static int nvm_file_init(void* context)
+{
+    const char* path = context;
+    uint8_t blank[NVM_FILE_SIZE];
+
+    if (nvm_file != NULL) {
+        fclose(nvm_file);
+    }
+
+    nvm_file = fopen(path, "r+b");
+
+    if (nvm_file == NULL) {
+        nvm_file = fopen(path, "w+b");
+
+        if (nvm_file == NULL) {
+            return -1;
+        }
+
+        memset(blank, 0x00, sizeof(blank));
+
+        if (fwrite(blank, 1, sizeof(blank), nvm_file) != sizeof(blank) || fflush(nvm_file) != 0) {
+            return -1;
+        }
+    }
+
+    nvm_file_dirty = false;
+
+    return 0;
+}
+
+static int nvm_file_read(void* context, uint16_t address, void* data, uint16_t size)
+{
+    if ((uint32_t)address + size > NVM_FILE_SIZE) {
+        return -1;
+    }
+
+    if (fseek(nvm_file, address, SEEK_SET) != 0 || fread(data, 1, size, nvm_file) != size) {
+        return -1;
+    }
+
+    nvm_file_busy(NVM_FILE_HEADER + size);
+
+    return 0;
+}
+
+static int nvm_file_write(void* context, uint16_t address, const void* data, uint16_t size)
+{
+    if ((uint32_t)address + size > NVM_FILE_SIZE) {
+        return -1;
+    }
+
+    // flushed to the OS on every write, so it survives the simulated power loss
+    if (fseek(nvm_file, address, SEEK_SET) != 0 || fwrite(data, 1, size, nvm_file) != size || fflush(nvm_file) != 0) {
+        return -1;
+    }
+
+    // and a write enable command before it
+    nvm_file_busy(1 + NVM_FILE_HEADER + size);
+
+    nvm_file_dirty = true;
+
+    return 0;
+}
+
+static int nvm_file_flush(void* context)
+{
+    if (!nvm_file_dirty) {
+        return 1;
+    }
+
+    nvm_file_dirty = false;
+
+    return 0;
+}
+
+const struct lorawan_nvm_backend lorawan_nvm_file = {
+    .init = nvm_file_init,
+    .read = nvm_file_read,
+    .write = nvm_file_write,
+    .flush = nvm_file_flush,
+    .process = NULL,
+    .size = NULL
+};
@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _NVM_FILE_H_
+#define _NVM_FILE_H_
+
+#include "pico/lorawan.h"
+
+/*!
+ * NVM backend for lorawan_nvm_set_backend( ) on the host, byte writable and
+ * never erased like an SPI FRAM. Writes go to the file right away and take
+ * the virtual time they take on a FRAM at 10 MHz. The context is the path of
+ * the file.
+ */
+extern const struct lorawan_nvm_backend lorawan_nvm_file;
+
+#endif
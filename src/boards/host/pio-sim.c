@@ -0,0 +1,598 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hardware/pio.h"
+
+#include "pio-sim.h"
+#include "sx1276-sim.h"
+
+#define PIO_SIM_FIFO_DEPTH  4
+#define PIO_SIM_PIN_COUNT   32
+
+enum pio_sim_opcode {
+    PIO_SIM_JMP,
+    PIO_SIM_WAIT,
+    PIO_SIM_IN,
+    PIO_SIM_OUT,
+    PIO_SIM_PUSH_PULL,
+    PIO_SIM_MOV,
+    PIO_SIM_IRQ,
+    PIO_SIM_SET
+};
+
+struct pio_sim_fifo {
+    uint32_t data[PIO_SIM_FIFO_DEPTH];
+    uint head;
+    uint count;
+};
+
+struct pio_sim_sm {
+    bool claimed;
+    bool enabled;
+    pio_sm_config config;
+    uint pc;
+    uint32_t x;
+    uint32_t y;
+    uint32_t osr;
+    uint32_t isr;
+    uint osr_count;     // bits shifted out of the OSR
+    uint isr_count;     // bits shifted into the ISR
+    struct pio_sim_fifo tx;
+    struct pio_sim_fifo rx;
+    PioSimStats_t stats;
+};
+
+struct pio_sim {
+    uint16_t instructions[PIO_INSTRUCTION_COUNT];
+    uint32_t used;
+    struct pio_sim_sm sm[NUM_PIO_STATE_MACHINES];
+};
+
+pio_hw_t host_pio_hw[2] = { { .index = 0 }, { .index = 1 } };
+
+static struct pio_sim pio_sims[2];
+
+static uint32_t pio_sim_levels;
+static uint32_t pio_sim_dirs;
+static uint8_t pio_sim_functions[PIO_SIM_PIN_COUNT];
+
+static PioSimFaultHandler_t* pio_sim_fault_handler = NULL;
+
+/*
+ * The model can not carry on past an instruction it does not model, or a
+ * state machine that stalls for good, the CPU would spin on its FIFOs.
+ */
+static void pio_sim_fail( const char* message, uint16_t instruction )
+{
+    if (pio_sim_fault_handler != NULL) {
+        pio_sim_fault_handler(message, instruction);
+    }
+
+    abort();
+}
+
+static bool pio_sim_fifo_full( const struct pio_sim_fifo* fifo )
+{
+    return fifo->count == PIO_SIM_FIFO_DEPTH;
+}
+
+static void pio_sim_fifo_put( struct pio_sim_fifo* fifo, uint32_t data )
+{
+    fifo->data[(fifo->head + fifo->count) % PIO_SIM_FIFO_DEPTH] = data;
+    fifo->count++;
+}
+
+static uint32_t pio_sim_fifo_get( struct pio_sim_fifo* fifo )
+{
+    uint32_t data = fifo->data[fifo->head];
+
+    fifo->head = (fifo->head + 1) % PIO_SIM_FIFO_DEPTH;
+    fifo->count--;
+
+    return data;
+}
+
+static void pio_sim_write_pins( uint base, uint count, uint32_t values, bool dirs )
+{
+    for (uint i = 0; i < count; i++) {
+        uint pin = (base + i) % PIO_SIM_PIN_COUNT;
+        uint32_t mask = (1u << pin);
+        uint32_t value = (values >> i) & 1;
+
+        if (dirs) {
+            pio_sim_dirs = (pio_sim_dirs & ~mask) | (value << pin);
+            continue;
+        }
+
+        if (((pio_sim_levels >> pin) & 1) == value) {
+            continue;
+        }
+
+        pio_sim_levels = (pio_sim_levels & ~mask) | (value << pin);
+
+        if (pio_sim_dirs & mask) {
+            SX1276SimPinWrite(pin, value);
+        }
+    }
+}
+
+static uint32_t pio_sim_read_pins( uint base, uint count )
+{
+    uint32_t values = 0;
+
+    for (uint i = 0; i < count; i++) {
+        uint pin = (base + i) % PIO_SIM_PIN_COUNT;
+        uint32_t value = (pio_sim_levels >> pin) & 1;
+
+        SX1276SimPinRead(pin, &value);
+
+        values |= (value << i);
+    }
+
+    return values;
+}
+
+static uint32_t pio_sim_shift_out( struct pio_sim_sm* sm, uint count )
+{
+    uint32_t data;
+
+    if (count == 32) {
+        data = sm->osr;
+        sm->osr = 0;
+    } else if (sm->config.out_shift_right) {
+        data = sm->osr & ((1u << count) - 1);
+        sm->osr >>= count;
+    } else {
+        data = sm->osr >> (32 - count);
+        sm->osr <<= count;
+    }
+
+    sm->osr_count = (sm->osr_count + count > 32) ? 32 : sm->osr_count + count;
+
+    return data;
+}
+
+static void pio_sim_shift_in( struct pio_sim_sm* sm, uint32_t data, uint count )
+{
+    if (count < 32) {
+        data &= (1u << count) - 1;
+    }
+
+    if (count == 32) {
+        sm->isr = data;
+    } else if (sm->config.in_shift_right) {
+        sm->isr = (sm->isr >> count) | (data << (32 - count));
+    } else {
+        sm->isr = (sm->isr << count) | data;
+    }
+
+    sm->isr_count = (sm->isr_count + count > 32) ? 32 : sm->isr_count + count;
+}
+
+static void pio_sim_push( struct pio_sim_sm* sm )
+{
+    pio_sim_fifo_put(&sm->rx, sm->isr);
+
+    sm->isr = 0;
+    sm->isr_count = 0;
+}
+
+static void pio_sim_pull( struct pio_sim_sm* sm )
+{
+    sm->osr = pio_sim_fifo_get(&sm->tx);
+    sm->osr_count = 0;
+}
+
+static bool pio_sim_condition( struct pio_sim_sm* sm, uint condition, uint16_t instruction )
+{
+    switch (condition) {
+        case 0:
+            return true;
+
+        case 1:
+            return sm->x == 0;
+
+        case 2:
+            return sm->x-- != 0;
+
+        case 3:
+            return sm->y == 0;
+
+        case 4:
+            return sm->y-- != 0;
+
+        case 5:
+            return sm->x != sm->y;
+
+        case 7:
+            return sm->osr_count < sm->config.pull_threshold;
+
+        default:
+            pio_sim_fail("JMP PIN is not modelled", instruction);
+            return false;
+    }
+}
+
+/*
+ * Executes the instruction at the program counter, returns false when it
+ * stalls. Side-set is applied even by a stalled instruction, like on the
+ * RP2040.
+ */
+static bool pio_sim_step( struct pio_sim* pio, struct pio_sim_sm* sm )
+{
+    const pio_sm_config* config = &sm->config;
+    uint16_t instruction = pio->instructions[sm->pc];
+    uint opcode = instruction >> 13;
+    uint field = (instruction >> 8) & 0x1f;
+    uint delay_bits = 5 - config->sideset_bit_count;
+    uint destination = (instruction >> 5) & 0x07;
+    uint count = instruction & 0x1f;
+    uint next = (sm->pc == config->wrap) ? config->wrap_target : (sm->pc + 1) % PIO_INSTRUCTION_COUNT;
+    uint32_t data;
+
+    if (config->sideset_bit_count > 0) {
+        uint side = field >> delay_bits;
+        uint side_bits = config->sideset_bit_count;
+
+        if (config->sideset_optional) {
+            side_bits--;
+        }
+
+        if (!config->sideset_optional || (side & (1u << side_bits))) {
+            pio_sim_write_pins(config->sideset_base, side_bits, side, config->sideset_pindirs);
+        }
+    }
+
+    if (count == 0) {
+        count = 32;
+    }
+
+    switch (opcode) {
+        case PIO_SIM_JMP:
+            if (pio_sim_condition(sm, destination, instruction)) {
+                next = instruction & 0x1f;
+            }
+            break;
+
+        case PIO_SIM_IN:
+            if (config->autopush && sm->isr_count + count >= config->push_threshold && pio_sim_fifo_full(&sm->rx)) {
+                return false;
+            }
+
+            switch (destination) {
+                case 0: data = pio_sim_read_pins(config->in_base, count); break;
+                case 1: data = sm->x; break;
+                case 2: data = sm->y; break;
+                case 3: data = 0; break;
+                case 6: data = sm->isr; break;
+                case 7: data = sm->osr; break;
+                default: pio_sim_fail("invalid IN source", instruction); return false;
+            }
+
+            pio_sim_shift_in(sm, data, count);
+
+            if (config->autopush && sm->isr_count >= config->push_threshold) {
+                pio_sim_push(sm);
+            }
+            break;
+
+        case PIO_SIM_OUT:
+            if (config->autopull && sm->osr_count >= config->pull_threshold) {
+                if (sm->tx.count == 0) {
+                    return false;
+                }
+
+                pio_sim_pull(sm);
+            }
+
+            data = pio_sim_shift_out(sm, count);
+
+            switch (destination) {
+                case 0: pio_sim_write_pins(config->out_base, config->out_count, data, false); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 3: break;
+                case 4: pio_sim_write_pins(config->out_base, config->out_count, data, true); break;
+                case 5: next = data & 0x1f; break;
+                case 6: sm->isr = data; sm->isr_count = count; break;
+                default: pio_sim_fail("OUT EXEC is not modelled", instruction); return false;
+            }
+            break;
+
+        case PIO_SIM_PUSH_PULL:
+            if (instruction & 0x80) {
+                // PULL, IfEmpty leaves a partly shifted OSR alone
+                if ((instruction & 0x40) && sm->osr_count < config->pull_threshold) {
+                    break;
+                }
+
+                if (sm->tx.count == 0) {
+                    if (instruction & 0x20) {
+                        return false;
+                    }
+
+                    sm->osr = sm->x;
+                    sm->osr_count = 0;
+                } else {
+                    pio_sim_pull(sm);
+                }
+            } else {
+                // PUSH, IfFull only pushes once the threshold is reached
+                if ((instruction & 0x40) && sm->isr_count < config->push_threshold) {
+                    break;
+                }
+
+                if (pio_sim_fifo_full(&sm->rx)) {
+                    if (instruction & 0x20) {
+                        return false;
+                    }
+                } else {
+                    pio_sim_push(sm);
+                }
+            }
+            break;
+
+        case PIO_SIM_MOV:
+            switch (instruction & 0x07) {
+                case 0: data = pio_sim_read_pins(config->in_base, 32); break;
+                case 1: data = sm->x; break;
+                case 2: data = sm->y; break;
+                case 3: data = 0; break;
+                case 6: data = sm->isr; break;
+                case 7: data = sm->osr; break;
+                default: pio_sim_fail("MOV STATUS is not modelled", instruction); return false;
+            }
+
+            if (((instruction >> 3) & 0x03) == 1) {
+                data = ~data;
+            } else if (((instruction >> 3) & 0x03) == 2) {
+                uint32_t reversed = 0;
+
+                for (int i = 0; i < 32; i++) {
+                    reversed |= ((data >> i) & 1) << (31 - i);
+                }
+                data = reversed;
+            }
+
+            switch (destination) {
+                case 0: pio_sim_write_pins(config->out_base, config->out_count, data, false); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 5: next = data & 0x1f; break;
+                case 6: sm->isr = data; sm->isr_count = 0; break;
+                case 7: sm->osr = data; sm->osr_count = 0; break;
+                default: pio_sim_fail("MOV EXEC is not modelled", instruction); return false;
+            }
+            break;
+
+        case PIO_SIM_SET:
+            data = instruction & 0x1f;
+
+            switch (destination) {
+                case 0: pio_sim_write_pins(config->set_base, config->set_count, data, false); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 4: pio_sim_write_pins(config->set_base, config->set_count, data, true); break;
+                default: pio_sim_fail("invalid SET destination", instruction); return false;
+            }
+            break;
+
+        default:
+            pio_sim_fail("WAIT and IRQ are not modelled", instruction);
+            return false;
+    }
+
+    sm->pc = next;
+
+    sm->stats.Instructions++;
+    sm->stats.Cycles += (uint64_t)((1 + (field & ((1u << delay_bits) - 1))) * config->clkdiv + 0.5f);
+
+    return true;
+}
+
+/*
+ * Runs the state machine until it stalls, which is what it would have done
+ * by the time the CPU looks at its FIFOs again.
+ */
+static void pio_sim_run( PIO pio, uint sm )
+{
+    struct pio_sim* sim = &pio_sims[pio->index];
+
+    if (!sim->sm[sm].enabled) {
+        return;
+    }
+
+    while (pio_sim_step(sim, &sim->sm[sm])) {
+    }
+}
+
+void PioSimGetStats( PIO pio, uint sm, PioSimStats_t* stats )
+{
+    *stats = pio_sims[pio->index].sm[sm].stats;
+}
+
+void PioSimSetFaultHandler( PioSimFaultHandler_t* handler )
+{
+    pio_sim_fault_handler = handler;
+}
+
+enum gpio_function gpio_get_function( uint gpio )
+{
+    return (enum gpio_function)pio_sim_functions[gpio % PIO_SIM_PIN_COUNT];
+}
+
+bool pio_can_add_program( PIO pio, const pio_program_t *program )
+{
+    uint32_t mask = (program->length < 32) ? ((1u << program->length) - 1) : 0xffffffff;
+
+    for (uint offset = 0; offset + program->length <= PIO_INSTRUCTION_COUNT; offset++) {
+        if ((program->origin < 0 || program->origin == (int)offset) && !(pio_sims[pio->index].used & (mask << offset))) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint pio_add_program( PIO pio, const pio_program_t *program )
+{
+    struct pio_sim* sim = &pio_sims[pio->index];
+    uint32_t mask = (program->length < 32) ? ((1u << program->length) - 1) : 0xffffffff;
+
+    // like the SDK, programs are placed as high up as they fit
+    for (int offset = PIO_INSTRUCTION_COUNT - program->length; offset >= 0; offset--) {
+        if ((program->origin >= 0 && program->origin != offset) || (sim->used & (mask << offset))) {
+            continue;
+        }
+
+        for (uint i = 0; i < program->length; i++) {
+            uint16_t instruction = program->instructions[i];
+
+            // JMP targets are relative to the start of the program
+            if ((instruction >> 13) == PIO_SIM_JMP) {
+                instruction += offset;
+            }
+
+            sim->instructions[offset + i] = instruction;
+        }
+
+        sim->used |= (mask << offset);
+
+        return offset;
+    }
+
+    pio_sim_fail("no program space", 0);
+    return 0;
+}
+
+int pio_claim_unused_sm( PIO pio, bool required )
+{
+    for (int sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+        if (!pio_sims[pio->index].sm[sm].claimed) {
+            pio_sims[pio->index].sm[sm].claimed = true;
+
+            return sm;
+        }
+    }
+
+    if (required) {
+        pio_sim_fail("no free state machine", 0);
+    }
+
+    return -1;
+}
+
+void pio_sm_init( PIO pio, uint sm, uint initial_pc, const pio_sm_config *config )
+{
+    struct pio_sim_sm* state = &pio_sims[pio->index].sm[sm];
+    bool claimed = state->claimed;
+
+    memset(state, 0x00, sizeof(*state));
+
+    state->claimed = claimed;
+    state->config = *config;
+    state->pc = initial_pc;
+
+    // the OSR starts out empty and the ISR with nothing shifted in
+    state->osr_count = 32;
+}
+
+void pio_sm_set_enabled( PIO pio, uint sm, bool enabled )
+{
+    pio_sims[pio->index].sm[sm].enabled = enabled;
+
+    pio_sim_run(pio, sm);
+}
+
+void pio_sm_set_pins_with_mask( PIO pio, uint sm, uint32_t pin_values, uint32_t pin_mask )
+{
+    for (uint pin = 0; pin < PIO_SIM_PIN_COUNT; pin++) {
+        if (pin_mask & (1u << pin)) {
+            pio_sim_write_pins(pin, 1, pin_values >> pin, false);
+        }
+    }
+}
+
+void pio_sm_set_pindirs_with_mask( PIO pio, uint sm, uint32_t pin_dirs, uint32_t pin_mask )
+{
+    pio_sim_dirs = (pio_sim_dirs & ~pin_mask) | (pin_dirs & pin_mask);
+}
+
+void pio_gpio_init( PIO pio, uint pin )
+{
+    pin %= PIO_SIM_PIN_COUNT;
+
+    pio_sim_functions[pin] = (pio->index == 0) ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1;
+
+    // the pin now follows the level driven by the state machine
+    if (pio_sim_dirs & (1u << pin)) {
+        SX1276SimPinWrite(pin, (pio_sim_levels >> pin) & 1);
+    }
+}
+
+bool pio_sm_is_tx_fifo_full( PIO pio, uint sm )
+{
+    pio_sim_run(pio, sm);
+
+    return pio_sim_fifo_full(&pio_sims[pio->index].sm[sm].tx);
+}
+
+bool pio_sm_is_rx_fifo_empty( PIO pio, uint sm )
+{
+    pio_sim_run(pio, sm);
+
+    return pio_sims[pio->index].sm[sm].rx.count == 0;
+}
+
+void pio_sm_put( PIO pio, uint sm, uint32_t data )
+{
+    struct pio_sim_sm* state = &pio_sims[pio->index].sm[sm];
+
+    // like the hardware, writes to a full FIFO are lost
+    if (!pio_sim_fifo_full(&state->tx)) {
+        pio_sim_fifo_put(&state->tx, data);
+    }
+
+    pio_sim_run(pio, sm);
+}
+
+uint32_t pio_sm_get( PIO pio, uint sm )
+{
+    struct pio_sim_sm* state = &pio_sims[pio->index].sm[sm];
+    uint32_t data = 0xffffffff;
+
+    pio_sim_run(pio, sm);
+
+    if (state->rx.count > 0) {
+        data = pio_sim_fifo_get(&state->rx);
+    }
+
+    pio_sim_run(pio, sm);
+
+    return data;
+}
+
+void pio_sm_put_blocking( PIO pio, uint sm, uint32_t data )
+{
+    if (pio_sm_is_tx_fifo_full(pio, sm)) {
+        pio_sim_fail("TX FIFO stays full, the state machine is stalled", 0);
+    }
+
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get_blocking( PIO pio, uint sm )
+{
+    if (pio_sm_is_rx_fifo_empty(pio, sm)) {
+        pio_sim_fail("RX FIFO stays empty, the state machine is stalled", 0);
+    }
+
+    return pio_sm_get(pio, sm);
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _PIO_SIM_H_
+#define _PIO_SIM_H_
+
+#include <stdint.h>
+
+#include "hardware/pio.h"
+
+/*!
+ * Instruction level model of the RP2040 PIO blocks, behind the
+ * hardware/pio.h stand-in of the host port.
+ *
+ * The pins of the state machines are wired to the SX1276 model. Side-set
+ * takes effect before an instruction samples its input pins, the model has
+ * no input synchronizers. WAIT and IRQ instructions are not modelled, a
+ * program using them stops the simulation, see PioSimSetFaultHandler( ).
+ */
+
+typedef struct PioSimStats_s
+{
+    uint64_t Instructions;  // instructions executed
+    uint64_t Cycles;        // system clock cycles spent executing them
+} PioSimStats_t;
+
+typedef void ( PioSimFaultHandler_t )( const char* message, uint16_t instruction );
+
+void PioSimGetStats( PIO pio, uint sm, PioSimStats_t* stats );
+
+/*!
+ * \brief Sets the handler told why the model stops the simulation, before it
+ *        aborts, the model itself prints nothing
+ */
+void PioSimSetFaultHandler( PioSimFaultHandler_t* handler );
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stddef.h>
+
+#include "sim-clock.h"
+
+#include "board-irq.h"
+#include "board-sleep.h"
+#include "rtc-board.h"
+
+// 1 ms ticks from the 64-bit virtual clock, as on the RP2040
+#define RTC_US_PER_TICK 1000
+
+static SimClockEvent_t rtc_alarm;
+static uint64_t rtc_timer_context;
+
+static void alarm_callback( void* context )
+{
+    // events are held back while "interrupts" are masked
+    BoardIrqRecordLatency(SimClockNow() - rtc_alarm.Deadline);
+
+    TimerIrqHandler( );
+}
+
+void RtcInit( void )
+{
+    SimClockEventInit(&rtc_alarm, alarm_callback, NULL);
+
+    RtcSetTimerContext();
+}
+
+uint32_t RtcGetCalendarTime( uint16_t *milliseconds )
+{
+    uint64_t now = SimClockNow() / 1000;
+
+    *milliseconds = (now % 1000);
+
+    return (now / 1000);
+}
+
+void RtcBkupRead( uint32_t *data0, uint32_t *data1 )
+{
+    *data0 = 0;
+    *data1 = 0;
+}
+
+uint32_t RtcGetTimerElapsedTime( void )
+{
+    return (SimClockNow() - rtc_timer_context) / RTC_US_PER_TICK;
+}
+
+uint32_t RtcSetTimerContext( void )
+{
+    uint64_t now = SimClockNow();
+
+    rtc_timer_context = now - (now % RTC_US_PER_TICK);
+
+    return now / RTC_US_PER_TICK;
+}
+
+uint32_t RtcGetTimerContext( void )
+{
+    return rtc_timer_context / RTC_US_PER_TICK;
+}
+
+uint32_t RtcGetMinimumTimeout( void )
+{
+    return 1;
+}
+
+void RtcSetAlarm( uint32_t timeout )
+{
+    SimClockSchedule(&rtc_alarm, rtc_timer_context + (uint64_t)timeout * RTC_US_PER_TICK);
+}
+
+void RtcStopAlarm( void )
+{
+    SimClockCancel(&rtc_alarm);
+}
+
+bool RtcGetAlarmTime( uint64_t* time )
+{
+    if (!rtc_alarm.IsPending) {
+        return false;
+    }
+
+    *time = rtc_alarm.Deadline;
+
+    return true;
+}
+
+uint32_t RtcMs2Tick( TimerTime_t milliseconds )
+{
+    return milliseconds * (1000 / RTC_US_PER_TICK);
+}
+
+uint32_t RtcGetTimerValue( void )
+{
+    return SimClockNow() / RTC_US_PER_TICK;
+}
+
+TimerTime_t RtcTick2Ms( uint32_t tick )
+{
+    return tick / (1000 / RTC_US_PER_TICK);
+}
+
+void RtcBkupWrite( uint32_t data0, uint32_t data1 )
+{
+}
+
+void RtcProcess( void )
+{
+    // Not used on this platform.
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stddef.h>
+
+#include "sim-clock.h"
+
+static uint64_t sim_clock_now = 0;
+static SimClockEvent_t* sim_clock_events = NULL;
+static uint32_t sim_clock_lock_depth = 0;
+
+static bool SimClockFireDue( void );
+
+uint64_t SimClockNow( void )
+{
+    // read by application threads when the MAC runs in its own task
+    return __atomic_load_n(&sim_clock_now, __ATOMIC_RELAXED);
+}
+
+void SimClockEventInit( SimClockEvent_t* event, void ( *callback )( void* context ), void* context )
+{
+    event->Deadline = 0;
+    event->Callback = callback;
+    event->Context = context;
+    event->IsPending = false;
+    event->Next = NULL;
+}
+
+void SimClockSchedule( SimClockEvent_t* event, uint64_t deadline )
+{
+    SimClockEvent_t** cur = &sim_clock_events;
+
+    SimClockCancel(event);
+
+    event->Deadline = deadline;
+    event->IsPending = true;
+
+    // keep the list sorted, events with equal deadlines fire in FIFO order
+    while (*cur != NULL && (*cur)->Deadline <= deadline) {
+        cur = &(*cur)->Next;
+    }
+
+    event->Next = *cur;
+    *cur = event;
+}
+
+void SimClockCancel( SimClockEvent_t* event )
+{
+    SimClockEvent_t** cur = &sim_clock_events;
+
+    if (!event->IsPending) {
+        return;
+    }
+
+    while (*cur != NULL) {
+        if (*cur == event) {
+            *cur = event->Next;
+            break;
+        }
+
+        cur = &(*cur)->Next;
+    }
+
+    event->IsPending = false;
+    event->Next = NULL;
+}
+
+bool SimClockNextDeadline( uint64_t* deadline )
+{
+    if (sim_clock_events == NULL) {
+        return false;
+    }
+
+    *deadline = sim_clock_events->Deadline;
+
+    return true;
+}
+
+bool SimClockAdvanceTo( uint64_t time )
+{
+    bool fired = false;
+
+    while (sim_clock_lock_depth == 0 && sim_clock_events != NULL && sim_clock_events->Deadline <= time) {
+        if (sim_clock_events->Deadline > sim_clock_now) {
+            __atomic_store_n(&sim_clock_now, sim_clock_events->Deadline, __ATOMIC_RELAXED);
+        }
+
+        fired |= SimClockFireDue();
+    }
+
+    if (time > sim_clock_now) {
+        __atomic_store_n(&sim_clock_now, time, __ATOMIC_RELAXED);
+    }
+
+    return fired;
+}
+
+bool SimClockRunNext( void )
+{
+    uint64_t deadline;
+
+    if (!SimClockNextDeadline(&deadline)) {
+        return false;
+    }
+
+    if (deadline < sim_clock_now) {
+        deadline = sim_clock_now;
+    }
+
+    return SimClockAdvanceTo(deadline);
+}
+
+void SimClockLock( void )
+{
+    sim_clock_lock_depth++;
+}
+
+void SimClockUnlock( void )
+{
+    if (--sim_clock_lock_depth == 0) {
+        // deliver whatever became due while "interrupts" were masked
+        SimClockAdvanceTo(sim_clock_now);
+    }
+}
+
+static bool SimClockFireDue( void )
+{
+    SimClockEvent_t* event = sim_clock_events;
+
+    if (event == NULL || event->Deadline > sim_clock_now) {
+        return false;
+    }
+
+    sim_clock_events = event->Next;
+    event->Next = NULL;
+    event->IsPending = false;
+
+    event->Callback(event->Context);
+
+    return true;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _SIM_CLOCK_H_
+#define _SIM_CLOCK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*!
+ * Virtual time event, fired by the simulation clock once its deadline is
+ * reached. Events stand in for the interrupts of the real board.
+ */
+typedef struct SimClockEvent_s
+{
+    uint64_t Deadline;
+    void ( *Callback )( void* context );
+    void* Context;
+    bool IsPending;
+    struct SimClockEvent_s* Next;
+} SimClockEvent_t;
+
+/*!
+ * \brief Current virtual time in microseconds since "boot"
+ */
+uint64_t SimClockNow( void );
+
+void SimClockEventInit( SimClockEvent_t* event, void ( *callback )( void* context ), void* context );
+
+void SimClockSchedule( SimClockEvent_t* event, uint64_t deadline );
+
+void SimClockCancel( SimClockEvent_t* event );
+
+/*!
+ * \brief Gets the deadline of the earliest pending event
+ *
+ * \retval true if an event is pending
+ */
+bool SimClockNextDeadline( uint64_t* deadline );
+
+/*!
+ * \brief Moves virtual time forward, firing every event that becomes due on
+ *        the way in deadline order.
+ *
+ * \retval true if at least one event was fired
+ */
+bool SimClockAdvanceTo( uint64_t time );
+
+/*!
+ * \brief Jumps to the earliest pending event and fires it
+ *
+ * \retval false if no event is pending
+ */
+bool SimClockRunNext( void );
+
+/*!
+ * Events are held back while the clock is locked, just like interrupts are
+ * while the board is in a critical section.
+ */
+void SimClockLock( void );
+
+void SimClockUnlock( void );
+
+#endif
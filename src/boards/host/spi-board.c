@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <stddef.h>
+
+#include "hardware/spi.h"
+
+#include "sx1276-sim.h"
+
+#include "spi-board.h"
+#include "spi-burst.h"
+#include "spi-pio.h"
+
+spi_inst_t host_spi_inst[2] = { { 0 }, { 1 } };
+
+void SpiInit( Spi_t *obj, SpiId_t spiId, PinNames mosi, PinNames miso, PinNames sclk, PinNames nss )
+{
+    obj->SpiId = spiId;
+    obj->Mosi.pin = mosi;
+    obj->Miso.pin = miso;
+    obj->Sclk.pin = sclk;
+
+    SpiBurstInit(obj);
+}
+
+void SpiMcuTransfer( Spi_t *obj, const uint8_t *tx, uint8_t *rx, uint16_t size )
+{
+    if (SpiPioIsActive(obj)) {
+        SpiPioTransfer(obj, tx, rx, size);
+        return;
+    }
+
+    for (uint16_t i = 0; i < size; i++) {
+        uint8_t in = SX1276SimSpiTransfer((tx != NULL) ? tx[i] : 0x00);
+
+        if (rx != NULL) {
+            rx[i] = in;
+        }
+    }
+}
+
+uint8_t SpiMcuInOut( Spi_t *obj, uint8_t outData )
+{
+    if (SpiPioIsActive(obj)) {
+        return SpiPioInOut(obj, outData);
+    }
+
+    // the SX1276 model is the only device on the simulated bus
+    return SX1276SimSpiTransfer(outData);
+}
+
+void SpiMcuSetNss( Spi_t *obj, uint32_t value )
+{
+    if (SpiPioIsActive(obj)) {
+        SpiPioSetNss(obj, value);
+    } else {
+        SX1276SimPinWrite(obj->Nss.pin, value);
+    }
+}
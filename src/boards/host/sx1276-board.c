@@ -0,0 +1,329 @@
+/*!
+ * \file      sx1276-board.c
+ *
+ * \brief     Host simulation SX1276 driver implementation
+ * 
+ * \remark    This is based on 
+ *            https://github.com/Lora-net/LoRaMac-node/blob/master/src/boards/B-L072Z-LRWAN1/sx1276-board.c
+ *
+ * \copyright Revised BSD License, see section \ref LICENSE.
+ *
+ * \code
+ *                ______                              _
+ *               / _____)             _              | |
+ *              ( (____  _____ ____ _| |_ _____  ____| |__
+ *               \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ *               _____) ) ____| | | || |_| ____( (___| | | |
+ *              (______/|_____)_|_|_| \__)_____)\____)_| |_|
+ *              (C)2013-2017 Semtech
+ *
+ * \endcode
+ *
+ * \author    Miguel Luis ( Semtech )
+ *
+ * \author    Gregory Cristian ( Semtech )
+ * 
+ */
+
+#include <stddef.h>
+
+#include "pico/time.h"
+
+#include "delay.h"
+#include "sx1276-board.h"
+#include "sx1276-sim.h"
+#include "sx1276-spi.h"
+#include "sx1276-tx.h"
+
+#include "radio/radio.h"
+
+const struct Radio_s Radio =
+{
+    SX1276Init,
+    SX1276GetStatus,
+    SX1276SetModem,
+    SX1276SetChannel,
+    SX1276IsChannelFree,
+    SX1276Random,
+    SX1276SetRxConfig,
+    SX1276SetTxConfig,
+    SX1276CheckRfFrequency,
+    SX1276GetTimeOnAir,
+    SX1276Send,
+    SX1276SetSleep,
+    SX1276SetStby,
+    SX1276SetRx,
+    SX1276StartCad,
+    SX1276SetTxContinuousWave,
+    SX1276ReadRssi,
+    SX1276Write,
+    SX1276Read,
+    SX1276WriteBuffer,
+    SX1276ReadBuffer,
+    SX1276SetMaxPayloadLength,
+    SX1276SetPublicNetwork,
+    SX1276GetWakeupTime,
+    NULL, // void ( *IrqProcess )( void )
+    NULL, // void ( *RxBoosted )( uint32_t timeout ) - SX126x Only
+    NULL, // void ( *SetRxDutyCycle )( uint32_t rxTime, uint32_t sleepTime ) - SX126x Only
+};
+
+static DioIrqHandler** irq_handlers;
+
+static uint64_t TxStartTime = 0;
+
+static uint32_t TxCount = 0;
+
+static bool TxActive = false;
+
+static uint64_t TxOnAirTime = 0;
+
+static uint64_t TxDoneTime = 0;
+
+static SX1276BoardRxWindow_t RxWindows[SX1276_BOARD_RX_WINDOWS];
+
+static uint8_t RxWindowCount = 0;
+
+static bool RxActive = false;
+
+// DIO0 is TX done while transmitting
+static void dio0_tx_done(void)
+{
+    if (TxActive) {
+        TxDoneTime = to_us_since_boot(get_absolute_time());
+        TxOnAirTime += TxDoneTime - TxStartTime;
+        TxActive = false;
+    }
+}
+
+// and RX done in a single receive window
+static void dio0_rx_done(void)
+{
+    if (RxActive) {
+        RxWindows[RxWindowCount - 1].DoneTime = to_us_since_boot(get_absolute_time());
+        RxActive = false;
+    }
+}
+
+static void dio_sim_callback(uint8_t dio, uint32_t level)
+{
+    // same edges as the RP2040 port: DIO0 rising, DIO1 both
+    if (dio == 0 && level) {
+        dio0_tx_done();
+        dio0_rx_done();
+        irq_handlers[0](NULL);
+    } else if (dio == 1) {
+        irq_handlers[1](NULL);
+    }
+}
+
+void SX1276SetAntSwLowPower( bool status )
+{
+}
+
+bool SX1276CheckRfFrequency( uint32_t frequency )
+{
+    return true;
+}
+
+void SX1276SetBoardTcxo( uint8_t state )
+{
+}
+
+uint32_t SX1276GetDio1PinState( void )
+{
+    return GpioRead(&SX1276.DIO1);
+}
+
+// from the settings of SX1276SetRxConfig( ), bandwidths 7 to 9 are 125 to 500 kHz
+static uint32_t rx_symbol_time(void)
+{
+    if (SX1276.Settings.Modem != MODEM_LORA || SX1276.Settings.LoRa.Bandwidth < 7) {
+        return 0;
+    }
+
+    return ((1u << SX1276.Settings.LoRa.Datarate) * 1000u) / (125u << (SX1276.Settings.LoRa.Bandwidth - 7));
+}
+
+void SX1276SetAntSw( uint8_t opMode )
+{
+    // called by SX1276SetOpMode( ) just before the mode is written
+    if (opMode == RFLR_OPMODE_TRANSMITTER) {
+        TxStartTime = to_us_since_boot(get_absolute_time());
+        TxCount++;
+        TxActive = true;
+        RxWindowCount = 0;
+        RxActive = false;
+    } else {
+        // left transmit without TX done, for example on a TX timeout
+        dio0_tx_done();
+        RxActive = false;
+
+        if (opMode == RFLR_OPMODE_RECEIVER_SINGLE && RxWindowCount < SX1276_BOARD_RX_WINDOWS) {
+            SX1276BoardRxWindow_t* window = &RxWindows[RxWindowCount];
+
+            window->OpenTime = to_us_since_boot(get_absolute_time());
+            window->DoneTime = 0;
+            window->SymbolTime = rx_symbol_time();
+
+            RxWindowCount++;
+            RxActive = true;
+        }
+    }
+}
+
+uint64_t SX1276BoardGetTxStartTime( void )
+{
+    return TxStartTime;
+}
+
+uint32_t SX1276BoardGetTxCount( void )
+{
+    return TxCount;
+}
+
+uint64_t SX1276BoardGetTxOnAirTime( void )
+{
+    return TxOnAirTime;
+}
+
+uint64_t SX1276BoardGetTxDoneTime( void )
+{
+    return TxDoneTime;
+}
+
+uint8_t SX1276BoardGetRxWindows( SX1276BoardRxWindow_t* windows )
+{
+    uint8_t count = RxWindowCount;
+
+    for (uint8_t i = 0; i < count; i++) {
+        windows[i] = RxWindows[i];
+    }
+
+    return count;
+}
+
+void SX1276Reset( void )
+{
+    GpioInit( &SX1276.Reset, SX1276.Reset.pin, PIN_OUTPUT, PIN_PUSH_PULL, PIN_PULL_UP, 0 ); // RST
+
+    DelayMs (1);
+
+    GpioInit( &SX1276.Reset, SX1276.Reset.pin, PIN_OUTPUT, PIN_PUSH_PULL, PIN_PULL_UP, 1 ); // RST
+
+    DelayMs (6);
+
+    // the registers are back to their reset values
+    SX1276SpiInvalidate( );
+}
+
+void SX1276IoInit( void )
+{
+    GpioInit( &SX1276.Spi.Nss, SX1276.Spi.Nss.pin, PIN_OUTPUT, PIN_PUSH_PULL, PIN_NO_PULL, 1 ); // CS
+    GpioInit( &SX1276.Reset, SX1276.Reset.pin, PIN_OUTPUT, PIN_PUSH_PULL, PIN_PULL_UP, 1 );     // RST
+
+    GpioInit( &SX1276.DIO0, SX1276.DIO0.pin, PIN_INPUT, PIN_PUSH_PULL, PIN_PULL_UP, 0 );        // IRQ / DIO0
+    GpioInit( &SX1276.DIO1, SX1276.DIO1.pin, PIN_INPUT, PIN_PUSH_PULL, PIN_PULL_UP, 0 );        // DI01
+
+    SX1276SpiInit( &SX1276.Spi );
+}
+
+void SX1276IoIrqInit( DioIrqHandler **irqHandlers )
+{
+    irq_handlers = irqHandlers;
+
+    SX1276SimSetDioHandler(dio_sim_callback);
+}
+
+/*!
+ * \brief Gets the board PA selection configuration
+ *
+ * \param [IN] power Selects the right PA according to the wanted power.
+ * \retval PaSelect RegPaConfig PaSelect value
+ */
+static uint8_t SX1276GetPaSelect( int8_t power );
+
+void SX1276SetRfTxPower( int8_t power )
+{
+    uint8_t paConfig = 0;
+    uint8_t paDac = 0;
+
+    paConfig = SX1276Read( REG_PACONFIG );
+    paDac = SX1276Read( REG_PADAC );
+
+    paConfig = ( paConfig & RF_PACONFIG_PASELECT_MASK ) | SX1276GetPaSelect( power );
+
+    if( ( paConfig & RF_PACONFIG_PASELECT_PABOOST ) == RF_PACONFIG_PASELECT_PABOOST )
+    {
+        if( power > 17 )
+        {
+            paDac = ( paDac & RF_PADAC_20DBM_MASK ) | RF_PADAC_20DBM_ON;
+        }
+        else
+        {
+            paDac = ( paDac & RF_PADAC_20DBM_MASK ) | RF_PADAC_20DBM_OFF;
+        }
+        if( ( paDac & RF_PADAC_20DBM_ON ) == RF_PADAC_20DBM_ON )
+        {
+            if( power < 5 )
+            {
+                power = 5;
+            }
+            if( power > 20 )
+            {
+                power = 20;
+            }
+            paConfig = ( paConfig & RF_PACONFIG_OUTPUTPOWER_MASK ) | ( uint8_t )( ( uint16_t )( power - 5 ) & 0x0F );
+        }
+        else
+        {
+            if( power < 2 )
+            {
+                power = 2;
+            }
+            if( power > 17 )
+            {
+                power = 17;
+            }
+            paConfig = ( paConfig & RF_PACONFIG_OUTPUTPOWER_MASK ) | ( uint8_t )( ( uint16_t )( power - 2 ) & 0x0F );
+        }
+    }
+    else
+    {
+        if( power > 0 )
+        {
+            if( power > 15 )
+            {
+                power = 15;
+            }
+            paConfig = ( paConfig & RF_PACONFIG_MAX_POWER_MASK & RF_PACONFIG_OUTPUTPOWER_MASK ) | ( 7 << 4 ) | ( power );
+        }
+        else
+        {
+            if( power < -4 )
+            {
+                power = -4;
+            }
+            paConfig = ( paConfig & RF_PACONFIG_MAX_POWER_MASK & RF_PACONFIG_OUTPUTPOWER_MASK ) | ( 0 << 4 ) | ( power + 4 );
+        }
+    }
+    SX1276Write( REG_PACONFIG, paConfig );
+    SX1276Write( REG_PADAC, paDac );
+}
+
+static uint8_t SX1276GetPaSelect( int8_t power )
+{
+    if( power > 14 )
+    {
+        return RF_PACONFIG_PASELECT_PABOOST;
+    }
+    else
+    {
+        return RF_PACONFIG_PASELECT_RFO;
+    }
+}
+
+uint32_t SX1276GetBoardTcxoWakeupTime( void )
+{
+    return 0;
+}
@@ -0,0 +1,622 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "sx1276/sx1276.h"
+#include "sim-clock.h"
+#include "sx1276-sim.h"
+
+#define SX1276_SIM_REG_COUNT        0x80
+#define SX1276_SIM_FIFO_SIZE        256
+#define SX1276_SIM_RX_QUEUE_SIZE    4
+
+// preamble symbols the modem needs to see to lock onto a frame
+#define SX1276_SIM_PREAMBLE_LOCK    4
+
+#define SX1276_SIM_XTAL_FREQ        32000000.0
+#define SX1276_SIM_FREQ_STEP        ( SX1276_SIM_XTAL_FREQ / ( 1 << 19 ) )
+
+struct sx1276_sim_rx_frame {
+    uint8_t buffer[SX1276_SIM_FIFO_SIZE];
+    uint8_t size;
+    int16_t rssi;
+    int8_t snr;
+    uint64_t start;     // preamble start, 0 for the next receive window
+};
+
+// registers 0x0D - 0x3F are banked between the FSK/OOK and the LoRa modem
+static uint8_t sx1276_sim_regs[2][SX1276_SIM_REG_COUNT];
+static uint8_t sx1276_sim_fifo[SX1276_SIM_FIFO_SIZE];
+
+static bool sx1276_sim_selected = false;
+static bool sx1276_sim_in_reset = false;
+static uint32_t sx1276_sim_byte_index = 0;
+static uint8_t sx1276_sim_address = 0;
+static bool sx1276_sim_write = false;
+
+// bit level bus, when SCK and MOSI are driven by the PIO model
+static uint32_t sx1276_sim_sck = 0;
+static uint32_t sx1276_sim_mosi = 0;
+static uint32_t sx1276_sim_miso = 0;
+static uint8_t sx1276_sim_bit = 0;
+static uint8_t sx1276_sim_shift_in = 0;
+static uint8_t sx1276_sim_shift_out = 0;
+
+static FILE* sx1276_sim_trace = NULL;
+static bool sx1276_sim_trace_line = false;
+
+static uint32_t sx1276_sim_dio_levels[2];
+static uint32_t sx1276_sim_dio_notified[2];
+static SX1276SimDioHandler* sx1276_sim_dio_handler = NULL;
+static SimClockEvent_t sx1276_sim_dio_event;
+
+static SX1276SimTxHandler* sx1276_sim_tx_handler = NULL;
+static void* sx1276_sim_tx_context = NULL;
+
+static struct sx1276_sim_rx_frame sx1276_sim_rx_queue[SX1276_SIM_RX_QUEUE_SIZE];
+static uint32_t sx1276_sim_rx_head = 0;
+static uint32_t sx1276_sim_rx_count = 0;
+
+static SimClockEvent_t sx1276_sim_radio_event;
+static bool sx1276_sim_radio_event_init = false;
+static uint64_t sx1276_sim_mode_entered = 0;
+static bool sx1276_sim_rx_due = false;
+
+static SX1276SimStats_t sx1276_sim_stats;
+
+static void SX1276SimReset( void );
+static uint8_t SX1276SimByteBegin( void );
+static void SX1276SimByteEnd( uint8_t out, uint8_t in );
+static void SX1276SimOnSck( uint32_t value );
+static bool SX1276SimIsLoRa( void );
+static uint8_t* SX1276SimReg( uint8_t addr );
+static uint8_t SX1276SimRead( uint8_t addr );
+static void SX1276SimWrite( uint8_t addr, uint8_t value );
+static void SX1276SimSetMode( uint8_t previous, uint8_t mode );
+static void SX1276SimRaiseIrq( uint8_t flags );
+static void SX1276SimUpdateDio( void );
+static void SX1276SimNotifyDio( void* context );
+static double SX1276SimSymbolTimeUs( void );
+static uint64_t SX1276SimTimeOnAirUs( uint8_t size );
+static void SX1276SimOnRadioEvent( void* context );
+
+void SX1276SimSetTxHandler( SX1276SimTxHandler* handler, void* context )
+{
+    sx1276_sim_tx_handler = handler;
+    sx1276_sim_tx_context = context;
+}
+
+void SX1276SimSetDioHandler( SX1276SimDioHandler* handler )
+{
+    sx1276_sim_dio_handler = handler;
+}
+
+bool SX1276SimQueueRxFrame( const uint8_t* buffer, uint8_t size, int16_t rssi, int8_t snr )
+{
+    return SX1276SimQueueRxFrameAt(buffer, size, rssi, snr, 0);
+}
+
+bool SX1276SimQueueRxFrameAt( const uint8_t* buffer, uint8_t size, int16_t rssi, int8_t snr, uint64_t start )
+{
+    struct sx1276_sim_rx_frame* frame;
+
+    if (sx1276_sim_rx_count == SX1276_SIM_RX_QUEUE_SIZE) {
+        return false;
+    }
+
+    frame = &sx1276_sim_rx_queue[(sx1276_sim_rx_head + sx1276_sim_rx_count) % SX1276_SIM_RX_QUEUE_SIZE];
+
+    memcpy(frame->buffer, buffer, size);
+    frame->size = size;
+    frame->rssi = rssi;
+    frame->snr = snr;
+    frame->start = start;
+
+    sx1276_sim_rx_count++;
+
+    return true;
+}
+
+void SX1276SimGetStats( SX1276SimStats_t* stats )
+{
+    *stats = sx1276_sim_stats;
+}
+
+void SX1276SimResetStats( void )
+{
+    memset(&sx1276_sim_stats, 0x00, sizeof(sx1276_sim_stats));
+}
+
+void SX1276SimSetTrace( FILE* trace )
+{
+    sx1276_sim_trace = trace;
+}
+
+void SX1276SimPinWrite( PinNames pin, uint32_t value )
+{
+    if (pin == SX1276.Spi.Nss.pin) {
+        if (value == 0 && !sx1276_sim_selected) {
+            sx1276_sim_byte_index = 0;
+            sx1276_sim_bit = 0;
+            sx1276_sim_stats.SpiTransactions++;
+        } else if (value != 0 && sx1276_sim_selected && sx1276_sim_trace_line) {
+            fputc('\n', sx1276_sim_trace);
+            sx1276_sim_trace_line = false;
+        }
+
+        sx1276_sim_selected = (value == 0);
+    } else if (pin == SX1276.Spi.Sclk.pin) {
+        SX1276SimOnSck(value);
+    } else if (pin == SX1276.Spi.Mosi.pin) {
+        sx1276_sim_mosi = value;
+    } else if (pin == SX1276.Reset.pin) {
+        if (value == 0) {
+            sx1276_sim_in_reset = true;
+        } else if (sx1276_sim_in_reset) {
+            sx1276_sim_in_reset = false;
+
+            SX1276SimReset();
+        }
+    }
+}
+
+bool SX1276SimPinRead( PinNames pin, uint32_t* value )
+{
+    if (pin == SX1276.DIO0.pin) {
+        *value = sx1276_sim_dio_levels[0];
+    } else if (pin == SX1276.DIO1.pin) {
+        *value = sx1276_sim_dio_levels[1];
+    } else if (pin == SX1276.Spi.Miso.pin) {
+        *value = sx1276_sim_miso;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+uint8_t SX1276SimSpiTransfer( uint8_t out )
+{
+    uint8_t in = SX1276SimByteBegin();
+
+    SX1276SimByteEnd(out, in);
+
+    return in;
+}
+
+/*
+ * SPI mode 0, MSB first: MOSI is sampled on the rising edge of SCK. The data
+ * of a read is only fetched once the first bit of the byte is clocked, so
+ * the FIFO pointer does not move past the last byte read.
+ */
+static void SX1276SimOnSck( uint32_t value )
+{
+    bool rising = (value != 0 && sx1276_sim_sck == 0);
+
+    sx1276_sim_sck = value;
+
+    if (!rising || !sx1276_sim_selected) {
+        return;
+    }
+
+    if (sx1276_sim_bit == 0) {
+        sx1276_sim_shift_out = SX1276SimByteBegin();
+    }
+
+    sx1276_sim_miso = (sx1276_sim_shift_out >> (7 - sx1276_sim_bit)) & 1;
+    sx1276_sim_shift_in = (sx1276_sim_shift_in << 1) | (sx1276_sim_mosi & 1);
+
+    if (++sx1276_sim_bit == 8) {
+        SX1276SimByteEnd(sx1276_sim_shift_in, sx1276_sim_shift_out);
+
+        sx1276_sim_bit = 0;
+    }
+}
+
+static uint8_t SX1276SimByteBegin( void )
+{
+    if (!sx1276_sim_radio_event_init) {
+        SX1276SimReset();
+    }
+
+    if (!sx1276_sim_selected || sx1276_sim_in_reset) {
+        return 0x00;
+    }
+
+    sx1276_sim_stats.SpiBytes++;
+
+    if (sx1276_sim_byte_index == 0 || sx1276_sim_write) {
+        return 0x00;
+    }
+
+    return SX1276SimRead(sx1276_sim_address);
+}
+
+static void SX1276SimByteEnd( uint8_t out, uint8_t in )
+{
+    if (!sx1276_sim_selected || sx1276_sim_in_reset) {
+        return;
+    }
+
+    if (sx1276_sim_byte_index == 0) {
+        sx1276_sim_write = (out & 0x80) != 0;
+        sx1276_sim_address = (out & 0x7f);
+
+        if (sx1276_sim_trace != NULL) {
+            fprintf(sx1276_sim_trace, "%c %02x", sx1276_sim_write ? 'W' : 'R', sx1276_sim_address);
+            sx1276_sim_trace_line = true;
+        }
+    } else {
+        if (sx1276_sim_write) {
+            SX1276SimWrite(sx1276_sim_address, out);
+        }
+
+        if (sx1276_sim_trace != NULL) {
+            fprintf(sx1276_sim_trace, " %02x", sx1276_sim_write ? out : in);
+        }
+
+        // burst access auto-increments the address, except for the FIFO
+        if (sx1276_sim_address != REG_FIFO) {
+            sx1276_sim_address = (sx1276_sim_address + 1) & 0x7f;
+        }
+    }
+
+    sx1276_sim_byte_index++;
+}
+
+static void SX1276SimReset( void )
+{
+    if (!sx1276_sim_radio_event_init) {
+        SimClockEventInit(&sx1276_sim_radio_event, SX1276SimOnRadioEvent, NULL);
+        SimClockEventInit(&sx1276_sim_dio_event, SX1276SimNotifyDio, NULL);
+        sx1276_sim_radio_event_init = true;
+    }
+
+    SimClockCancel(&sx1276_sim_radio_event);
+
+    memset(sx1276_sim_regs, 0x00, sizeof(sx1276_sim_regs));
+    memset(sx1276_sim_fifo, 0x00, sizeof(sx1276_sim_fifo));
+
+    // power on defaults, only the ones the driver depends on
+    sx1276_sim_regs[0][REG_OPMODE] = 0x09;
+    sx1276_sim_regs[0][REG_FRFMSB] = 0x6c;
+    sx1276_sim_regs[0][REG_FRFMID] = 0x80;
+    sx1276_sim_regs[0][REG_PACONFIG] = 0x4f;
+    sx1276_sim_regs[0][REG_PARAMP] = 0x09;
+    sx1276_sim_regs[0][REG_OCP] = 0x2b;
+    sx1276_sim_regs[0][REG_LNA] = 0x20;
+    sx1276_sim_regs[0][REG_VERSION] = 0x12;
+    sx1276_sim_regs[0][REG_PADAC] = 0x84;
+
+    sx1276_sim_regs[1][REG_LR_FIFOTXBASEADDR] = 0x80;
+    sx1276_sim_regs[1][REG_LR_MODEMCONFIG1] = 0x72;
+    sx1276_sim_regs[1][REG_LR_MODEMCONFIG2] = 0x70;
+    sx1276_sim_regs[1][REG_LR_SYMBTIMEOUTLSB] = 0x64;
+    sx1276_sim_regs[1][REG_LR_PREAMBLELSB] = 0x08;
+    sx1276_sim_regs[1][REG_LR_PAYLOADLENGTH] = 0x01;
+    sx1276_sim_regs[1][REG_LR_PAYLOADMAXLENGTH] = 0xff;
+    sx1276_sim_regs[1][REG_LR_MODEMCONFIG3] = 0x04;
+    sx1276_sim_regs[1][REG_LR_DETECTOPTIMIZE] = 0xc3;
+    sx1276_sim_regs[1][REG_LR_INVERTIQ] = 0x27;
+    sx1276_sim_regs[1][REG_LR_DETECTIONTHRESHOLD] = 0x0a;
+    sx1276_sim_regs[1][REG_LR_SYNCWORD] = 0x12;
+    sx1276_sim_regs[1][REG_LR_INVERTIQ2] = 0x1d;
+
+    sx1276_sim_mode_entered = SimClockNow();
+
+    SX1276SimUpdateDio();
+}
+
+static bool SX1276SimIsLoRa( void )
+{
+    return (sx1276_sim_regs[0][REG_OPMODE] & RFLR_OPMODE_LONGRANGEMODE_ON) != 0;
+}
+
+static uint8_t* SX1276SimReg( uint8_t addr )
+{
+    if (addr >= 0x0d && addr <= 0x3f && SX1276SimIsLoRa()) {
+        return &sx1276_sim_regs[1][addr];
+    }
+
+    return &sx1276_sim_regs[0][addr];
+}
+
+static uint8_t SX1276SimRead( uint8_t addr )
+{
+    if (addr == REG_FIFO) {
+        uint8_t* ptr = &sx1276_sim_regs[1][REG_LR_FIFOADDRPTR];
+
+        return sx1276_sim_fifo[(*ptr)++];
+    }
+
+    if (SX1276SimIsLoRa()) {
+        switch (addr) {
+            case REG_LR_RSSIVALUE:
+                // -120 dBm noise floor
+                return 37;
+
+            case REG_LR_RSSIWIDEBAND:
+                // LFSR noise, used by the driver as random source
+                return (uint8_t)(SimClockNow() ^ (SimClockNow() >> 7) ^ sx1276_sim_stats.SpiBytes);
+
+            default:
+                break;
+        }
+    } else if (addr == REG_IMAGECAL) {
+        // calibration completes instantly
+        return sx1276_sim_regs[0][REG_IMAGECAL] & ~0x60;
+    }
+
+    return *SX1276SimReg(addr);
+}
+
+static void SX1276SimWrite( uint8_t addr, uint8_t value )
+{
+    if (addr == REG_FIFO) {
+        uint8_t* ptr = &sx1276_sim_regs[1][REG_LR_FIFOADDRPTR];
+
+        sx1276_sim_fifo[(*ptr)++] = value;
+        return;
+    }
+
+    if (addr == REG_OPMODE) {
+        uint8_t previous = sx1276_sim_regs[0][REG_OPMODE];
+
+        sx1276_sim_regs[0][REG_OPMODE] = value;
+
+        if ((previous ^ value) & RFLR_OPMODE_LONGRANGEMODE_ON) {
+            // the modem is switched in sleep mode only
+            SimClockCancel(&sx1276_sim_radio_event);
+        }
+
+        if ((previous & ~RF_OPMODE_MASK) != (value & ~RF_OPMODE_MASK)) {
+            SX1276SimSetMode(previous & ~RF_OPMODE_MASK, value & ~RF_OPMODE_MASK);
+        }
+        return;
+    }
+
+    if (SX1276SimIsLoRa() && addr == REG_LR_IRQFLAGS) {
+        // write one to clear
+        sx1276_sim_regs[1][REG_LR_IRQFLAGS] &= ~value;
+
+        SX1276SimUpdateDio();
+        return;
+    }
+
+    *SX1276SimReg(addr) = value;
+
+    if (addr == REG_DIOMAPPING1) {
+        SX1276SimUpdateDio();
+    }
+}
+
+static void SX1276SimSetMode( uint8_t previous, uint8_t mode )
+{
+    uint64_t now = SimClockNow();
+
+    SimClockCancel(&sx1276_sim_radio_event);
+    sx1276_sim_rx_due = false;
+
+    if (previous == RFLR_OPMODE_RECEIVER || previous == RFLR_OPMODE_RECEIVER_SINGLE) {
+        sx1276_sim_stats.RxOnUs += now - sx1276_sim_mode_entered;
+    }
+
+    sx1276_sim_mode_entered = now;
+
+    if (!SX1276SimIsLoRa()) {
+        // the FSK modem is only used during calibration
+        return;
+    }
+
+    switch (mode) {
+        case RFLR_OPMODE_TRANSMITTER:
+            SimClockSchedule(&sx1276_sim_radio_event, now + SX1276SimTimeOnAirUs(sx1276_sim_regs[1][REG_LR_PAYLOADLENGTH]));
+            break;
+
+        case RFLR_OPMODE_RECEIVER:
+        case RFLR_OPMODE_RECEIVER_SINGLE:
+        {
+            uint32_t symbols = ((sx1276_sim_regs[1][REG_LR_MODEMCONFIG2] & 0x03) << 8) | sx1276_sim_regs[1][REG_LR_SYMBTIMEOUTLSB];
+            int preamble = (sx1276_sim_regs[1][REG_LR_PREAMBLEMSB] << 8) | sx1276_sim_regs[1][REG_LR_PREAMBLELSB];
+            double symbol = SX1276SimSymbolTimeUs();
+            uint64_t timeout = now + (uint64_t)(symbols * symbol);
+
+            // frames sent at a set time are lost once too little of their
+            // preamble is left to lock onto
+            while (sx1276_sim_rx_count > 0) {
+                struct sx1276_sim_rx_frame* frame = &sx1276_sim_rx_queue[sx1276_sim_rx_head];
+
+                if (frame->start == 0 || now <= frame->start + (uint64_t)((preamble - SX1276_SIM_PREAMBLE_LOCK) * symbol)) {
+                    break;
+                }
+
+                sx1276_sim_rx_head = (sx1276_sim_rx_head + 1) % SX1276_SIM_RX_QUEUE_SIZE;
+                sx1276_sim_rx_count--;
+
+                sx1276_sim_stats.RxMissed++;
+            }
+
+            if (sx1276_sim_rx_count > 0) {
+                struct sx1276_sim_rx_frame* frame = &sx1276_sim_rx_queue[sx1276_sim_rx_head];
+                uint64_t start = (frame->start > now) ? frame->start : now;
+
+                // a single receive window must still be open when the preamble starts
+                if (mode == RFLR_OPMODE_RECEIVER || start <= timeout) {
+                    sx1276_sim_rx_due = true;
+
+                    SimClockSchedule(&sx1276_sim_radio_event, start + SX1276SimTimeOnAirUs(frame->size));
+                    break;
+                }
+            }
+
+            if (mode == RFLR_OPMODE_RECEIVER_SINGLE) {
+                SimClockSchedule(&sx1276_sim_radio_event, timeout);
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+static void SX1276SimRaiseIrq( uint8_t flags )
+{
+    sx1276_sim_regs[1][REG_LR_IRQFLAGS] |= (flags & ~sx1276_sim_regs[1][REG_LR_IRQFLAGSMASK]);
+
+    SX1276SimUpdateDio();
+}
+
+static void SX1276SimUpdateDio( void )
+{
+    uint8_t flags = sx1276_sim_regs[1][REG_LR_IRQFLAGS];
+    uint8_t mapping = sx1276_sim_regs[0][REG_DIOMAPPING1];
+    uint32_t levels[2] = { 0, 0 };
+
+    if (SX1276SimIsLoRa()) {
+        static const uint8_t dio0[4] = { RFLR_IRQFLAGS_RXDONE, RFLR_IRQFLAGS_TXDONE, RFLR_IRQFLAGS_CADDONE, 0 };
+        static const uint8_t dio1[4] = { RFLR_IRQFLAGS_RXTIMEOUT, RFLR_IRQFLAGS_FHSSCHANGEDCHANNEL, RFLR_IRQFLAGS_CADDETECTED, 0 };
+
+        levels[0] = (flags & dio0[(mapping >> 6) & 0x03]) ? 1 : 0;
+        levels[1] = (flags & dio1[(mapping >> 4) & 0x03]) ? 1 : 0;
+    }
+
+    sx1276_sim_dio_levels[0] = levels[0];
+    sx1276_sim_dio_levels[1] = levels[1];
+
+    if (levels[0] == sx1276_sim_dio_notified[0] && levels[1] == sx1276_sim_dio_notified[1]) {
+        return;
+    }
+
+    if (sx1276_sim_selected) {
+        // edges caused by a bus access are seen once the "IRQ" can be taken
+        SimClockSchedule(&sx1276_sim_dio_event, SimClockNow());
+    } else {
+        SX1276SimNotifyDio(NULL);
+    }
+}
+
+static void SX1276SimNotifyDio( void* context )
+{
+    for (int i = 0; i < 2; i++) {
+        if (sx1276_sim_dio_levels[i] != sx1276_sim_dio_notified[i]) {
+            sx1276_sim_dio_notified[i] = sx1276_sim_dio_levels[i];
+
+            if (sx1276_sim_dio_handler != NULL) {
+                sx1276_sim_dio_handler(i, sx1276_sim_dio_notified[i]);
+            }
+        }
+    }
+}
+
+static double SX1276SimSymbolTimeUs( void )
+{
+    static const double bandwidths[10] = {
+        7.8e3, 10.4e3, 15.6e3, 20.8e3, 31.25e3, 41.7e3, 62.5e3, 125e3, 250e3, 500e3
+    };
+
+    uint8_t bw = sx1276_sim_regs[1][REG_LR_MODEMCONFIG1] >> 4;
+    uint8_t sf = sx1276_sim_regs[1][REG_LR_MODEMCONFIG2] >> 4;
+
+    if (bw > 9) {
+        bw = 9;
+    }
+
+    return (double)(1 << sf) * 1e6 / bandwidths[bw];
+}
+
+static uint64_t SX1276SimTimeOnAirUs( uint8_t size )
+{
+    uint8_t config1 = sx1276_sim_regs[1][REG_LR_MODEMCONFIG1];
+    uint8_t config2 = sx1276_sim_regs[1][REG_LR_MODEMCONFIG2];
+    uint8_t config3 = sx1276_sim_regs[1][REG_LR_MODEMCONFIG3];
+
+    int sf = config2 >> 4;
+    int cr = (config1 >> 1) & 0x07;
+    int implicit_header = config1 & 0x01;
+    int crc = (config2 >> 2) & 0x01;
+    int low_datarate_optimize = (config3 >> 3) & 0x01;
+    int preamble = (sx1276_sim_regs[1][REG_LR_PREAMBLEMSB] << 8) | sx1276_sim_regs[1][REG_LR_PREAMBLELSB];
+
+    double symbol = SX1276SimSymbolTimeUs();
+    double payload = ceil((8.0 * size - 4.0 * sf + 28 + 16 * crc - 20 * implicit_header) / (4.0 * (sf - 2 * low_datarate_optimize)));
+
+    if (payload < 0) {
+        payload = 0;
+    }
+
+    payload = 8 + payload * (cr + 4);
+
+    return (uint64_t)((preamble + 4.25 + payload) * symbol);
+}
+
+static void SX1276SimOnRadioEvent( void* context )
+{
+    uint64_t now = SimClockNow();
+    uint8_t mode = sx1276_sim_regs[0][REG_OPMODE] & ~RF_OPMODE_MASK;
+
+    if (mode == RFLR_OPMODE_TRANSMITTER) {
+        uint8_t size = sx1276_sim_regs[1][REG_LR_PAYLOADLENGTH];
+        uint8_t frame[SX1276_SIM_FIFO_SIZE];
+        uint32_t frf = (sx1276_sim_regs[0][REG_FRFMSB] << 16) | (sx1276_sim_regs[0][REG_FRFMID] << 8) | sx1276_sim_regs[0][REG_FRFLSB];
+
+        for (int i = 0; i < size; i++) {
+            frame[i] = sx1276_sim_fifo[(uint8_t)(sx1276_sim_regs[1][REG_LR_FIFOTXBASEADDR] + i)];
+        }
+
+        sx1276_sim_stats.TxFrames++;
+        sx1276_sim_stats.TxOnAirUs += now - sx1276_sim_mode_entered;
+
+        sx1276_sim_regs[0][REG_OPMODE] = (sx1276_sim_regs[0][REG_OPMODE] & RF_OPMODE_MASK) | RFLR_OPMODE_STANDBY;
+        sx1276_sim_mode_entered = now;
+
+        // give the "network" a chance to queue a downlink before TxDone is handled
+        if (sx1276_sim_tx_handler != NULL) {
+            sx1276_sim_tx_handler(frame, size, (uint32_t)(frf * SX1276_SIM_FREQ_STEP), sx1276_sim_tx_context);
+        }
+
+        SX1276SimRaiseIrq(RFLR_IRQFLAGS_TXDONE);
+    } else if (mode == RFLR_OPMODE_RECEIVER || mode == RFLR_OPMODE_RECEIVER_SINGLE) {
+        sx1276_sim_stats.RxOnUs += now - sx1276_sim_mode_entered;
+
+        if (mode == RFLR_OPMODE_RECEIVER_SINGLE) {
+            sx1276_sim_regs[0][REG_OPMODE] = (sx1276_sim_regs[0][REG_OPMODE] & RF_OPMODE_MASK) | RFLR_OPMODE_STANDBY;
+        }
+        sx1276_sim_mode_entered = now;
+
+        if (sx1276_sim_rx_due) {
+            struct sx1276_sim_rx_frame* frame = &sx1276_sim_rx_queue[sx1276_sim_rx_head];
+            uint8_t base = sx1276_sim_regs[1][REG_LR_FIFORXBASEADDR];
+            int16_t rssi = frame->rssi + 157;
+
+            for (int i = 0; i < frame->size; i++) {
+                sx1276_sim_fifo[(uint8_t)(base + i)] = frame->buffer[i];
+            }
+
+            sx1276_sim_regs[1][REG_LR_FIFORXCURRENTADDR] = base;
+            sx1276_sim_regs[1][REG_LR_RXNBBYTES] = frame->size;
+            sx1276_sim_regs[1][REG_LR_PKTSNRVALUE] = (uint8_t)(frame->snr * 4);
+            sx1276_sim_regs[1][REG_LR_PKTRSSIVALUE] = (rssi < 0) ? 0 : ((rssi > 255) ? 255 : rssi);
+
+            sx1276_sim_rx_head = (sx1276_sim_rx_head + 1) % SX1276_SIM_RX_QUEUE_SIZE;
+            sx1276_sim_rx_count--;
+
+            sx1276_sim_stats.RxFrames++;
+            sx1276_sim_rx_due = false;
+
+            SX1276SimRaiseIrq(RFLR_IRQFLAGS_VALIDHEADER | RFLR_IRQFLAGS_RXDONE);
+        } else {
+            sx1276_sim_stats.RxTimeouts++;
+
+            SX1276SimRaiseIrq(RFLR_IRQFLAGS_RXTIMEOUT);
+        }
+    }
+}
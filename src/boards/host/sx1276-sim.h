@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ * 
+ */
+
+#ifndef _SX1276_SIM_H_
+#define _SX1276_SIM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gpio.h"
+
+/*!
+ * Register level model of the SX1276 LoRa modem used by the host port.
+ *
+ * The model sits behind SpiInOut( ) and the NSS / RESET / DIO pins, so the
+ * unmodified LoRaMac-node sx1276.c driver runs against it. Transmissions
+ * complete after their computed time on air in virtual time, and receive
+ * windows either time out after the programmed number of symbols or deliver
+ * the next frame queued with SX1276SimQueueRxFrame( ). A frame queued with
+ * SX1276SimQueueRxFrameAt( ) is only received by a window that is open while
+ * enough of its preamble is left, as on air.
+ *
+ * The bus is modelled at byte level for spi-board.c, and at bit level on
+ * the SCK, MOSI and MISO pins for the PIO model.
+ */
+
+typedef struct SX1276SimStats_s
+{
+    uint32_t SpiTransactions;
+    uint32_t SpiBytes;
+    uint32_t TxFrames;
+    uint32_t RxFrames;
+    uint32_t RxTimeouts;
+    uint32_t RxMissed;      // timed frames no receive window caught
+    uint64_t TxOnAirUs;
+    uint64_t RxOnUs;
+} SX1276SimStats_t;
+
+/*!
+ * \brief Called at the end of every simulated transmission
+ *
+ * \param [IN] buffer    Frame that was sent
+ * \param [IN] size      Frame size in bytes
+ * \param [IN] frequency Channel frequency in Hz
+ * \param [IN] context   Context given to SX1276SimSetTxHandler
+ */
+typedef void ( SX1276SimTxHandler )( const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context );
+
+/*!
+ * \brief Called when a DIO line of the model changes level
+ */
+typedef void ( SX1276SimDioHandler )( uint8_t dio, uint32_t level );
+
+void SX1276SimSetTxHandler( SX1276SimTxHandler* handler, void* context );
+
+void SX1276SimSetDioHandler( SX1276SimDioHandler* handler );
+
+/*!
+ * \brief Queues a frame to be delivered in the next receive window
+ *
+ * \retval true if the frame was queued
+ */
+bool SX1276SimQueueRxFrame( const uint8_t* buffer, uint8_t size, int16_t rssi, int8_t snr );
+
+/*!
+ * \brief Queues a frame whose preamble starts at a set virtual time, like a
+ *        gateway transmitting it at the start of a receive window
+ *
+ * \param [IN] start Preamble start in us, 0 for the next receive window
+ * \retval true if the frame was queued
+ */
+bool SX1276SimQueueRxFrameAt( const uint8_t* buffer, uint8_t size, int16_t rssi, int8_t snr, uint64_t start );
+
+void SX1276SimGetStats( SX1276SimStats_t* stats );
+
+void SX1276SimResetStats( void );
+
+/*!
+ * \brief Writes every transaction that reaches the bus to trace, one line
+ *        per transaction: "W" or "R", the address and the data bytes in hex.
+ *        NULL stops tracing.
+ */
+void SX1276SimSetTrace( FILE* trace );
+
+/*!
+ * Pin and bus hooks used by the host gpio-board.c and spi-board.c
+ */
+void SX1276SimPinWrite( PinNames pin, uint32_t value );
+
+bool SX1276SimPinRead( PinNames pin, uint32_t* value );
+
+uint8_t SX1276SimSpiTransfer( uint8_t out );
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+/*
+ * sx1276_spi, assembled from ../rp2040/sx1276-spi.pio
+ *
+ * The RP2040 build generates this header with pioasm. The host port can not
+ * run pioasm, so it uses this copy in the pioasm output format, regenerate
+ * it with "pioasm -o c-sdk" when the program changes.
+ */
+
+#pragma once
+
+#include "hardware/pio.h"
+
+#define sx1276_spi_wrap_target 0
+#define sx1276_spi_wrap 23
+
+static const uint16_t sx1276_spi_program_instructions[] = {
+            //     .wrap_target
+    0x6027, //  0: out    x, 7            side 0
+    0x6041, //  1: out    y, 1            side 0
+    0xe000, //  2: set    pins, 0         side 0
+    0x0045, //  3: jmp    x--, 5          side 0
+    0x0016, //  4: jmp    22              side 0
+    0x6101, //  5: out    pins, 1         side 0 [1]
+    0x5101, //  6: in     pins, 1         side 1 [1]
+    0x6101, //  7: out    pins, 1         side 0 [1]
+    0x5101, //  8: in     pins, 1         side 1 [1]
+    0x6101, //  9: out    pins, 1         side 0 [1]
+    0x5101, // 10: in     pins, 1         side 1 [1]
+    0x6101, // 11: out    pins, 1         side 0 [1]
+    0x5101, // 12: in     pins, 1         side 1 [1]
+    0x6101, // 13: out    pins, 1         side 0 [1]
+    0x5101, // 14: in     pins, 1         side 1 [1]
+    0x6101, // 15: out    pins, 1         side 0 [1]
+    0x5101, // 16: in     pins, 1         side 1 [1]
+    0x6101, // 17: out    pins, 1         side 0 [1]
+    0x5101, // 18: in     pins, 1         side 1 [1]
+    0x6101, // 19: out    pins, 1         side 0 [1]
+    0x5101, // 20: in     pins, 1         side 1 [1]
+    0x0045, // 21: jmp    x--, 5          side 0
+    0x0060, // 22: jmp    !y, 0           side 0
+    0xe001, // 23: set    pins, 1         side 0
+            //     .wrap
+};
+
+static const struct pio_program sx1276_spi_program = {
+    .instructions = sx1276_spi_program_instructions,
+    .length = 24,
+    .origin = -1,
+};
+
+static inline pio_sm_config sx1276_spi_program_get_default_config(uint offset) {
+    pio_sm_config c = pio_get_default_sm_config();
+    sm_config_set_wrap(&c, offset + sx1276_spi_wrap_target, offset + sx1276_spi_wrap);
+    sm_config_set_sideset(&c, 1, false, false);
+    return c;
+}
+
+static inline void sx1276_spi_program_init(PIO pio, uint sm, uint offset, float clkdiv, uint sck, uint mosi, uint miso, uint nss) {
+    pio_sm_config c = sx1276_spi_program_get_default_config(offset);
+    uint32_t outputs = (1u << sck) | (1u << mosi) | (1u << nss);
+
+    sm_config_set_out_pins(&c, mosi, 1);
+    sm_config_set_in_pins(&c, miso);
+    sm_config_set_set_pins(&c, nss, 1);
+    sm_config_set_sideset_pins(&c, sck);
+
+    // a byte at a time, MSB first, with autopull and autopush
+    sm_config_set_out_shift(&c, false, true, 8);
+    sm_config_set_in_shift(&c, false, true, 8);
+    sm_config_set_clkdiv(&c, clkdiv);
+
+    // NSS high, SCK low while idle
+    pio_sm_set_pins_with_mask(pio, sm, (1u << nss), outputs);
+    pio_sm_set_pindirs_with_mask(pio, sm, outputs, outputs | (1u << miso));
+
+    pio_gpio_init(pio, sck);
+    pio_gpio_init(pio, mosi);
+    pio_gpio_init(pio, miso);
+    pio_gpio_init(pio, nss);
+
+    pio_sm_init(pio, sm, offset, &c);
+    pio_sm_set_enabled(pio, sm, true);
+}
@@ -9,13 +9,57 @@
 #include <string.h>
 
 #include "pico.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
 #include "pico/unique_id.h"
+#include "hardware/regs/m0plus.h"
+#include "hardware/structs/clocks.h"
+#include "hardware/structs/scb.h"
 #include "hardware/sync.h"
+#include "hardware/timer.h"
 
 #include "board.h"
+#include "board-irq.h"
+#include "board-sleep.h"
+
+// upper bound of the deferred handler sources the RAM resident interrupts
+// register, the radio DIO0 and DIO1 and the RTC alarm take 3
+#define BOARD_DEFERRED_IRQS_MAX (8)
+
+typedef struct BoardDeferredIrq_s
+{
+    BoardIrqDeferredHandler_t* Handler;
+    void* Context;
+    uint32_t Timestamp;
+} BoardDeferredIrq_t;
+
+static volatile bool board_flash_busy = false;
+static uint32_t board_flash_irq_state;
+static bool board_flash_lockout = false;
+
+static uint32_t board_ram_irq_mask = 0;
+static BoardDeferredIrq_t board_deferred_irqs[BOARD_DEFERRED_IRQS_MAX];
+static volatile uint32_t board_deferred_irq_count = 0;
+static uint32_t board_deferred_irq_sources = 0;
+static volatile uint32_t board_deferred_irq_drops = 0;
+
+static volatile uint32_t board_max_irq_latency = 0;
+
+#if PICO_LORAWAN_CORE1
+// the MAC on core 1 and the application on core 0 share the uplink queue, the
+// critical sections also keep the other core out, and nest as LoRaMac-node's do
+static spin_lock_t* board_critical_lock = NULL;
+static volatile int board_critical_owner = -1;
+static uint32_t board_critical_depth = 0;
+#endif
 
 void BoardInitMcu( void )
 {
+#if PICO_LORAWAN_CORE1
+    if (board_critical_lock == NULL) {
+        board_critical_lock = spin_lock_init(spin_lock_claim_unused(true));
+    }
+#endif
 }
 
 void BoardInitPeriph( void )
@@ -24,7 +68,55 @@ void BoardInitPeriph( void )
 
 void BoardLowPowerHandler( void )
 {
+    BoardSleepUntil(0);
+}
+
+static int64_t board_wake_callback(alarm_id_t id, void* user_data)
+{
+    // nothing to do, the interrupt woke the core
+    return 0;
+}
+
+void BoardSleepUntil( uint64_t wakeTime )
+{
+    alarm_id_t alarm = 0;
+
+    if (wakeTime != 0) {
+        alarm = add_alarm_at(from_us_since_boot(wakeTime), board_wake_callback, NULL, false);
+
+        if (alarm <= 0) {
+            // already passed, or no alarm left to wake up with
+            return;
+        }
+    }
+
+#if PICO_LORAWAN_DEEP_SLEEP
+    // keep the timer counting and the GPIO edges detected, the rest of the
+    // clocks stop until an interrupt is pending
+    clocks_hw->sleep_en0 = CLOCKS_SLEEP_EN0_CLK_SYS_IO_BITS | CLOCKS_SLEEP_EN0_CLK_SYS_PADS_BITS;
+    clocks_hw->sleep_en1 = CLOCKS_SLEEP_EN1_CLK_SYS_TIMER_BITS | CLOCKS_SLEEP_EN1_CLK_SYS_WATCHDOG_BITS;
+
+    scb_hw->scr |= M0PLUS_SCR_SLEEPDEEP_BITS;
+#endif
+
     __wfi();
+
+#if PICO_LORAWAN_DEEP_SLEEP
+    scb_hw->scr &= ~M0PLUS_SCR_SLEEPDEEP_BITS;
+
+    clocks_hw->sleep_en0 = ~0u;
+    clocks_hw->sleep_en1 = ~0u;
+#endif
+
+    if (alarm > 0) {
+        cancel_alarm(alarm);
+    }
+}
+
+bool BoardAdvanceTime( uint64_t wakeTime )
+{
+    // the timer keeps counting, the task blocks until an interrupt wakes it
+    return false;
 }
 
 uint8_t BoardGetBatteryLevel( void )
@@ -53,13 +145,140 @@ void BoardGetUniqueId( uint8_t *id )
 void BoardCriticalSectionBegin( uint32_t *mask )
 {
     *mask = save_and_disable_interrupts();
+
+#if PICO_LORAWAN_CORE1
+    if (board_critical_owner != (int)get_core_num()) {
+        spin_lock_unsafe_blocking(board_critical_lock);
+        board_critical_owner = get_core_num();
+    }
+
+    board_critical_depth++;
+#endif
 }
 
 void BoardCriticalSectionEnd( uint32_t *mask )
 {
+#if PICO_LORAWAN_CORE1
+    if (--board_critical_depth == 0) {
+        board_critical_owner = -1;
+        spin_unlock_unsafe(board_critical_lock);
+    }
+#endif
+
     restore_interrupts(*mask);
 }
 
 void BoardResetMcu( void )
 {
 }
+
+void BoardFlashOperationBegin( void )
+{
+    // the other core may be running from flash too
+    board_flash_lockout = multicore_lockout_victim_is_initialized(get_core_num() ^ 1);
+
+    if (board_flash_lockout) {
+        multicore_lockout_start_blocking();
+    }
+
+#if PICO_LORAWAN_RAM_IRQ
+    uint32_t mask = save_and_disable_interrupts();
+
+    // only leave the interrupts with RAM resident handlers enabled
+    board_flash_irq_state = *((io_rw_32*)(PPB_BASE + M0PLUS_NVIC_ISER_OFFSET));
+    *((io_rw_32*)(PPB_BASE + M0PLUS_NVIC_ICER_OFFSET)) = board_flash_irq_state & ~board_ram_irq_mask;
+
+    board_flash_busy = true;
+
+    restore_interrupts(mask);
+#else
+    board_flash_irq_state = save_and_disable_interrupts();
+#endif
+}
+
+void BoardFlashOperationEnd( void )
+{
+#if PICO_LORAWAN_RAM_IRQ
+    uint32_t mask = save_and_disable_interrupts();
+
+    board_flash_busy = false;
+
+    // run the deferred handlers in order, still with interrupts masked as
+    // they expect to be called from interrupt context
+    for (uint32_t i = 0; i < board_deferred_irq_count; i++) {
+        BoardIrqRecordLatency(time_us_32() - board_deferred_irqs[i].Timestamp);
+
+        board_deferred_irqs[i].Handler(board_deferred_irqs[i].Context);
+    }
+
+    board_deferred_irq_count = 0;
+
+    *((io_rw_32*)(PPB_BASE + M0PLUS_NVIC_ISER_OFFSET)) = board_flash_irq_state;
+
+    restore_interrupts(mask);
+#else
+    restore_interrupts(board_flash_irq_state);
+#endif
+
+    if (board_flash_lockout) {
+        multicore_lockout_end_blocking();
+    }
+}
+
+void BoardIrqSetRamResident( uint32_t irq, uint32_t sources )
+{
+    board_ram_irq_mask |= (1u << irq);
+
+    // each source is pending at most once, see BoardIrqDefer( )
+    board_deferred_irq_sources += sources;
+
+    if (board_deferred_irq_sources > BOARD_DEFERRED_IRQS_MAX) {
+        board_deferred_irq_sources = BOARD_DEFERRED_IRQS_MAX;
+    }
+}
+
+bool BOARD_RAM_FUNC(BoardIrqDefer)( BoardIrqDeferredHandler_t* handler, void* context )
+{
+    if (!board_flash_busy) {
+        return false;
+    }
+
+    // the handlers read the state of their source, so one run covers a
+    // source that fired again before it ran, the latency is of the first
+    for (uint32_t i = 0; i < board_deferred_irq_count; i++) {
+        if (board_deferred_irqs[i].Handler == handler && board_deferred_irqs[i].Context == context) {
+            return true;
+        }
+    }
+
+    // there is one entry per registered source, so this only happens to a
+    // source that was not registered, it can't run from flash now either
+    if (board_deferred_irq_count >= board_deferred_irq_sources) {
+        board_deferred_irq_drops++;
+        return true;
+    }
+
+    board_deferred_irqs[board_deferred_irq_count].Handler = handler;
+    board_deferred_irqs[board_deferred_irq_count].Context = context;
+    board_deferred_irqs[board_deferred_irq_count].Timestamp = time_us_32();
+    board_deferred_irq_count++;
+
+    return true;
+}
+
+void BOARD_RAM_FUNC(BoardIrqRecordLatency)( uint32_t latency )
+{
+    if (latency > board_max_irq_latency) {
+        board_max_irq_latency = latency;
+    }
+}
+
+uint32_t BoardIrqGetMaxLatency( void )
+{
+    return board_max_irq_latency;
+}
+
+uint32_t BoardIrqGetDrops( void )
+{
+    return board_deferred_irq_drops;
+}
@@ -2,50 +2,312 @@
  * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
  *
  * SPDX-License-Identifier: BSD-3-Clause
- * 
+ *
  */
 
 #include <string.h>
 
 #include "pico/stdlib.h"
+#include "pico/lorawan.h"
 #include "hardware/flash.h"
 
 #include "utilities.h"
+#include "board-irq.h"
 #include "eeprom-board.h"
+#include "eeprom-mcu.h"
+#include "nvm-cow.h"
+#include "nvm-journal.h"
+
+#ifndef PICO_LORAWAN_NVM_SECTORS
+#define PICO_LORAWAN_NVM_SECTORS (1)
+#endif
+
+#ifndef PICO_LORAWAN_NVM_LEAN
+#define PICO_LORAWAN_NVM_LEAN (0)
+#endif
 
 #define EEPROM_SIZE    (FLASH_SECTOR_SIZE)
-#define EEPROM_OFFSET  (PICO_FLASH_SIZE_BYTES - EEPROM_SIZE)
+#define EEPROM_OFFSET  (PICO_FLASH_SIZE_BYTES - EEPROM_SIZE * PICO_LORAWAN_NVM_SECTORS)
 #define EEPROM_ADDRESS ((const uint8_t*)(XIP_BASE + EEPROM_OFFSET))
+#define EEPROM_PAGES   (EEPROM_SIZE / FLASH_PAGE_SIZE)
 
+#if PICO_LORAWAN_NVM_LEAN
+// read through XIP, only the pages being changed are held in RAM
+static struct nvm_cow eeprom_cow;
+#else
 static uint8_t eeprom_write_cache[EEPROM_SIZE];
+#endif
 
-void EepromMcuInit()
+static EepromMcuStats_t eeprom_stats;
+static uint32_t eeprom_sector_erases[PICO_LORAWAN_NVM_SECTORS];
+
+static void EepromMcuCountErase( uint32_t offset )
 {
-    memcpy(eeprom_write_cache, EEPROM_ADDRESS, sizeof(eeprom_write_cache));
+    uint32_t sector = offset / FLASH_SECTOR_SIZE;
+
+    eeprom_stats.Erases++;
+    eeprom_sector_erases[sector]++;
+
+    if (eeprom_sector_erases[sector] > eeprom_stats.MaxSectorErases) {
+        eeprom_stats.MaxSectorErases = eeprom_sector_erases[sector];
+    }
+}
+
+void EepromMcuFlashGetStats( EepromMcuStats_t* stats )
+{
+    stats->Erases = eeprom_stats.Erases;
+    stats->SkippedErases = eeprom_stats.SkippedErases;
+    stats->PagesProgrammed = eeprom_stats.PagesProgrammed;
+    stats->MaxSectorErases = eeprom_stats.MaxSectorErases;
+
+#if PICO_LORAWAN_NVM_LEAN
+    stats->SkippedErases = eeprom_cow.stats.skipped_erases;
+    stats->RamBytes = eeprom_cow.stats.buffer_bytes;
+    stats->MaxRamBytes = eeprom_cow.stats.max_buffer_bytes;
+#else
+    stats->RamBytes = sizeof(eeprom_write_cache);
+    stats->MaxRamBytes = sizeof(eeprom_write_cache);
+#endif
+}
+
+#if PICO_LORAWAN_NVM_SECTORS > 1 || PICO_LORAWAN_NVM_LEAN
+
+static void EepromMcuFlashRead( void* context, uint32_t offset, void* data, uint32_t size )
+{
+    memcpy(data, EEPROM_ADDRESS + offset, size);
+}
+
+static int EepromMcuFlashErase( void* context, uint32_t offset )
+{
+    // XIP is only unavailable for one sector or page at a time
+    BoardFlashOperationBegin();
+    flash_range_erase(EEPROM_OFFSET + offset, FLASH_SECTOR_SIZE);
+    BoardFlashOperationEnd();
+
+    EepromMcuCountErase(offset);
+
+    return 0;
 }
 
-uint8_t EepromMcuReadBuffer( uint16_t addr, uint8_t *buffer, uint16_t size )
+static int EepromMcuFlashProgram( void* context, uint32_t offset, const void* data, uint32_t size )
+{
+    BoardFlashOperationBegin();
+    flash_range_program(EEPROM_OFFSET + offset, data, size);
+    BoardFlashOperationEnd();
+
+    eeprom_stats.PagesProgrammed += size / FLASH_PAGE_SIZE;
+
+    return 0;
+}
+
+static const struct nvm_journal_flash eeprom_flash = {
+    .sector_size = FLASH_SECTOR_SIZE,
+    .page_size = FLASH_PAGE_SIZE,
+    .sector_count = PICO_LORAWAN_NVM_SECTORS,
+    .context = NULL,
+    .read = EepromMcuFlashRead,
+    .erase = EepromMcuFlashErase,
+    .program = EepromMcuFlashProgram
+};
+
+#endif
+
+#if PICO_LORAWAN_NVM_LEAN
+
+static int EepromBackendInit( void* context )
+{
+    // nothing is copied, the image is read through XIP
+    return nvm_cow_init(&eeprom_cow, &eeprom_flash);
+}
+
+static int EepromBackendRead( void* context, uint16_t addr, void* buffer, uint16_t size )
+{
+    nvm_cow_read(&eeprom_cow, addr, buffer, size);
+
+    return 0;
+}
+
+static int EepromBackendWrite( void* context, uint16_t addr, const void* buffer, uint16_t size )
+{
+    return nvm_cow_write(&eeprom_cow, addr, buffer, size);
+}
+
+static int EepromBackendFlush( void* context )
+{
+    if (!nvm_cow_is_dirty(&eeprom_cow)) {
+        return 1;
+    }
+
+    return nvm_cow_flush(&eeprom_cow);
+}
+
+static bool EepromBackendProcess( void* context )
+{
+    return false;
+}
+
+#else
+
+static int EepromBackendRead( void* context, uint16_t addr, void* buffer, uint16_t size )
 {
     memcpy(buffer, eeprom_write_cache + addr, size);
-    
-    return SUCCESS;
+
+    return 0;
 }
 
-uint8_t EepromMcuWriteBuffer( uint16_t addr, uint8_t *buffer, uint16_t size )
+#if PICO_LORAWAN_NVM_SECTORS > 1
+
+static struct nvm_journal eeprom_journal;
+
+static int EepromBackendInit( void* context )
+{
+    memset(eeprom_write_cache, 0xff, sizeof(eeprom_write_cache));
+
+    if (nvm_journal_init(&eeprom_journal, &eeprom_flash, eeprom_write_cache, sizeof(eeprom_write_cache)) == 1) {
+        // no journal yet, import the image of the single sector layout, the
+        // last sector of the ring, it is only erased once the journal wraps
+        memcpy(eeprom_write_cache, EEPROM_ADDRESS + (PICO_LORAWAN_NVM_SECTORS - 1) * EEPROM_SIZE, sizeof(eeprom_write_cache));
+
+        nvm_journal_mark_all(&eeprom_journal);
+    }
+
+    return 0;
+}
+
+static int EepromBackendWrite( void* context, uint16_t addr, const void* buffer, uint16_t size )
+{
+    nvm_journal_write(&eeprom_journal, addr, buffer, size);
+
+    return 0;
+}
+
+static int EepromBackendFlush( void* context )
 {
-    memcpy(eeprom_write_cache + addr, buffer, size);
+    if (!nvm_journal_is_dirty(&eeprom_journal)) {
+        return 1;
+    }
 
-    return SUCCESS;
+    return nvm_journal_flush(&eeprom_journal);
 }
 
-uint8_t EepromMcuFlush()
+static bool EepromBackendProcess( void* context )
 {
-    uint32_t mask;
+    return nvm_journal_process(&eeprom_journal);
+}
+
+#else
+
+// pages of the cache that were written to since the last flush
+static uint32_t eeprom_dirty_pages;
+
+static int EepromBackendInit( void* context )
+{
+    memcpy(eeprom_write_cache, EEPROM_ADDRESS, sizeof(eeprom_write_cache));
 
-    BoardCriticalSectionBegin(&mask);
+    eeprom_dirty_pages = 0;
 
-    flash_range_erase(EEPROM_OFFSET, sizeof(eeprom_write_cache));
-    flash_range_program(EEPROM_OFFSET, eeprom_write_cache, sizeof(eeprom_write_cache));
+    return 0;
+}
+
+static int EepromBackendWrite( void* context, uint16_t addr, const void* buffer, uint16_t size )
+{
+    const uint8_t* data = buffer;
 
-    BoardCriticalSectionEnd(&mask);
+    for (uint16_t i = 0; i < size; i++) {
+        if (eeprom_write_cache[addr + i] != data[i]) {
+            eeprom_write_cache[addr + i] = data[i];
+            eeprom_dirty_pages |= (1u << ((addr + i) / FLASH_PAGE_SIZE));
+        }
+    }
+
+    return 0;
 }
+
+static int EepromBackendFlush( void* context )
+{
+    uint32_t pages = 0;
+    bool erase = false;
+
+    // compare the dirty pages against flash, through XIP
+    for (uint32_t page = 0; page < EEPROM_PAGES; page++) {
+        const uint8_t* flash = EEPROM_ADDRESS + page * FLASH_PAGE_SIZE;
+        const uint8_t* cache = eeprom_write_cache + page * FLASH_PAGE_SIZE;
+
+        if (!(eeprom_dirty_pages & (1u << page)) || memcmp(flash, cache, FLASH_PAGE_SIZE) == 0) {
+            continue;
+        }
+
+        pages |= (1u << page);
+
+        // programming can only clear bits
+        for (uint32_t i = 0; i < FLASH_PAGE_SIZE && !erase; i++) {
+            if ((flash[i] & cache[i]) != cache[i]) {
+                erase = true;
+            }
+        }
+    }
+
+    eeprom_dirty_pages = 0;
+
+    if (pages == 0) {
+        return 1;
+    }
+
+    if (erase) {
+        // after the erase, every page that isn't blank must be programmed again
+        pages = 0;
+
+        for (uint32_t page = 0; page < EEPROM_PAGES; page++) {
+            const uint8_t* cache = eeprom_write_cache + page * FLASH_PAGE_SIZE;
+
+            for (uint32_t i = 0; i < FLASH_PAGE_SIZE; i++) {
+                if (cache[i] != 0xff) {
+                    pages |= (1u << page);
+                    break;
+                }
+            }
+        }
+    } else {
+        eeprom_stats.SkippedErases++;
+    }
+
+    BoardFlashOperationBegin();
+
+    if (erase) {
+        flash_range_erase(EEPROM_OFFSET, sizeof(eeprom_write_cache));
+    }
+
+    for (uint32_t page = 0; page < EEPROM_PAGES; page++) {
+        if (pages & (1u << page)) {
+            flash_range_program(EEPROM_OFFSET + page * FLASH_PAGE_SIZE, eeprom_write_cache + page * FLASH_PAGE_SIZE, FLASH_PAGE_SIZE);
+
+            eeprom_stats.PagesProgrammed++;
+        }
+    }
+
+    BoardFlashOperationEnd();
+
+    if (erase) {
+        EepromMcuCountErase(0);
+    }
+
+    return 0;
+}
+
+static bool EepromBackendProcess( void* context )
+{
+    return false;
+}
+
+#endif
+
+#endif
+
+const struct lorawan_nvm_backend EepromMcuFlashBackend = {
+    .init = EepromBackendInit,
+    .read = EepromBackendRead,
+    .write = EepromBackendWrite,
+    .flush = EepromBackendFlush,
+    .process = EepromBackendProcess,
+    .size = NULL
+};
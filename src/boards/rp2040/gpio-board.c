@@ -7,7 +7,9 @@
 
 #include "hardware/gpio.h"
 
+#include "board-irq.h"
 #include "gpio-board.h"
+#include "spi-burst.h"
 
 void GpioMcuInit( Gpio_t *obj, PinNames pin, PinModes mode, PinConfigs config, PinTypes type, uint32_t value )
 {
@@ -51,12 +53,17 @@ void GpioMcuInit( Gpio_t *obj, PinNames pin, PinModes mode, PinConfigs config, P
     }
 }
 
-void GpioMcuWrite( Gpio_t *obj, uint32_t value )
+void BOARD_RAM_FUNC(GpioMcuWrite)( Gpio_t *obj, uint32_t value )
 {
+    // the NSS line of the radio is driven by the SPI burst layer
+    if (SpiBurstOnNssWrite(obj, value)) {
+        return;
+    }
+
     gpio_put(obj->pin, value);
 }
 
-uint32_t GpioMcuRead( Gpio_t *obj )
+uint32_t BOARD_RAM_FUNC(GpioMcuRead)( Gpio_t *obj )
 {
     return gpio_get(obj->pin);
 }
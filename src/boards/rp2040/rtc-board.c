@@ -7,16 +7,99 @@
 
 #include "pico/time.h"
 #include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
 
+#include "board-irq.h"
+#include "board-sleep.h"
 #include "rtc-board.h"
 
-static alarm_pool_t* rtc_alarm_pool = NULL;
+/*
+ * LoRaMac-node keeps timer ticks in 32 bits. Ticks are 1 ms, taken from the
+ * 64-bit microsecond timer, so they wrap after about 49.7 days instead of
+ * 71.6 minutes for 1 us ticks, and at a power of two in milliseconds too.
+ */
+#define RTC_US_PER_TICK 1000
+
 static absolute_time_t rtc_timer_context;
+
+#if PICO_LORAWAN_RAM_IRQ
+/*
+ * The alarm pool handles its IRQ from flash, drive a hardware alarm directly
+ * so the IRQ can stay enabled while flash is written.
+ */
+static uint rtc_alarm_num;
+static volatile bool rtc_alarm_armed = false;
+static uint64_t rtc_alarm_target;
+#else
+static alarm_pool_t* rtc_alarm_pool = NULL;
 static alarm_id_t last_rtc_alarm_id = -1;
+static volatile bool rtc_alarm_armed = false;
+static absolute_time_t rtc_alarm_target;
+#endif
+
+#if PICO_LORAWAN_RAM_IRQ
+static void rtc_alarm_deferred(void* context)
+{
+    TimerIrqHandler( );
+}
+
+static void __not_in_flash_func(rtc_alarm_program)(void)
+{
+    // the hardware alarm matches the low 32 bits only, so an alarm more than
+    // 71.6 minutes away first fires on an earlier wrap and is re-armed
+    timer_hw->alarm[rtc_alarm_num] = (uint32_t)rtc_alarm_target;
+
+    // the alarm only fires on an exact match, force it if the target has
+    // already passed
+    if (time_us_64() >= rtc_alarm_target) {
+        hw_set_bits(&timer_hw->intf, 1u << rtc_alarm_num);
+    }
+}
+
+static void __not_in_flash_func(rtc_alarm_irq_handler)(void)
+{
+    hw_clear_bits(&timer_hw->intf, 1u << rtc_alarm_num);
+    timer_hw->intr = 1u << rtc_alarm_num;
+
+    if (!rtc_alarm_armed) {
+        return;
+    }
+
+    uint64_t now = time_us_64();
+
+    // a stale IRQ of a previous alarm, or a wrap of the low 32 bits
+    if (now < rtc_alarm_target) {
+        rtc_alarm_program();
+        return;
+    }
+
+    rtc_alarm_armed = false;
+
+    BoardIrqRecordLatency(now - rtc_alarm_target);
+
+    if (BoardIrqDefer(rtc_alarm_deferred, NULL)) {
+        return;
+    }
+
+    TimerIrqHandler( );
+}
+#endif
 
 void RtcInit( void )
 {
+#if PICO_LORAWAN_RAM_IRQ
+    rtc_alarm_num = hardware_alarm_claim_unused(true);
+
+    irq_set_exclusive_handler(TIMER_IRQ_0 + rtc_alarm_num, rtc_alarm_irq_handler);
+    hw_set_bits(&timer_hw->inte, 1u << rtc_alarm_num);
+    irq_set_enabled(TIMER_IRQ_0 + rtc_alarm_num, true);
+
+    BoardIrqSetRamResident(TIMER_IRQ_0 + rtc_alarm_num, 1);
+#else
     rtc_alarm_pool = alarm_pool_create(2, 16);
+#endif
 
     RtcSetTimerContext();
 }
@@ -40,21 +123,22 @@ uint32_t RtcGetTimerElapsedTime( void )
 {
     int64_t delta = absolute_time_diff_us(rtc_timer_context, get_absolute_time());
 
-    return delta;
+    return delta / RTC_US_PER_TICK;
 }
 
 uint32_t RtcSetTimerContext( void )
 {
-    rtc_timer_context = get_absolute_time();
+    uint64_t now = to_us_since_boot(get_absolute_time());
 
-    uint64_t ticks = to_us_since_boot(rtc_timer_context);
+    // on a tick boundary, so the context and RtcGetTimerValue() agree
+    rtc_timer_context = from_us_since_boot(now - (now % RTC_US_PER_TICK));
 
-    return ticks;
+    return now / RTC_US_PER_TICK;
 }
 
 uint32_t RtcGetTimerContext( void )
 {
-    uint64_t ticks = to_us_since_boot(rtc_timer_context);
+    uint64_t ticks = to_us_since_boot(rtc_timer_context) / RTC_US_PER_TICK;
 
     return ticks;
 }
@@ -64,7 +148,36 @@ uint32_t RtcGetMinimumTimeout( void )
     return 1;
 }
 
+#if PICO_LORAWAN_RAM_IRQ
+void RtcSetAlarm( uint32_t timeout )
+{
+    uint32_t mask = save_and_disable_interrupts();
+
+    rtc_alarm_target = to_us_since_boot(rtc_timer_context) + (uint64_t)timeout * RTC_US_PER_TICK;
+    rtc_alarm_armed = true;
+
+    timer_hw->intr = 1u << rtc_alarm_num;
+    rtc_alarm_program();
+
+    restore_interrupts(mask);
+}
+
+void RtcStopAlarm( void )
+{
+    rtc_alarm_armed = false;
+
+    timer_hw->armed = 1u << rtc_alarm_num;
+}
+#else
 static int64_t alarm_callback(alarm_id_t id, void *user_data) {
+    int64_t latency = absolute_time_diff_us(rtc_alarm_target, get_absolute_time());
+
+    if (latency > 0) {
+        BoardIrqRecordLatency(latency);
+    }
+
+    rtc_alarm_armed = false;
+
     TimerIrqHandler( );
 
     return 0;
@@ -76,31 +189,52 @@ void RtcSetAlarm( uint32_t timeout )
         alarm_pool_cancel_alarm(rtc_alarm_pool, last_rtc_alarm_id);
     }
 
-    last_rtc_alarm_id = alarm_pool_add_alarm_at(rtc_alarm_pool, delayed_by_us(rtc_timer_context, timeout), alarm_callback, NULL, true);
+    rtc_alarm_target = delayed_by_us(rtc_timer_context, (uint64_t)timeout * RTC_US_PER_TICK);
+    rtc_alarm_armed = true;
+
+    last_rtc_alarm_id = alarm_pool_add_alarm_at(rtc_alarm_pool, rtc_alarm_target, alarm_callback, NULL, true);
 }
 
 void RtcStopAlarm( void )
 {
+    rtc_alarm_armed = false;
+
     if (last_rtc_alarm_id > -1) {
         alarm_pool_cancel_alarm(rtc_alarm_pool, last_rtc_alarm_id);
     }
 }
+#endif
+
+bool RtcGetAlarmTime( uint64_t* time )
+{
+    if (!rtc_alarm_armed) {
+        return false;
+    }
+
+#if PICO_LORAWAN_RAM_IRQ
+    *time = rtc_alarm_target;
+#else
+    *time = to_us_since_boot(rtc_alarm_target);
+#endif
+
+    return true;
+}
 
 uint32_t RtcMs2Tick( TimerTime_t milliseconds )
 {
-    return milliseconds * 1000;
+    return milliseconds * (1000 / RTC_US_PER_TICK);
 }
 
 uint32_t RtcGetTimerValue( void )
 {
     uint64_t now = to_us_since_boot(get_absolute_time());
 
-    return now;
+    return now / RTC_US_PER_TICK;
 }
 
 TimerTime_t RtcTick2Ms( uint32_t tick )
 {
-    return us_to_ms(tick);
+    return tick / (1000 / RTC_US_PER_TICK);
 }
 
 void RtcBkupWrite( uint32_t data0, uint32_t data1 )
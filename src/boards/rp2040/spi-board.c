@@ -5,10 +5,120 @@
  * 
  */
 
+#include <stddef.h>
+
 #include "pico/stdlib.h"
+#include "hardware/dma.h"
 #include "hardware/spi.h"
 
+#include "board-irq.h"
 #include "spi-board.h"
+#include "spi-burst.h"
+#include "spi-pio.h"
+
+// shorter bursts are clocked by the CPU, setting up DMA costs more
+#define SPI_BURST_DMA_THRESHOLD (16)
+
+#define SPI_FIFO_DEPTH          (8)
+
+static int spi_dma_tx = -1;
+static int spi_dma_rx = -1;
+
+static const uint8_t spi_zero = 0x00;
+static uint8_t spi_discard;
+
+static inline spi_inst_t* spi_inst( Spi_t *obj )
+{
+    return (obj->SpiId == 0) ? spi0 : spi1;
+}
+
+static void BOARD_RAM_FUNC(spi_transfer_cpu)( spi_hw_t* hw, const uint8_t* tx, uint8_t* rx, size_t len )
+{
+    size_t tx_remaining = len;
+    size_t rx_remaining = len;
+
+    while (tx_remaining || rx_remaining) {
+        // keep the TX FIFO fed, without overflowing the RX FIFO
+        if (tx_remaining && (hw->sr & SPI_SSPSR_TNF_BITS) && (rx_remaining - tx_remaining) < SPI_FIFO_DEPTH) {
+            hw->dr = (tx != NULL) ? *tx++ : 0x00;
+            tx_remaining--;
+        }
+
+        if (rx_remaining && (hw->sr & SPI_SSPSR_RNE_BITS)) {
+            uint8_t in = (uint8_t)hw->dr;
+
+            if (rx != NULL) {
+                *rx++ = in;
+            }
+            rx_remaining--;
+        }
+    }
+}
+
+static void BOARD_RAM_FUNC(spi_transfer_dma)( spi_inst_t* spi, const uint8_t* tx, uint8_t* rx, size_t len )
+{
+    dma_channel_config config;
+
+    config = dma_channel_get_default_config(spi_dma_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, spi_get_dreq(spi, true));
+    channel_config_set_read_increment(&config, tx != NULL);
+    channel_config_set_write_increment(&config, false);
+    dma_channel_configure(spi_dma_tx, &config, &spi_get_hw(spi)->dr, (tx != NULL) ? tx : &spi_zero, len, false);
+
+    config = dma_channel_get_default_config(spi_dma_rx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, spi_get_dreq(spi, false));
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, rx != NULL);
+    dma_channel_configure(spi_dma_rx, &config, (rx != NULL) ? rx : &spi_discard, &spi_get_hw(spi)->dr, len, false);
+
+    // start both together, the last byte is clocked out once RX completes
+    dma_start_channel_mask((1u << spi_dma_tx) | (1u << spi_dma_rx));
+    dma_channel_wait_for_finish_blocking(spi_dma_rx);
+}
+
+void BOARD_RAM_FUNC(SpiMcuTransfer)( Spi_t *obj, const uint8_t *tx, uint8_t *rx, uint16_t size )
+{
+    if (SpiPioIsActive(obj)) {
+        SpiPioTransfer(obj, tx, rx, size);
+    } else if (size >= SPI_BURST_DMA_THRESHOLD && spi_dma_rx >= 0) {
+        spi_transfer_dma(spi_inst(obj), tx, rx, size);
+    } else {
+        spi_transfer_cpu(spi_get_hw(spi_inst(obj)), tx, rx, size);
+    }
+}
+
+uint8_t BOARD_RAM_FUNC(SpiMcuInOut)( Spi_t *obj, uint8_t outData )
+{
+    if (SpiPioIsActive(obj)) {
+        return SpiPioInOut(obj, outData);
+    }
+
+#if PICO_LORAWAN_RAM_IRQ
+    // spi_write_read_blocking( ) runs from flash, drive the FIFOs directly
+    uint8_t inData;
+
+    spi_transfer_cpu(spi_get_hw(spi_inst(obj)), &outData, &inData, 1);
+
+    return inData;
+#else
+    uint8_t inData = 0x00;
+
+    spi_write_read_blocking(spi_inst(obj), &outData, &inData, 1);
+
+    return inData;
+#endif
+}
+
+void BOARD_RAM_FUNC(SpiMcuSetNss)( Spi_t *obj, uint32_t value )
+{
+    if (SpiPioIsActive(obj)) {
+        SpiPioSetNss(obj, value);
+    } else {
+        gpio_put(obj->Nss.pin, value);
+    }
+}
 
 void SpiInit( Spi_t *obj, SpiId_t spiId, PinNames mosi, PinNames miso, PinNames sclk, PinNames nss )
 {
@@ -19,14 +129,12 @@ void SpiInit( Spi_t *obj, SpiId_t spiId, PinNames mosi, PinNames miso, PinNames
     gpio_set_function(sclk, GPIO_FUNC_SPI);
 
     obj->SpiId = spiId;
-}
-
-uint16_t SpiInOut( Spi_t *obj, uint16_t outData )
-{
-    const uint8_t outDataB = (outData & 0xff);
-    uint8_t inDataB = 0x00;
 
-    spi_write_read_blocking((obj->SpiId == 0) ? spi0 : spi1, &outDataB, &inDataB, 1);
+    // bursts fall back to the CPU when no DMA channels are free
+    if (spi_dma_rx < 0) {
+        spi_dma_tx = dma_claim_unused_channel(false);
+        spi_dma_rx = (spi_dma_tx < 0) ? -1 : dma_claim_unused_channel(false);
+    }
 
-    return inDataB;
+    SpiBurstInit(obj);
 }
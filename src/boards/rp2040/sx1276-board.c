@@ -28,9 +28,15 @@
 #include <stddef.h>
 
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "pico/time.h"
 
+#include "board-irq.h"
 #include "delay.h"
 #include "sx1276-board.h"
+#include "sx1276-spi.h"
+#include "sx1276-tx.h"
 
 #include "radio/radio.h"
 
@@ -67,14 +73,95 @@ const struct Radio_s Radio =
 
 static DioIrqHandler** irq_handlers;
 
+static uint64_t TxStartTime = 0;
+
+static uint32_t TxCount = 0;
+
+static volatile bool TxActive = false;
+
+static volatile uint64_t TxOnAirTime = 0;
+
+static volatile uint64_t TxDoneTime = 0;
+
+static SX1276BoardRxWindow_t RxWindows[SX1276_BOARD_RX_WINDOWS];
+
+static volatile uint8_t RxWindowCount = 0;
+
+static volatile bool RxActive = false;
+
+/*
+ * DIO0 is TX done while transmitting. Reads the raw timer, as the time
+ * functions of the SDK may run from flash.
+ */
+static void __not_in_flash_func(dio0_tx_done)(void)
+{
+    if (TxActive) {
+        uint32_t onAirTime = timer_hw->timerawl - (uint32_t)TxStartTime;
+
+        TxOnAirTime += onAirTime;
+        TxDoneTime = TxStartTime + onAirTime;
+        TxActive = false;
+    }
+}
+
+// and RX done in a single receive window
+static void __not_in_flash_func(dio0_rx_done)(void)
+{
+    if (RxActive) {
+        SX1276BoardRxWindow_t* window = &RxWindows[RxWindowCount - 1];
+
+        window->DoneTime = window->OpenTime + (uint32_t)(timer_hw->timerawl - (uint32_t)window->OpenTime);
+        RxActive = false;
+    }
+}
+
+#if PICO_LORAWAN_RAM_IRQ
+static void dio_deferred(void* context)
+{
+    irq_handlers[(uintptr_t)context](NULL);
+}
+
+/*
+ * The SDK GPIO callback dispatch runs from flash, so the DIO pins are handled
+ * by a RAM resident shared handler on IO_IRQ_BANK0 instead.
+ */
+static void __not_in_flash_func(dio_irq_handler)(void)
+{
+    io_irq_ctrl_hw_t* irq_ctrl = get_core_num() ? &iobank0_hw->proc1_irq_ctrl : &iobank0_hw->proc0_irq_ctrl;
+
+    for (uintptr_t dio = 0; dio < 2; dio++) {
+        uint pin = (dio == 0) ? SX1276.DIO0.pin : SX1276.DIO1.pin;
+        uint32_t events = (irq_ctrl->ints[pin / 8] >> (4 * (pin % 8))) & 0xf;
+
+        if (events == 0) {
+            continue;
+        }
+
+        // acknowledge the edge events
+        iobank0_hw->intr[pin / 8] = events << (4 * (pin % 8));
+
+        if (dio == 0) {
+            dio0_tx_done();
+            dio0_rx_done();
+        }
+
+        if (!BoardIrqDefer(dio_deferred, (void*)dio)) {
+            irq_handlers[dio](NULL);
+        }
+    }
+}
+#else
 void dio_gpio_callback(uint gpio, uint32_t events)
 {
     if (gpio == SX1276.DIO0.pin) {
+        dio0_tx_done();
+        dio0_rx_done();
         irq_handlers[0](NULL);
     } else if (gpio == SX1276.DIO1.pin) {
         irq_handlers[1](NULL);
     }
 }
+#endif
 
 void SX1276SetAntSwLowPower( bool status )
 {
@@ -94,8 +181,72 @@ uint32_t SX1276GetDio1PinState( void )
     return GpioRead(&SX1276.DIO1);
 }
 
+// from the settings of SX1276SetRxConfig( ), bandwidths 7 to 9 are 125 to 500 kHz
+static uint32_t rx_symbol_time(void)
+{
+    if (SX1276.Settings.Modem != MODEM_LORA || SX1276.Settings.LoRa.Bandwidth < 7) {
+        return 0;
+    }
+
+    return ((1u << SX1276.Settings.LoRa.Datarate) * 1000u) / (125u << (SX1276.Settings.LoRa.Bandwidth - 7));
+}
+
 void SX1276SetAntSw( uint8_t opMode )
 {
+    // called by SX1276SetOpMode( ) just before the mode is written
+    if (opMode == RFLR_OPMODE_TRANSMITTER) {
+        TxStartTime = to_us_since_boot(get_absolute_time());
+        TxCount++;
+        TxActive = true;
+        RxWindowCount = 0;
+        RxActive = false;
+    } else {
+        // left transmit without TX done, for example on a TX timeout
+        dio0_tx_done();
+        RxActive = false;
+
+        if (opMode == RFLR_OPMODE_RECEIVER_SINGLE && RxWindowCount < SX1276_BOARD_RX_WINDOWS) {
+            SX1276BoardRxWindow_t* window = &RxWindows[RxWindowCount];
+
+            window->OpenTime = to_us_since_boot(get_absolute_time());
+            window->DoneTime = 0;
+            window->SymbolTime = rx_symbol_time();
+
+            RxWindowCount++;
+            RxActive = true;
+        }
+    }
+}
+
+uint64_t SX1276BoardGetTxStartTime( void )
+{
+    return TxStartTime;
+}
+
+uint32_t SX1276BoardGetTxCount( void )
+{
+    return TxCount;
+}
+
+uint64_t SX1276BoardGetTxOnAirTime( void )
+{
+    return TxOnAirTime;
+}
+
+uint64_t SX1276BoardGetTxDoneTime( void )
+{
+    return TxDoneTime;
+}
+
+uint8_t SX1276BoardGetRxWindows( SX1276BoardRxWindow_t* windows )
+{
+    uint8_t count = RxWindowCount;
+
+    for (uint8_t i = 0; i < count; i++) {
+        windows[i] = RxWindows[i];
+    }
+
+    return count;
 }
 
 void SX1276Reset( void )
@@ -107,6 +258,9 @@ void SX1276Reset( void )
     GpioInit( &SX1276.Reset, SX1276.Reset.pin, PIN_OUTPUT, PIN_PUSH_PULL, PIN_PULL_UP, 1 ); // RST
 
     DelayMs (6);
+
+    // the registers are back to their reset values
+    SX1276SpiInvalidate( );
 }
 
 void SX1276IoInit( void )
@@ -116,14 +270,27 @@ void SX1276IoInit( void )
 
     GpioInit( &SX1276.DIO0, SX1276.DIO0.pin, PIN_INPUT, PIN_PUSH_PULL, PIN_PULL_UP, 0 );        // IRQ / DIO0
     GpioInit( &SX1276.DIO1, SX1276.DIO1.pin, PIN_INPUT, PIN_PUSH_PULL, PIN_PULL_UP, 0 );        // DI01
+
+    SX1276SpiInit( &SX1276.Spi );
 }
 
 void SX1276IoIrqInit( DioIrqHandler **irqHandlers )
 {
     irq_handlers = irqHandlers;
 
+#if PICO_LORAWAN_RAM_IRQ
+    gpio_set_irq_enabled(SX1276.DIO0.pin, GPIO_IRQ_EDGE_RISE, true);
+    gpio_set_irq_enabled(SX1276.DIO1.pin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+
+    irq_add_shared_handler(IO_IRQ_BANK0, dio_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+
+    // DIO0 and DIO1
+    BoardIrqSetRamResident(IO_IRQ_BANK0, 2);
+#else
     gpio_set_irq_enabled_with_callback(SX1276.DIO0.pin, GPIO_IRQ_EDGE_RISE, true, &dio_gpio_callback);
     gpio_set_irq_enabled_with_callback(SX1276.DIO1.pin, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &dio_gpio_callback);
+#endif
 }
 
 /*!
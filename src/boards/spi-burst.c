@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "board-irq.h"
+#include "spi-burst.h"
+
+// address byte and the whole 256 byte FIFO but one byte
+#define SPI_BURST_BUFFER_SIZE (256)
+
+#define SPI_BURST_BUS_COUNT   (2)
+
+enum spi_burst_state {
+    SPI_BURST_IDLE,     // NSS is high, or framing is disabled
+    SPI_BURST_ADDRESS,  // NSS is low, next byte is the address
+    SPI_BURST_WRITE,    // collecting the data of a write transaction
+    SPI_BURST_SHADOW,   // answering a read transaction from the shadow
+    SPI_BURST_READ,     // returning the data read ahead
+    SPI_BURST_DIRECT    // reading byte by byte until NSS is raised
+};
+
+struct spi_burst {
+    Spi_t* obj;
+    bool enabled;
+    bool selected;
+    SpiBurstReadAheadHandler_t* read_ahead;
+    const SpiBurstShadow_t* shadow;
+    enum spi_burst_state state;
+    uint8_t address;    // register of the next data byte
+    uint16_t length;
+    uint16_t position;  // first data byte in buffer
+    uint8_t buffer[SPI_BURST_BUFFER_SIZE];
+    SpiBurstStats_t stats;
+};
+
+static struct spi_burst spi_bursts[SPI_BURST_BUS_COUNT];
+
+static inline uint8_t spi_burst_next( uint8_t address )
+{
+    return (address == 0x00) ? 0x00 : ((address + 1) & 0x7f);
+}
+
+static void BOARD_RAM_FUNC(spi_burst_select)( struct spi_burst* burst )
+{
+    if (!burst->selected) {
+        SpiMcuSetNss(burst->obj, 0);
+
+        burst->selected = true;
+        burst->stats.Transactions++;
+    }
+}
+
+static void BOARD_RAM_FUNC(spi_burst_update)( struct spi_burst* burst, const uint8_t* data, uint16_t size )
+{
+    for (uint16_t i = 0; i < size; i++) {
+        if (burst->shadow != NULL && burst->address != 0x00) {
+            burst->shadow->Update(burst->address, data[i]);
+        }
+
+        burst->address = spi_burst_next(burst->address);
+    }
+}
+
+static void BOARD_RAM_FUNC(spi_burst_flush)( struct spi_burst* burst )
+{
+    spi_burst_select(burst);
+    SpiMcuTransfer(burst->obj, burst->buffer, NULL, burst->length);
+    spi_burst_update(burst, burst->buffer + burst->position, burst->length - burst->position);
+
+    burst->length = 0;
+    burst->position = 0;
+}
+
+void SpiBurstInit( Spi_t *obj )
+{
+    struct spi_burst* burst = &spi_bursts[obj->SpiId];
+
+    burst->obj = obj;
+    burst->enabled = true;
+    burst->selected = false;
+    burst->state = SPI_BURST_IDLE;
+}
+
+void SpiBurstWrite( Spi_t *obj, uint8_t addr, const uint8_t *buffer, uint16_t size )
+{
+    struct spi_burst* burst = &spi_bursts[obj->SpiId];
+
+    addr |= 0x80;
+
+    spi_burst_select(burst);
+    SpiMcuTransfer(obj, &addr, NULL, 1);
+    SpiMcuTransfer(obj, buffer, NULL, size);
+    SpiMcuSetNss(obj, 1);
+
+    burst->selected = false;
+    burst->address = addr & 0x7f;
+    spi_burst_update(burst, buffer, size);
+}
+
+void SpiBurstRead( Spi_t *obj, uint8_t addr, uint8_t *buffer, uint16_t size )
+{
+    struct spi_burst* burst = &spi_bursts[obj->SpiId];
+
+    addr &= 0x7f;
+
+    spi_burst_select(burst);
+    SpiMcuTransfer(obj, &addr, NULL, 1);
+    SpiMcuTransfer(obj, NULL, buffer, size);
+    SpiMcuSetNss(obj, 1);
+
+    burst->selected = false;
+    burst->address = addr;
+    spi_burst_update(burst, buffer, size);
+}
+
+void SpiBurstSetEnabled( Spi_t *obj, bool enable )
+{
+    spi_bursts[obj->SpiId].enabled = enable;
+}
+
+void SpiBurstSetReadAhead( Spi_t *obj, SpiBurstReadAheadHandler_t *handler )
+{
+    spi_bursts[obj->SpiId].read_ahead = handler;
+}
+
+void SpiBurstSetShadow( Spi_t *obj, const SpiBurstShadow_t *shadow )
+{
+    spi_bursts[obj->SpiId].shadow = shadow;
+}
+
+void SpiBurstGetStats( Spi_t *obj, SpiBurstStats_t *stats )
+{
+    *stats = spi_bursts[obj->SpiId].stats;
+}
+
+bool BOARD_RAM_FUNC(SpiBurstOnNssWrite)( Gpio_t *obj, uint32_t value )
+{
+    for (int i = 0; i < SPI_BURST_BUS_COUNT; i++) {
+        struct spi_burst* burst = &spi_bursts[i];
+
+        if (burst->obj == NULL || obj != &burst->obj->Nss) {
+            continue;
+        }
+
+        if (!burst->enabled) {
+            // a PIO bus sequences NSS itself, the board decides
+            SpiMcuSetNss(burst->obj, value);
+            return true;
+        }
+
+        if (value == 0) {
+            // NSS is asserted with the first byte that must reach the bus
+            burst->state = SPI_BURST_ADDRESS;
+            return true;
+        }
+
+        if (burst->state == SPI_BURST_WRITE) {
+            spi_burst_flush(burst);
+        }
+
+        if (!burst->selected && burst->state == SPI_BURST_SHADOW) {
+            burst->stats.ShadowTransactions++;
+        }
+
+        // also sets the idle level when the pin is initialized
+        SpiMcuSetNss(burst->obj, 1);
+
+        burst->selected = false;
+        burst->state = SPI_BURST_IDLE;
+
+        return true;
+    }
+
+    return false;
+}
+
+uint16_t BOARD_RAM_FUNC(SpiInOut)( Spi_t *obj, uint16_t outData )
+{
+    struct spi_burst* burst = &spi_bursts[obj->SpiId];
+    uint8_t out = (outData & 0xff);
+    uint8_t in;
+    uint16_t size;
+
+    switch (burst->state) {
+        case SPI_BURST_IDLE:
+            return SpiMcuInOut(obj, out);
+
+        case SPI_BURST_ADDRESS:
+            burst->address = out & 0x7f;
+
+            if (out & 0x80) {
+                // the data of a write transaction is sent when NSS is raised
+                burst->buffer[0] = out;
+                burst->length = 1;
+                burst->position = 1;
+                burst->state = SPI_BURST_WRITE;
+
+                return 0x00;
+            }
+
+            size = (burst->read_ahead != NULL) ? burst->read_ahead(burst->address) : 0;
+
+            if (size == 0) {
+                // the address byte is sent with the first byte not in the shadow
+                burst->state = SPI_BURST_SHADOW;
+
+                return 0x00;
+            }
+
+            if (size > SPI_BURST_BUFFER_SIZE - 1) {
+                size = SPI_BURST_BUFFER_SIZE - 1;
+            }
+
+            burst->buffer[0] = out;
+            memset(burst->buffer + 1, 0x00, size);
+
+            spi_burst_select(burst);
+            SpiMcuTransfer(obj, burst->buffer, burst->buffer, size + 1);
+            spi_burst_update(burst, burst->buffer + 1, size);
+
+            burst->length = size + 1;
+            burst->position = 1;
+            burst->state = SPI_BURST_READ;
+
+            return burst->buffer[0];
+
+        case SPI_BURST_WRITE:
+            if (burst->length == SPI_BURST_BUFFER_SIZE) {
+                // NSS stays low, the device keeps incrementing the address
+                spi_burst_flush(burst);
+            }
+
+            burst->buffer[burst->length++] = out;
+
+            return 0x00;
+
+        case SPI_BURST_SHADOW:
+            if (burst->shadow != NULL && burst->address != 0x00 && burst->shadow->Read(burst->address, &in)) {
+                burst->address = spi_burst_next(burst->address);
+
+                return in;
+            }
+
+            // continue the transaction on the bus from the current register
+            spi_burst_select(burst);
+            SpiMcuInOut(obj, burst->address);
+
+            burst->state = SPI_BURST_DIRECT;
+            break;
+
+        case SPI_BURST_READ:
+            if (burst->position < burst->length) {
+                return burst->buffer[burst->position++];
+            }
+
+            // read past the read ahead, carry on byte by byte
+            burst->state = SPI_BURST_DIRECT;
+            break;
+
+        default:
+            break;
+    }
+
+    in = SpiMcuInOut(obj, out);
+    spi_burst_update(burst, &in, 1);
+
+    return in;
+}
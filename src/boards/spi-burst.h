@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _SPI_BURST_H_
+#define _SPI_BURST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpio.h"
+#include "spi.h"
+
+/*!
+ * Burst transfers on top of the LoRaMac-node spi-board.h API, shared by the
+ * board ports.
+ *
+ * A burst sends an address byte followed by a block of data in a single NSS
+ * transaction. The unmodified sx1276.c driver clocks its FIFO and register
+ * block transfers one SpiInOut( ) call per byte, so the NSS line of the bus
+ * is driven by this layer, which frames those calls:
+ *
+ *  - the data bytes of a write transaction (address bit 7 set) are collected
+ *    and sent as one burst when NSS is raised
+ *  - a read transaction is read ahead in one burst when the read ahead
+ *    handler returns the number of bytes the driver is about to read
+ *  - with a register shadow, NSS is only asserted once a byte can not be
+ *    answered by the shadow, so reads of cached registers do not reach the
+ *    bus at all
+ *
+ * Like on the Semtech radios, the address auto-increments within a
+ * transaction, except for address 0x00 which is the FIFO.
+ */
+
+typedef struct SpiBurstStats_s
+{
+    uint32_t Transactions;          // NSS transactions on the bus
+    uint32_t ShadowTransactions;    // read transactions answered by the shadow
+} SpiBurstStats_t;
+
+/*!
+ * \brief Returns the number of bytes to read ahead for a read transaction
+ *        at addr, 0 to read byte by byte
+ */
+typedef uint16_t ( SpiBurstReadAheadHandler_t )( uint8_t addr );
+
+/*!
+ * Register shadow of the device on the bus
+ */
+typedef struct SpiBurstShadow_s
+{
+    /*!
+     * \brief Reads a register from the shadow
+     *
+     * \retval true if value was set, false if the register must be read
+     *         from the device
+     */
+    bool ( *Read )( uint8_t addr, uint8_t *value );
+
+    /*!
+     * \brief Called with every register value written to or read from
+     *        the device
+     */
+    void ( *Update )( uint8_t addr, uint8_t value );
+} SpiBurstShadow_t;
+
+/*!
+ * \brief Writes size bytes starting at addr in a single transaction
+ *
+ * \param [IN] obj    SPI object
+ * \param [IN] addr   Register address, bit 7 is set by the function
+ * \param [IN] buffer Data to write
+ * \param [IN] size   Number of bytes to write
+ */
+void SpiBurstWrite( Spi_t *obj, uint8_t addr, const uint8_t *buffer, uint16_t size );
+
+/*!
+ * \brief Reads size bytes starting at addr in a single transaction
+ *
+ * \param [IN]  obj    SPI object
+ * \param [IN]  addr   Register address, bit 7 is cleared by the function
+ * \param [OUT] buffer Buffer receiving the data
+ * \param [IN]  size   Number of bytes to read
+ */
+void SpiBurstRead( Spi_t *obj, uint8_t addr, uint8_t *buffer, uint16_t size );
+
+/*!
+ * \brief Enables or disables the framing of SpiInOut( ) calls, when disabled
+ *        every call is a separate single byte transfer. Must not be called
+ *        within a transaction.
+ */
+void SpiBurstSetEnabled( Spi_t *obj, bool enable );
+
+/*!
+ * \brief Sets the read ahead handler of the bus, NULL to remove it
+ */
+void SpiBurstSetReadAhead( Spi_t *obj, SpiBurstReadAheadHandler_t *handler );
+
+/*!
+ * \brief Sets the register shadow of the bus, NULL to remove it
+ */
+void SpiBurstSetShadow( Spi_t *obj, const SpiBurstShadow_t *shadow );
+
+/*!
+ * \brief Gets the transaction counters of the bus since boot
+ */
+void SpiBurstGetStats( Spi_t *obj, SpiBurstStats_t *stats );
+
+/*!
+ * \brief Called by GpioMcuWrite( ) for every pin change
+ *
+ * \param [IN] obj   Pin being written
+ * \param [IN] value Pin level
+ *
+ * \retval true if the pin is the NSS line of a bus, which is then driven
+ *         through SpiMcuSetNss( ), GpioMcuWrite( ) must leave it alone
+ */
+bool SpiBurstOnNssWrite( Gpio_t *obj, uint32_t value );
+
+/*!
+ * Board specific part, implemented by spi-board.c
+ */
+
+/*!
+ * \brief Registers the bus, called by SpiInit( )
+ */
+void SpiBurstInit( Spi_t *obj );
+
+/*!
+ * \brief Full duplex transfer of size bytes, tx NULL sends zeros and rx NULL
+ *        discards the data received. tx and rx may be the same buffer.
+ */
+void SpiMcuTransfer( Spi_t *obj, const uint8_t *tx, uint8_t *rx, uint16_t size );
+
+/*!
+ * \brief Single byte transfer, as done by SpiInOut( ) without framing
+ */
+uint8_t SpiMcuInOut( Spi_t *obj, uint8_t outData );
+
+/*!
+ * \brief Drives the NSS line of the bus
+ */
+void SpiMcuSetNss( Spi_t *obj, uint32_t value );
+
+#endif
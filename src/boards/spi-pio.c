@@ -0,0 +1,257 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/gpio.h"
+#include "hardware/pio.h"
+
+#include "board-irq.h"
+#include "spi-burst.h"
+#include "spi-pio.h"
+#include "sx1276-spi.pio.h"
+
+// fastest SCK of the SX1276
+#define SPI_PIO_BAUDRATE        (10 * 1000 * 1000)
+#define SPI_PIO_CYCLES_PER_BIT  (4)
+
+// shorter transfers are fed by the CPU, setting up DMA costs more
+#define SPI_PIO_DMA_THRESHOLD   (16)
+
+// bytes the CPU keeps in flight, without filling the RX FIFO
+#define SPI_PIO_FIFO_DEPTH      (4)
+
+#define SPI_PIO_RELEASE         (0x01)
+
+#define SPI_PIO_BUS_COUNT       (2)
+
+// data of one stream, a full SPI burst layer buffer, and its headers
+#define SPI_PIO_STREAM_DATA     (256)
+#define SPI_PIO_STREAM_SIZE     (SPI_PIO_STREAM_DATA + (SPI_PIO_STREAM_DATA + SPI_PIO_SEGMENT_SIZE - 1) / SPI_PIO_SEGMENT_SIZE)
+
+struct spi_pio_bus {
+    Spi_t* obj;
+    PIO pio;
+    uint sm;
+    uint nss;
+    bool asserted;  // a segment was sent since NSS was last released
+    bool pending;   // a stream without data to receive is still running
+};
+
+// one bus per PIO block, indexed by the SpiId of the bus
+static struct spi_pio_bus spi_pio_buses[SPI_PIO_BUS_COUNT];
+
+static int spi_pio_dma_tx = -1;
+static int spi_pio_dma_rx = -1;
+
+static uint8_t spi_pio_stream[SPI_PIO_STREAM_SIZE];
+static uint8_t spi_pio_discard;
+
+static inline uint8_t spi_pio_header( uint16_t size, bool release )
+{
+    return (uint8_t)((size << 1) | (release ? SPI_PIO_RELEASE : 0));
+}
+
+static void BOARD_RAM_FUNC(spi_pio_wait)( struct spi_pio_bus* bus )
+{
+    if (bus->pending) {
+        dma_channel_wait_for_finish_blocking(spi_pio_dma_rx);
+
+        bus->pending = false;
+    }
+}
+
+static void BOARD_RAM_FUNC(spi_pio_claim_nss)( struct spi_pio_bus* bus )
+{
+    enum gpio_function function = (pio_get_index(bus->pio) == 0) ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1;
+
+    // GpioMcuInit( ) hands the pin back to SIO when the driver sets it up
+    if (gpio_get_function(bus->nss) != function) {
+        pio_gpio_init(bus->pio, bus->nss);
+    }
+}
+
+static void BOARD_RAM_FUNC(spi_pio_transfer_cpu)( struct spi_pio_bus* bus, const uint8_t* tx, uint8_t* rx, uint16_t size )
+{
+    uint16_t sent = 0;
+    uint16_t received = 0;
+    uint16_t segment = 0;
+
+    while (received < size) {
+        if (sent < size && (sent - received) < SPI_PIO_FIFO_DEPTH && !pio_sm_is_tx_fifo_full(bus->pio, bus->sm)) {
+            if (segment == 0) {
+                segment = (size - sent > SPI_PIO_SEGMENT_SIZE) ? SPI_PIO_SEGMENT_SIZE : (size - sent);
+
+                pio_sm_put(bus->pio, bus->sm, (uint32_t)spi_pio_header(segment, false) << 24);
+                continue;
+            }
+
+            // the program shifts out of the top byte, MSB first
+            pio_sm_put(bus->pio, bus->sm, (uint32_t)((tx != NULL) ? tx[sent] : 0x00) << 24);
+            sent++;
+            segment--;
+        }
+
+        if (!pio_sm_is_rx_fifo_empty(bus->pio, bus->sm)) {
+            uint8_t in = (uint8_t)pio_sm_get(bus->pio, bus->sm);
+
+            if (rx != NULL) {
+                rx[received] = in;
+            }
+            received++;
+        }
+    }
+}
+
+static void BOARD_RAM_FUNC(spi_pio_transfer_dma)( struct spi_pio_bus* bus, const uint8_t* tx, uint8_t* rx, uint16_t size )
+{
+    dma_channel_config config;
+    uint16_t length = 0;
+
+    for (uint16_t i = 0; i < size; i++) {
+        if ((i % SPI_PIO_SEGMENT_SIZE) == 0) {
+            uint16_t segment = (size - i > SPI_PIO_SEGMENT_SIZE) ? SPI_PIO_SEGMENT_SIZE : (size - i);
+
+            spi_pio_stream[length++] = spi_pio_header(segment, false);
+        }
+
+        spi_pio_stream[length++] = (tx != NULL) ? tx[i] : 0x00;
+    }
+
+    // byte writes are replicated over the FIFO word, so the program sees the
+    // byte in the top bits it shifts out first
+    config = dma_channel_get_default_config(spi_pio_dma_tx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, pio_get_dreq(bus->pio, bus->sm, true));
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    dma_channel_configure(spi_pio_dma_tx, &config, &bus->pio->txf[bus->sm], spi_pio_stream, length, false);
+
+    config = dma_channel_get_default_config(spi_pio_dma_rx);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_dreq(&config, pio_get_dreq(bus->pio, bus->sm, false));
+    channel_config_set_read_increment(&config, false);
+    channel_config_set_write_increment(&config, rx != NULL);
+    dma_channel_configure(spi_pio_dma_rx, &config, (rx != NULL) ? rx : &spi_pio_discard, &bus->pio->rxf[bus->sm], size, false);
+
+    dma_start_channel_mask((1u << spi_pio_dma_tx) | (1u << spi_pio_dma_rx));
+
+    // tx was copied to the stream, writes carry on while the CPU returns
+    bus->pending = true;
+
+    if (rx != NULL) {
+        spi_pio_wait(bus);
+    }
+}
+
+bool SpiPioInit( Spi_t *obj, PIO pio, PinNames mosi, PinNames miso, PinNames sclk, PinNames nss )
+{
+    struct spi_pio_bus* bus = &spi_pio_buses[pio_get_index(pio)];
+    float clkdiv = (float)clock_get_hz(clk_sys) / (SPI_PIO_BAUDRATE * SPI_PIO_CYCLES_PER_BIT);
+    uint offset;
+    int sm;
+
+    if (!pio_can_add_program(pio, &sx1276_spi_program)) {
+        return false;
+    }
+
+    sm = pio_claim_unused_sm(pio, false);
+
+    if (sm < 0) {
+        return false;
+    }
+
+    offset = pio_add_program(pio, &sx1276_spi_program);
+
+    sx1276_spi_program_init(pio, sm, offset, (clkdiv < 1.0f) ? 1.0f : clkdiv, sclk, mosi, miso, nss);
+
+    bus->obj = obj;
+    bus->pio = pio;
+    bus->sm = sm;
+    bus->nss = nss;
+    bus->asserted = false;
+    bus->pending = false;
+
+    obj->SpiId = (SpiId_t)pio_get_index(pio);
+    obj->Mosi.pin = mosi;
+    obj->Miso.pin = miso;
+    obj->Sclk.pin = sclk;
+    obj->Nss.pin = nss;
+
+    // streams fall back to the CPU when no DMA channels are free
+    if (spi_pio_dma_rx < 0) {
+        spi_pio_dma_tx = dma_claim_unused_channel(false);
+        spi_pio_dma_rx = (spi_pio_dma_tx < 0) ? -1 : dma_claim_unused_channel(false);
+    }
+
+    SpiBurstInit(obj);
+
+    return true;
+}
+
+bool BOARD_RAM_FUNC(SpiPioIsActive)( Spi_t *obj )
+{
+    return spi_pio_buses[obj->SpiId].obj == obj;
+}
+
+void BOARD_RAM_FUNC(SpiPioTransfer)( Spi_t *obj, const uint8_t *tx, uint8_t *rx, uint16_t size )
+{
+    struct spi_pio_bus* bus = &spi_pio_buses[obj->SpiId];
+
+    while (size > 0) {
+        uint16_t chunk = (size > SPI_PIO_STREAM_DATA) ? SPI_PIO_STREAM_DATA : size;
+
+        spi_pio_wait(bus);
+
+        if (chunk >= SPI_PIO_DMA_THRESHOLD && spi_pio_dma_rx >= 0) {
+            spi_pio_transfer_dma(bus, tx, rx, chunk);
+        } else {
+            spi_pio_transfer_cpu(bus, tx, rx, chunk);
+        }
+
+        tx = (tx != NULL) ? tx + chunk : NULL;
+        rx = (rx != NULL) ? rx + chunk : NULL;
+        size -= chunk;
+
+        bus->asserted = true;
+    }
+}
+
+uint8_t BOARD_RAM_FUNC(SpiPioInOut)( Spi_t *obj, uint8_t outData )
+{
+    struct spi_pio_bus* bus = &spi_pio_buses[obj->SpiId];
+    uint8_t inData;
+
+    spi_pio_wait(bus);
+    spi_pio_transfer_cpu(bus, &outData, &inData, 1);
+
+    bus->asserted = true;
+
+    return inData;
+}
+
+void BOARD_RAM_FUNC(SpiPioSetNss)( Spi_t *obj, uint32_t value )
+{
+    struct spi_pio_bus* bus = &spi_pio_buses[obj->SpiId];
+
+    spi_pio_claim_nss(bus);
+
+    if (value == 0 || !bus->asserted) {
+        return;
+    }
+
+    // the header must follow the last byte of a stream still being sent
+    if (bus->pending) {
+        dma_channel_wait_for_finish_blocking(spi_pio_dma_tx);
+    }
+
+    pio_sm_put_blocking(bus->pio, bus->sm, (uint32_t)spi_pio_header(0, true) << 24);
+
+    bus->asserted = false;
+}
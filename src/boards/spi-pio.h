@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _SPI_PIO_H_
+#define _SPI_PIO_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/pio.h"
+
+#include "spi.h"
+
+/*!
+ * SX1276 bus on a PIO state machine instead of an SPI peripheral, shared by
+ * the board ports.
+ *
+ * The sx1276_spi program sequences NSS itself. Its TX FIFO is fed a stream
+ * of segments, each a header byte followed by up to SPI_PIO_SEGMENT_SIZE
+ * bytes to send: bits 7:1 of the header are the number of bytes and bit 0
+ * releases NSS once they are sent. A burst of the SPI burst layer, address
+ * and data, is encoded into one stream and handed to a single DMA transfer,
+ * so the CPU is not involved until the data received is complete.
+ *
+ * The board SpiMcu* functions of spi-burst.h call the functions below for a
+ * bus initialized with SpiPioInit( ).
+ */
+
+#define SPI_PIO_SEGMENT_SIZE    (127)
+
+/*!
+ * \brief Initializes the bus on a free state machine of pio, the bus then
+ *        replaces SpiInit( ) for obj
+ *
+ * \retval true on success, false if pio has no room for the program or no
+ *         free state machine
+ */
+bool SpiPioInit( Spi_t *obj, PIO pio, PinNames mosi, PinNames miso, PinNames sclk, PinNames nss );
+
+/*!
+ * \brief Checks whether obj was initialized with SpiPioInit( )
+ */
+bool SpiPioIsActive( Spi_t *obj );
+
+/*!
+ * \brief Same as SpiMcuTransfer( ), a transfer without data to receive
+ *        returns while the state machine is still sending it
+ */
+void SpiPioTransfer( Spi_t *obj, const uint8_t *tx, uint8_t *rx, uint16_t size );
+
+/*!
+ * \brief Same as SpiMcuInOut( )
+ */
+uint8_t SpiPioInOut( Spi_t *obj, uint8_t outData );
+
+/*!
+ * \brief Same as SpiMcuSetNss( ), NSS is asserted with the first segment
+ *        sent and released by a header queued behind the last one
+ */
+void SpiPioSetNss( Spi_t *obj, uint32_t value );
+
+#endif
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "board-irq.h"
+#include "spi-burst.h"
+#include "sx1276-spi.h"
+
+#include "sx1276/sx1276.h"
+
+#define SX1276_SPI_REG_COUNT  (0x80)
+
+// RegOpMode LongRangeMode and AccessSharedReg bits, select the register page
+#define SX1276_SPI_PAGE_MASK  (0xc0)
+#define SX1276_SPI_PAGE_LORA  (0x80)
+
+static uint8_t sx1276_spi_shadow[SX1276_SPI_REG_COUNT];
+static uint32_t sx1276_spi_valid[SX1276_SPI_REG_COUNT / 32];
+
+// register page of 0x0d - 0x3f, FSK after reset
+static uint8_t sx1276_spi_page;
+
+/*
+ * Configuration registers only change when they are written. Status, IRQ,
+ * FIFO pointer and RegOpMode (the radio leaves TX and RX on its own) are
+ * always read from the radio, as is the whole FSK page which the LoRaWAN
+ * stack does not use for long.
+ */
+static bool BOARD_RAM_FUNC(sx1276_spi_is_config)( uint8_t addr )
+{
+    switch (addr) {
+        case REG_FRFMSB:
+        case REG_FRFMID:
+        case REG_FRFLSB:
+        case REG_PACONFIG:
+        case REG_PARAMP:
+        case REG_OCP:
+        case REG_DIOMAPPING1:
+        case REG_DIOMAPPING2:
+        case REG_VERSION:
+        case REG_PADAC:
+            return true;
+
+        case REG_LR_FIFOTXBASEADDR:
+        case REG_LR_FIFORXBASEADDR:
+        case REG_LR_IRQFLAGSMASK:
+        case REG_LR_MODEMCONFIG1:
+        case REG_LR_MODEMCONFIG2:
+        case REG_LR_SYMBTIMEOUTLSB:
+        case REG_LR_PREAMBLEMSB:
+        case REG_LR_PREAMBLELSB:
+        case REG_LR_PAYLOADLENGTH:
+        case REG_LR_PAYLOADMAXLENGTH:
+        case REG_LR_HOPPERIOD:
+        case REG_LR_MODEMCONFIG3:
+        case REG_LR_DETECTOPTIMIZE:
+        case REG_LR_INVERTIQ:
+        case REG_LR_HIGHBWOPTIMIZE1:
+        case REG_LR_DETECTIONTHRESHOLD:
+        case REG_LR_SYNCWORD:
+        case REG_LR_HIGHBWOPTIMIZE2:
+        case REG_LR_INVERTIQ2:
+            return (sx1276_spi_page == SX1276_SPI_PAGE_LORA);
+
+        default:
+            return false;
+    }
+}
+
+static inline bool sx1276_spi_is_valid( uint8_t addr )
+{
+    return (sx1276_spi_valid[addr / 32] & (1u << (addr % 32))) != 0;
+}
+
+static bool BOARD_RAM_FUNC(sx1276_spi_shadow_read)( uint8_t addr, uint8_t *value )
+{
+    if (!sx1276_spi_is_config(addr) || !sx1276_spi_is_valid(addr)) {
+        return false;
+    }
+
+    *value = sx1276_spi_shadow[addr];
+
+    return true;
+}
+
+static void BOARD_RAM_FUNC(sx1276_spi_shadow_update)( uint8_t addr, uint8_t value )
+{
+    if (addr == REG_OPMODE && (value & SX1276_SPI_PAGE_MASK) != sx1276_spi_page) {
+        // the paged registers of the other modem are not tracked
+        for (uint8_t page_addr = REG_LR_FIFOADDRPTR; page_addr < REG_DIOMAPPING1; page_addr++) {
+            sx1276_spi_valid[page_addr / 32] &= ~(1u << (page_addr % 32));
+        }
+
+        sx1276_spi_page = value & SX1276_SPI_PAGE_MASK;
+    }
+
+    if (!sx1276_spi_is_config(addr)) {
+        return;
+    }
+
+    sx1276_spi_shadow[addr] = value;
+    sx1276_spi_valid[addr / 32] |= (1u << (addr % 32));
+}
+
+static const SpiBurstShadow_t sx1276_spi_shadow_handlers = {
+    .Read = sx1276_spi_shadow_read,
+    .Update = sx1276_spi_shadow_update
+};
+
+/*
+ * In LoRa mode the driver reads a received frame from the FIFO right after
+ * storing its size, so the whole frame is read ahead in one burst. Reading
+ * past the end only moves the FIFO pointer, which the driver sets before
+ * every access. FSK FIFO reads pop data and are left byte by byte.
+ */
+static uint16_t BOARD_RAM_FUNC(sx1276_spi_read_ahead)( uint8_t addr )
+{
+    if (addr == REG_LR_FIFO && SX1276.Settings.Modem == MODEM_LORA) {
+        return SX1276.Settings.LoRaPacketHandler.Size;
+    }
+
+    return 0;
+}
+
+void SX1276SpiInit( Spi_t *obj )
+{
+    SX1276SpiInvalidate();
+
+    SpiBurstSetReadAhead(obj, sx1276_spi_read_ahead);
+    SpiBurstSetShadow(obj, &sx1276_spi_shadow_handlers);
+}
+
+void SX1276SpiInvalidate( void )
+{
+    memset(sx1276_spi_valid, 0x00, sizeof(sx1276_spi_valid));
+
+    sx1276_spi_page = 0x00;
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _SX1276_SPI_H_
+#define _SX1276_SPI_H_
+
+#include "spi.h"
+
+/*!
+ * SX1276 specific handlers of the SPI burst layer, shared by the board
+ * ports: the read ahead of received LoRa frames and a write-through shadow
+ * of the configuration registers.
+ */
+
+/*!
+ * \brief Sets the SX1276 handlers on the bus of the radio
+ */
+void SX1276SpiInit( Spi_t *obj );
+
+/*!
+ * \brief Drops the register shadow, to be called when the radio is reset
+ */
+void SX1276SpiInvalidate( void );
+
+#endif
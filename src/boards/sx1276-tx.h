@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _SX1276_TX_H_
+#define _SX1276_TX_H_
+
+#include <stdint.h>
+
+/*!
+ * \brief Gets the time the driver last switched the radio to transmit, in us
+ *        since boot, 0 if it never did
+ */
+uint64_t SX1276BoardGetTxStartTime( void );
+
+/*!
+ * \brief Gets the number of times the driver switched the radio to transmit
+ *        since boot
+ */
+uint32_t SX1276BoardGetTxCount( void );
+
+/*!
+ * \brief Gets the time the radio spent transmitting since boot, in us, from
+ *        the switch to transmit to the DIO0 TX done interrupt
+ */
+uint64_t SX1276BoardGetTxOnAirTime( void );
+
+/*!
+ * \brief Gets the time of the last DIO0 TX done interrupt, in us since boot,
+ *        0 if there was none
+ */
+uint64_t SX1276BoardGetTxDoneTime( void );
+
+/*!
+ * Single receive window opened by the driver
+ */
+typedef struct SX1276BoardRxWindow_s
+{
+    uint64_t OpenTime;      // switch to receive, in us since boot
+    uint64_t DoneTime;      // DIO0 RX done interrupt, 0 if the window timed out
+    uint32_t SymbolTime;    // LoRa symbol time in us, 0 for FSK
+} SX1276BoardRxWindow_t;
+
+#define SX1276_BOARD_RX_WINDOWS     2
+
+/*!
+ * \brief Gets the single receive windows opened since the last switch to
+ *        transmit, the first SX1276_BOARD_RX_WINDOWS of them
+ *
+ * \retval Number of windows copied to windows
+ */
+uint8_t SX1276BoardGetRxWindows( SX1276BoardRxWindow_t* windows );
+
+#endif
@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+/*
+ * Table driven replacement for the byte oriented AES of LoRaMac-node
+ * (peripherals/soft-se/aes.c), implementing the encryption half of its
+ * aes.h API, which is all cmac.c and soft-se.c use.
+ *
+ * A round is 16 lookups in a single 1 KB table of combined SubBytes and
+ * MixColumns columns, rotated into place, instead of per byte GF(2^8)
+ * arithmetic. The tables are built in RAM on first use, so the lookups
+ * never go through the XIP cache on the RP2040.
+ *
+ * soft-se.c calls aes_set_key( ) before every block operation, so expanded
+ * key schedules are kept in a small cache indexed by the key itself. A key
+ * changed with SecureElementSetKey( ) no longer matches its old entry, which
+ * ages out, and a context only holds its key and a hint to its cache entry.
+ *
+ * Blocks encrypted ahead of time with aes_precompute( ) are looked up by key
+ * entry and input before running the cipher.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pico.h"
+
+#include "aes.h"
+#include "aes-ttable.h"
+
+#define AES_KEY_CACHE_SIZE      (4)
+
+#define AES_MAX_KEY_SIZE        (32)
+#define AES_MAX_SCHEDULE_WORDS  (4 * (N_MAX_ROUNDS + 1))
+
+// layout of aes_context.ksch, which is not word aligned
+#define AES_CONTEXT_KEY         (0)
+#define AES_CONTEXT_KEY_SIZE    (AES_CONTEXT_KEY + AES_MAX_KEY_SIZE)
+#define AES_CONTEXT_SLOT        (AES_CONTEXT_KEY_SIZE + 1)
+#define AES_CONTEXT_GENERATION  (AES_CONTEXT_SLOT + 1)
+
+struct aes_key_entry {
+    uint32_t generation;    // 0 for a free entry
+    uint32_t last_used;
+    uint8_t key_size;
+    uint8_t rounds;
+    uint8_t key[AES_MAX_KEY_SIZE];
+    uint32_t schedule[AES_MAX_SCHEDULE_WORDS];
+};
+
+struct aes_precomputed_block {
+    uint32_t generation;    // of the key entry, 0 for a free block
+    uint8_t slot;
+    uint32_t in[4];
+    uint32_t out[4];
+};
+
+// S-box and its column through MixColumns, { 2s, s, s, 3s } from LSB to MSB
+static uint8_t aes_sbox[256];
+static uint32_t aes_table[256];
+static bool aes_tables_ready = false;
+
+static struct aes_key_entry aes_key_cache[AES_KEY_CACHE_SIZE];
+static uint32_t aes_key_generation = 0;
+static uint32_t aes_key_clock = 0;
+
+static struct aes_precomputed_block aes_precomputed[AES_PRECOMPUTE_SIZE];
+static uint8_t aes_precomputed_count = 0;
+static uint8_t aes_precompute_next = 0;
+static struct aes_precompute_stats aes_precompute_stats;
+
+static inline uint8_t aes_xtime( uint8_t x )
+{
+    return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+static inline uint8_t aes_rotl8( uint8_t x, int n )
+{
+    return (uint8_t)((x << n) | (x >> (8 - n)));
+}
+
+static inline uint32_t aes_rotl32( uint32_t x, int n )
+{
+    return (x << n) | (x >> (32 - n));
+}
+
+static inline uint32_t aes_load32( const uint8_t* p )
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void aes_store32( uint8_t* p, uint32_t x )
+{
+    p[0] = (uint8_t)x;
+    p[1] = (uint8_t)(x >> 8);
+    p[2] = (uint8_t)(x >> 16);
+    p[3] = (uint8_t)(x >> 24);
+}
+
+static void aes_tables_init( void )
+{
+    uint8_t p = 1;
+    uint8_t q = 1;
+
+    // walk the multiplicative group with generator 3, q = 1 / p
+    do {
+        p = p ^ aes_xtime(p);
+
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+
+        aes_sbox[p] = q ^ aes_rotl8(q, 1) ^ aes_rotl8(q, 2) ^ aes_rotl8(q, 3) ^ aes_rotl8(q, 4) ^ 0x63;
+    } while (p != 1);
+
+    aes_sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = aes_sbox[i];
+        uint8_t s2 = aes_xtime(s);
+
+        aes_table[i] = (uint32_t)s2 | ((uint32_t)s << 8) | ((uint32_t)s << 16) | ((uint32_t)(s2 ^ s) << 24);
+    }
+
+    aes_tables_ready = true;
+}
+
+static inline uint32_t aes_sub_word( uint32_t x )
+{
+    return (uint32_t)aes_sbox[x & 0xff] |
+           ((uint32_t)aes_sbox[(x >> 8) & 0xff] << 8) |
+           ((uint32_t)aes_sbox[(x >> 16) & 0xff] << 16) |
+           ((uint32_t)aes_sbox[x >> 24] << 24);
+}
+
+static void aes_expand_key( struct aes_key_entry* entry )
+{
+    uint32_t* w = entry->schedule;
+    int nk = entry->key_size / 4;
+    int words = 4 * (entry->rounds + 1);
+    uint8_t rcon = 0x01;
+
+    for (int i = 0; i < nk; i++) {
+        w[i] = aes_load32(&entry->key[4 * i]);
+    }
+
+    // words hold rows 0 to 3 from LSB to MSB, RotWord is a rotate right
+    for (int i = nk; i < words; i++) {
+        uint32_t t = w[i - 1];
+
+        if ((i % nk) == 0) {
+            t = aes_sub_word(aes_rotl32(t, 24)) ^ rcon;
+            rcon = aes_xtime(rcon);
+        } else if (nk > 6 && (i % nk) == 4) {
+            t = aes_sub_word(t);
+        }
+
+        w[i] = w[i - nk] ^ t;
+    }
+}
+
+static bool aes_key_equal( const uint8_t* a, const uint8_t* b, uint8_t size )
+{
+    uint8_t diff = 0;
+
+    for (int i = 0; i < size; i++) {
+        diff |= a[i] ^ b[i];
+    }
+
+    return diff == 0;
+}
+
+static struct aes_key_entry* aes_key_lookup( const uint8_t* key, uint8_t key_size )
+{
+    struct aes_key_entry* victim = &aes_key_cache[0];
+
+    aes_key_clock++;
+
+    for (int i = 0; i < AES_KEY_CACHE_SIZE; i++) {
+        struct aes_key_entry* entry = &aes_key_cache[i];
+
+        if (entry->generation != 0 && entry->key_size == key_size && aes_key_equal(entry->key, key, key_size)) {
+            entry->last_used = aes_key_clock;
+
+            return entry;
+        }
+
+        if (entry->generation == 0 || (victim->generation != 0 && entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    // a new generation tells contexts pointing at the entry it was replaced
+    if (++aes_key_generation == 0) {
+        aes_key_generation = 1;
+    }
+
+    victim->generation = aes_key_generation;
+    victim->last_used = aes_key_clock;
+    victim->key_size = key_size;
+    victim->rounds = (key_size / 4) + 6;
+    memcpy(victim->key, key, key_size);
+
+    aes_expand_key(victim);
+
+    return victim;
+}
+
+static inline const uint32_t* aes_context_schedule( const aes_context* ctx )
+{
+    const uint8_t* k = ctx->ksch;
+    struct aes_key_entry* entry = &aes_key_cache[k[AES_CONTEXT_SLOT]];
+
+    if (entry->generation != aes_load32(&k[AES_CONTEXT_GENERATION])) {
+        // evicted by other keys since aes_set_key( ), expand it again
+        entry = aes_key_lookup(&k[AES_CONTEXT_KEY], k[AES_CONTEXT_KEY_SIZE]);
+    }
+
+    return entry->schedule;
+}
+
+return_type aes_set_key( const uint8_t key[], length_type keylen, aes_context ctx[1] )
+{
+    struct aes_key_entry* entry;
+
+    if (keylen != 16 && keylen != 24 && keylen != 32) {
+        ctx->rnd = 0;
+
+        return (uint8_t)-1;
+    }
+
+    if (!aes_tables_ready) {
+        aes_tables_init();
+    }
+
+    entry = aes_key_lookup(key, keylen);
+
+    memcpy(&ctx->ksch[AES_CONTEXT_KEY], key, keylen);
+    ctx->ksch[AES_CONTEXT_KEY_SIZE] = keylen;
+    ctx->ksch[AES_CONTEXT_SLOT] = (uint8_t)(entry - aes_key_cache);
+    aes_store32(&ctx->ksch[AES_CONTEXT_GENERATION], entry->generation);
+    ctx->rnd = entry->rounds;
+
+    return 0;
+}
+
+#define AES_ROUND(t, s, rk) \
+    do { \
+        t[0] = aes_table[s[0] & 0xff] ^ aes_rotl32(aes_table[(s[1] >> 8) & 0xff], 8) ^ \
+               aes_rotl32(aes_table[(s[2] >> 16) & 0xff], 16) ^ aes_rotl32(aes_table[s[3] >> 24], 24) ^ rk[0]; \
+        t[1] = aes_table[s[1] & 0xff] ^ aes_rotl32(aes_table[(s[2] >> 8) & 0xff], 8) ^ \
+               aes_rotl32(aes_table[(s[3] >> 16) & 0xff], 16) ^ aes_rotl32(aes_table[s[0] >> 24], 24) ^ rk[1]; \
+        t[2] = aes_table[s[2] & 0xff] ^ aes_rotl32(aes_table[(s[3] >> 8) & 0xff], 8) ^ \
+               aes_rotl32(aes_table[(s[0] >> 16) & 0xff], 16) ^ aes_rotl32(aes_table[s[1] >> 24], 24) ^ rk[2]; \
+        t[3] = aes_table[s[3] & 0xff] ^ aes_rotl32(aes_table[(s[0] >> 8) & 0xff], 8) ^ \
+               aes_rotl32(aes_table[(s[1] >> 16) & 0xff], 16) ^ aes_rotl32(aes_table[s[2] >> 24], 24) ^ rk[3]; \
+    } while (0)
+
+#define AES_FINAL(s, c, rk) \
+    ((uint32_t)aes_sbox[s[c] & 0xff] ^ \
+     ((uint32_t)aes_sbox[(s[(c + 1) & 3] >> 8) & 0xff] << 8) ^ \
+     ((uint32_t)aes_sbox[(s[(c + 2) & 3] >> 16) & 0xff] << 16) ^ \
+     ((uint32_t)aes_sbox[s[(c + 3) & 3] >> 24] << 24) ^ rk[c])
+
+static void __not_in_flash_func(aes_cipher)( const uint32_t* rk, int rounds, const uint32_t in[4], uint32_t out[4] )
+{
+    uint32_t s[4];
+    uint32_t t[4];
+    int round;
+
+    for (int c = 0; c < 4; c++) {
+        s[c] = in[c] ^ rk[c];
+    }
+
+    // two rounds per iteration, swapping the state between s and t
+    for (round = 1; round < rounds - 1; round += 2) {
+        AES_ROUND(t, s, (rk + 4 * round));
+        AES_ROUND(s, t, (rk + 4 * (round + 1)));
+    }
+
+    AES_ROUND(t, s, (rk + 4 * round));
+    rk += 4 * rounds;
+
+    for (int c = 0; c < 4; c++) {
+        out[c] = AES_FINAL(t, c, rk);
+    }
+}
+
+static bool __not_in_flash_func(aes_precompute_take)( const aes_context* ctx, const uint32_t in[4], uint32_t out[4] )
+{
+    uint8_t slot = ctx->ksch[AES_CONTEXT_SLOT];
+    uint32_t generation = aes_load32(&ctx->ksch[AES_CONTEXT_GENERATION]);
+
+    for (int i = 0; i < AES_PRECOMPUTE_SIZE; i++) {
+        struct aes_precomputed_block* block = &aes_precomputed[i];
+
+        if (block->generation != generation || block->slot != slot ||
+            block->in[0] != in[0] || block->in[1] != in[1] || block->in[2] != in[2] || block->in[3] != in[3]) {
+            continue;
+        }
+
+        memcpy(out, block->out, sizeof(block->out));
+
+        block->generation = 0;
+        aes_precomputed_count--;
+        aes_precompute_stats.hits++;
+
+        return true;
+    }
+
+    return false;
+}
+
+return_type __not_in_flash_func(aes_encrypt)( const uint8_t in[N_BLOCK], uint8_t out[N_BLOCK], const aes_context ctx[1] )
+{
+    uint32_t s[4];
+    uint32_t t[4];
+
+    if (ctx->rnd == 0) {
+        return (uint8_t)-1;
+    }
+
+    for (int c = 0; c < 4; c++) {
+        s[c] = aes_load32(&in[4 * c]);
+    }
+
+    if (aes_precomputed_count == 0 || !aes_precompute_take(ctx, s, t)) {
+        aes_cipher(aes_context_schedule(ctx), ctx->rnd, s, t);
+    }
+
+    for (int c = 0; c < 4; c++) {
+        aes_store32(&out[4 * c], t[c]);
+    }
+
+    return 0;
+}
+
+void aes_precompute( const uint8_t key[16], const uint8_t block[16] )
+{
+    struct aes_precomputed_block* precomputed = &aes_precomputed[aes_precompute_next];
+    aes_context ctx;
+
+    aes_set_key(key, 16, &ctx);
+
+    if (precomputed->generation == 0) {
+        aes_precomputed_count++;
+    }
+
+    for (int c = 0; c < 4; c++) {
+        precomputed->in[c] = aes_load32(&block[4 * c]);
+    }
+
+    aes_cipher(aes_context_schedule(&ctx), ctx.rnd, precomputed->in, precomputed->out);
+
+    precomputed->slot = ctx.ksch[AES_CONTEXT_SLOT];
+    precomputed->generation = aes_load32(&ctx.ksch[AES_CONTEXT_GENERATION]);
+
+    aes_precompute_next = (aes_precompute_next + 1) % AES_PRECOMPUTE_SIZE;
+    aes_precompute_stats.blocks++;
+}
+
+void aes_precompute_clear( void )
+{
+    memset(aes_precomputed, 0x00, sizeof(aes_precomputed));
+
+    aes_precomputed_count = 0;
+    aes_precompute_next = 0;
+}
+
+void aes_precompute_get_stats( struct aes_precompute_stats* stats )
+{
+    *stats = aes_precompute_stats;
+}
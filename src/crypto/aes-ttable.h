@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _AES_TTABLE_H_
+#define _AES_TTABLE_H_
+
+#include <stdint.h>
+
+/*
+ * Extensions of the table driven AES, on top of the aes.h API.
+ *
+ * Blocks that are known to be encrypted soon, such as the keystream and MIC
+ * blocks of the next uplink, can be encrypted ahead of time while the CPU is
+ * idle. aes_encrypt() with the same key and input then copies the result
+ * instead of running the cipher. A precomputed block is used once.
+ */
+
+#define AES_PRECOMPUTE_SIZE     (12)
+
+struct aes_precompute_stats {
+    uint32_t blocks;    // blocks encrypted ahead of time
+    uint32_t hits;      // aes_encrypt() calls served by a precomputed block
+};
+
+/*!
+ * \brief Encrypts block with the 128 bit key ahead of time, replacing the
+ *        oldest precomputed block when all AES_PRECOMPUTE_SIZE are in use
+ */
+void aes_precompute( const uint8_t key[16], const uint8_t block[16] );
+
+/*!
+ * \brief Drops all precomputed blocks
+ */
+void aes_precompute_clear( void );
+
+void aes_precompute_get_stats( struct aes_precompute_stats* stats );
+
+#endif
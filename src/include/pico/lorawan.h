@@ -13,6 +13,7 @@ extern "C" {
 #endif
 
 #include "hardware/gpio.h"
+#include "hardware/pio.h"
 #include "hardware/spi.h"
 
 #include "LoRaMac.h"
@@ -24,6 +25,7 @@ struct lorawan_sx1276_settings {
         uint miso;
         uint sck;
         uint nss;
+        PIO pio;    // run the bus on a state machine of this PIO block instead of inst, NULL for inst
     } spi;
     uint reset;
     uint dio0;
@@ -44,8 +46,140 @@ struct lorawan_otaa_settings {
     const char* channel_mask;
 };
 
+enum lorawan_nvm_flush_policy {
+    LORAWAN_NVM_FLUSH_IMMEDIATE,    // write every change to flash right away
+    LORAWAN_NVM_FLUSH_ON_IDLE,      // coalesce changes until lorawan_process() goes idle
+    LORAWAN_NVM_FLUSH_EVERY_N,      // write after every N changes
+    LORAWAN_NVM_FLUSH_MANUAL        // only write on lorawan_nvm_sync()
+};
+
+struct lorawan_nvm_stats {
+    uint32_t flushes;
+    uint32_t skipped_flushes;
+    uint32_t erases;
+    uint32_t skipped_erases;
+    uint32_t pages_programmed;
+    uint32_t max_sector_erases;
+    uint32_t max_flush_time_us;
+    uint64_t total_flush_time_us;
+    uint32_t max_irq_latency_us;
+    uint32_t dropped_irqs;          // radio and timer interrupts lost during flash operations, see PICO_LORAWAN_RAM_IRQ
+    uint32_t ram_bytes;             // of the NVM image held in RAM now, see PICO_LORAWAN_NVM_LEAN
+    uint32_t max_ram_bytes;
+    uint32_t bytes_written;         // handed to the NVM backend by the stack
+};
+
+struct lorawan_nvm_backend {
+    int (*init)(void* context);                                                     // -1 on failure
+    int (*read)(void* context, uint16_t address, void* data, uint16_t size);        // addresses below 4096
+    int (*write)(void* context, uint16_t address, const void* data, uint16_t size);
+    int (*flush)(void* context);        // 0 once the writes are persistent, 1 if there were none, -1 on failure
+    bool (*process)(void* context);     // background work while idle, true if it did any, may be NULL
+    uint32_t (*size)(void* context);    // bytes it holds, may be NULL for 4096
+};
+
+enum lorawan_event {
+    LORAWAN_EVENT_JOINED        = (1 << 0),     // join accepted, or ABP session started
+    LORAWAN_EVENT_TX_DONE       = (1 << 1),     // the MAC completed an uplink, after its RX windows
+    LORAWAN_EVENT_RX            = (1 << 2),     // a downlink is ready for lorawan_receive()
+    LORAWAN_EVENT_CLASS_CHANGED = (1 << 3),
+    LORAWAN_EVENT_BEACON        = (1 << 4),     // class B beacon received, lost or not found
+    LORAWAN_EVENT_TIME_SYNC     = (1 << 5),     // device time updated by the network
+    LORAWAN_EVENT_NVM_WRITTEN   = (1 << 6)      // NVM changes are in flash
+};
+
+#define LORAWAN_EVENT_ALL   (0x7f)
+
+enum lorawan_uplink_priority {
+    LORAWAN_UPLINK_PRIORITY_TELEMETRY,  // sent in order, dropped first when the queue is full
+    LORAWAN_UPLINK_PRIORITY_ALARM       // sent before any telemetry
+};
+
+struct lorawan_uplink_queue_stats {
+    uint32_t queued;            // uplinks accepted into the queue
+    uint32_t sent;              // uplinks handed to the MAC
+    uint32_t dropped_full;      // rejected or evicted because the queue was full
+    uint32_t dropped_expired;   // deadline passed before the MAC was free
+    uint32_t dropped_rejected;  // too long for the datarate when its turn came, or refused by the MAC
+    uint32_t depth;             // uplinks in the queue now
+    uint32_t max_depth;
+};
+
+struct lorawan_confirmed_result {
+    bool sent;                  // false if the MAC refused the uplink and nothing was transmitted
+    bool ack_received;
+    uint8_t retransmissions;    // transmissions after the first one
+    int8_t datarate;            // of the last transmission
+    uint32_t airtime_us;        // radio time on air of all transmissions
+};
+
+typedef void (*lorawan_confirmed_callback_t)(int handle, const struct lorawan_confirmed_result* result, void* context);
+
+struct lorawan_downlink {
+    uint8_t port;
+    uint8_t size;
+    int8_t rssi;                // dBm
+    int8_t snr;                 // dB
+    int8_t rx_slot;             // see enum LoRaMacRxSlot_t, 0 for RX1
+    int8_t datarate;
+    uint32_t downlink_counter;
+    uint8_t data[242];
+};
+
+struct lorawan_downlink_stats {
+    uint32_t received;          // downlinks stored until the application reads them
+    uint32_t dropped_full;      // lost because all slots held unread downlinks
+    uint32_t depth;             // unread downlinks now
+    uint32_t max_depth;
+};
+
+struct lorawan_sleep_stats {
+    uint32_t sleeps;
+    uint32_t early_wakes;       // woken by an interrupt before the expected time
+    uint64_t expected_us;       // time to the next deadline when going to sleep, summed
+    uint64_t actual_us;         // time actually slept, summed over the same sleeps
+    uint64_t total_us;          // time slept, including sleeps without a deadline
+};
+
+struct lorawan_rx_timing_stats {
+    uint32_t uplinks;               // uplinks whose RX windows were measured
+    uint32_t windows;               // RX windows measured
+    int32_t last_open_error_us;     // RX window opened this much later than the MAC scheduled it, negative if earlier
+    uint32_t max_open_error_us;
+    uint32_t downlinks;             // downlinks measured for clock drift
+    uint32_t max_drift_ppm;
+    uint32_t rx_error_ms;           // RX error the last uplink was sent with
+    int64_t rx_on_saved_us;         // radio RX time saved against a fixed 20 ms RX error, summed
+};
+
+struct lorawan_send_stats {
+    uint32_t sends;                 // uplinks that reached the radio
+    uint32_t last_latency_us;       // from the MAC taking the uplink off the queue to the radio transmitting
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;
+    uint32_t precomputed_blocks;    // AES blocks of upcoming uplinks encrypted while idle, PICO_LORAWAN_FAST_AES only
+    uint32_t precomputed_hits;      // of those, the ones used by an uplink
+};
+
+struct lorawan_os {
+    void* (*mutex_create)(void);
+    void (*mutex_lock)(void* mutex);
+    void (*mutex_unlock)(void* mutex);
+    void* (*semaphore_create)(void);                                // binary, created empty
+    bool (*semaphore_take)(void* semaphore, uint32_t timeout_ms);   // false on timeout, 0 only polls
+    void (*semaphore_give)(void* semaphore);                        // also called from interrupt handlers
+    void* (*task_create)(void (*entry)(void* arg), void* arg);      // NULL on failure
+    void* (*task_self)(void);
+};
+
+#define LORAWAN_OS_WAIT_FOREVER (0xffffffff)
+
 const char* lorawan_default_dev_eui(char* dev_eui);
 
+int lorawan_os_init(const struct lorawan_os* os, uint32_t timeout_ms);
+
+int lorawan_nvm_set_backend(const struct lorawan_nvm_backend* backend, void* context);
+
 int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacRegion_t region);
 
 int lorawan_init_abp(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacRegion_t region, const struct lorawan_abp_settings* abp_settings);
@@ -60,14 +194,50 @@ int lorawan_process();
 
 int lorawan_process_timeout_ms(uint32_t timeout_ms);
 
+uint32_t lorawan_wait_event(uint32_t mask, uint32_t timeout_ms);
+
+int lorawan_sleep_until_next_event(uint32_t max_sleep_ms);
+
+void lorawan_sleep_get_stats(struct lorawan_sleep_stats* stats);
+
 int lorawan_send_unconfirmed(const void* data, uint8_t data_len, uint8_t app_port);
 
+int lorawan_send_unconfirmed_queued(const void* data, uint8_t data_len, uint8_t app_port, enum lorawan_uplink_priority priority, uint32_t deadline_ms);
+
+void* lorawan_tx_acquire(uint8_t* max_len);
+
+int lorawan_tx_commit(uint8_t data_len, uint8_t app_port);
+
+void lorawan_tx_release();
+
+int lorawan_send_confirmed(const void* data, uint8_t data_len, uint8_t app_port, enum lorawan_uplink_priority priority, lorawan_confirmed_callback_t callback, void* context);
+
+void lorawan_uplink_queue_get_stats(struct lorawan_uplink_queue_stats* stats);
+
 int lorawan_receive(void* data, uint8_t data_len, uint8_t* app_port);
 
+const struct lorawan_downlink* lorawan_receive_borrow();
+
+void lorawan_receive_release();
+
+void lorawan_downlink_get_stats(struct lorawan_downlink_stats* stats);
+
 void lorawan_debug(bool debug);
 
+void lorawan_get_send_stats(struct lorawan_send_stats* stats);
+
+void lorawan_rx_timing_get_stats(struct lorawan_rx_timing_stats* stats);
+
 int lorawan_erase_nvm();
 
+int lorawan_nvm_set_flush_policy(enum lorawan_nvm_flush_policy policy, uint32_t interval);
+
+int lorawan_nvm_set_fcnt_reservation(uint16_t frames);
+
+int lorawan_nvm_sync();
+
+void lorawan_nvm_get_stats(struct lorawan_nvm_stats* stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -24,6 +24,7 @@
  *
  */
 
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -31,8 +32,25 @@
 #include "pico/time.h"
 
 #include "board.h"
+#include "board-irq.h"
+#include "board-sleep.h"
+#include "eeprom-board.h"
+#include "eeprom-mcu.h"
+#include "nvm-channel-plan.h"
+#include "nvm-region-channels.h"
 #include "rtc-board.h"
+#include "spi-pio.h"
 #include "sx1276-board.h"
+#include "sx1276-tx.h"
+
+#if PICO_LORAWAN_FAST_AES
+#include "aes-ttable.h"
+#endif
+
+#if PICO_LORAWAN_CORE1
+#include "pico/multicore.h"
+#include "hardware/sync.h"
+#endif
 
 #include "../../periodic-uplink-lpp/firmwareVersion.h"
 #include "Commissioning.h"
@@ -41,6 +59,7 @@
 #include "LmhpCompliance.h"
 #include "LmHandlerMsgDisplay.h"
 #include "NvmDataMgmt.h"
+#include "utilities.h"
 
 /*!
  * LoRaWAN default end-device class
@@ -71,6 +90,53 @@
  */
 #define LORAWAN_APP_DATA_BUFFER_MAX_SIZE            242
 
+/*!
+ * Number of uplinks held back while the MAC is busy or duty cycle restricted
+ */
+#ifndef PICO_LORAWAN_UPLINK_QUEUE_SIZE
+#define PICO_LORAWAN_UPLINK_QUEUE_SIZE              (4)
+#endif
+
+/*!
+ * Number of downlinks held until the application reads them
+ */
+#ifndef PICO_LORAWAN_DOWNLINK_RING_SIZE
+#define PICO_LORAWAN_DOWNLINK_RING_SIZE             (4)
+#endif
+
+/*!
+ * Number of confirmed uplinks that can be outstanding, queued or being
+ * retransmitted by the MAC
+ */
+#ifndef PICO_LORAWAN_CONFIRMED_IN_FLIGHT
+#define PICO_LORAWAN_CONFIRMED_IN_FLIGHT            (2)
+#endif
+
+/*!
+ * RX window error tolerated until a datarate is calibrated, in ms
+ */
+#define LORAWAN_DEFAULT_RX_ERROR                    20
+
+/*!
+ * RX windows measured after uplinks at a datarate before its RX error is
+ * derived from the measurements, 0 keeps LORAWAN_DEFAULT_RX_ERROR
+ */
+#ifndef PICO_LORAWAN_RX_CALIBRATION_SAMPLES
+#define PICO_LORAWAN_RX_CALIBRATION_SAMPLES         (8)
+#endif
+
+/*!
+ * Added to the largest measured RX window error, in us
+ */
+#define LORAWAN_RX_ERROR_MARGIN_US                  500
+
+/*!
+ * Clock drift against the gateway assumed until enough downlinks were measured, in ppm
+ */
+#define LORAWAN_DEFAULT_CLOCK_DRIFT_PPM             50
+
+#define LORAWAN_RX_CALIBRATION_DATARATES            16
+
 /*!
  * LoRaWAN ETSI duty cycle control enable/disable
  *
@@ -83,6 +149,11 @@
  */
 #define LORAWAN_PUBLIC_NETWORK                      true
 
+/*!
+ * Maximum frame counter gap accepted by the network server (MAX_FCNT_GAP)
+ */
+#define LORAWAN_MAX_FCNT_GAP                        16384
+
 /*!
  * User application data
  */
@@ -170,19 +241,322 @@ static const struct lorawan_abp_settings* AbpSettings = NULL;
 
 static const struct lorawan_otaa_settings* OtaaSettings = NULL;
 
-static uint8_t AppRxDataBuffer[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+/*!
+ * Single producer, single consumer ring of downlinks. OnRxData( ) writes at
+ * DownlinkHead, the application reads at DownlinkTail. Both run from 0 to
+ * twice the ring size, so a full ring can be told from an empty one.
+ */
+static struct lorawan_downlink DownlinkRing[PICO_LORAWAN_DOWNLINK_RING_SIZE];
 
-static LmHandlerAppData_t AppRxData =
-{
-    .Buffer = AppRxDataBuffer,
-    .BufferSize = 0,
-    .Port = 0,
-};
+static uint32_t DownlinkHead = 0;
+
+static uint32_t DownlinkTail = 0;
+
+static struct lorawan_downlink_stats DownlinkStats;
+
+static uint32_t DownlinkRingDepth( uint32_t head, uint32_t tail );
 
 static bool Debug = false;
 
-extern void EepromMcuInit();
-extern uint8_t EepromMcuFlush();
+/*!
+ * Events set by the callbacks below, see enum lorawan_event, cleared by
+ * lorawan_wait_event( )
+ */
+static uint32_t Events = 0;
+
+static void EventSet( uint32_t events );
+
+/*!
+ * Calls made into the MAC when it runs on core 1 or in a task of its own
+ */
+typedef enum MacCommand_e
+{
+    MAC_COMMAND_INIT,
+    MAC_COMMAND_ERASE_NVM,
+    MAC_COMMAND_NVM_SYNC,
+    MAC_COMMAND_NVM_SET_FLUSH_POLICY,
+    MAC_COMMAND_NVM_SET_FCNT_RESERVATION,
+} MacCommand_t;
+
+/*!
+ * Mailbox of one call at a time, the caller fills in the command and bumps
+ * Request, the MAC runs it and sets Reply to the same value. Uplinks, downlinks
+ * and events do not go through it, they have their own queues.
+ */
+typedef struct MacMailbox_s
+{
+    uint32_t Request;
+    uint32_t Reply;
+    MacCommand_t Command;
+    uint32_t Args[2];
+    int Result;
+} MacMailbox_t;
+
+static MacMailbox_t MacMailbox;
+
+static const struct lorawan_sx1276_settings* MacSx1276Settings = NULL;
+
+static bool MacRunning = false;
+
+static bool MacJoinRequested = false;
+
+/*!
+ * MAC state published after each lorawan_process( ), so the application can
+ * get lorawan_is_joined( ) and lorawan_tx_acquire( ) answered without waiting
+ */
+static bool MacJoined = false;
+
+static uint8_t MacTxPossibleSize = 0;
+
+#if PICO_LORAWAN_CORE1
+static bool Core1Launched = false;
+
+static void Core1Main( void );
+#else
+/*!
+ * OS adapter set by lorawan_os_init( ), lorawan_init( ) then starts MacTask
+ */
+static const struct lorawan_os* Os = NULL;
+
+static uint32_t OsTimeoutMs = LORAWAN_OS_WAIT_FOREVER;
+
+/*!
+ * Published by whichever of lorawan_init( ) and MacTaskMain( ) runs first,
+ * read from other tasks and interrupt handlers
+ */
+static void* MacTask = NULL;
+
+/*!
+ * Given by API calls and by the radio and timer interrupts, wakes MacTask
+ */
+static void* MacSemaphore = NULL;
+
+static void* MacReplySemaphore = NULL;
+
+static void* MacMailboxMutex = NULL;
+
+/*!
+ * Given with every event, wakes the task in lorawan_wait_event( )
+ */
+static void* EventSemaphore = NULL;
+
+static void* UplinkQueueMutex = NULL;
+
+static void MacTaskMain( void* arg );
+#endif
+
+static bool MacRemote( void );
+
+static void MacWake( void );
+
+static int MacCall( MacCommand_t command, uint32_t arg0, uint32_t arg1 );
+
+static bool MacWaitReply( uint32_t request );
+
+static void MacServe( void );
+
+static void MacPublish( void );
+
+static void MacLoop( void );
+
+static void MacIdle( void );
+
+static bool EventWaitUntil( absolute_time_t timeoutTime );
+
+static struct lorawan_sleep_stats SleepStats;
+
+static enum lorawan_nvm_flush_policy NvmFlushPolicy = LORAWAN_NVM_FLUSH_IMMEDIATE;
+
+static uint32_t NvmFlushInterval = 1;
+
+static uint32_t NvmPendingChanges = 0;
+
+/*!
+ * Uplink frame counter reservation, the persisted FCntUp is the end of a block
+ * of FCntReservation frames, so the crypto context only changes in flash once
+ * per block. After a reset the stack resumes past the block.
+ */
+static uint16_t FCntReservation = 0;
+
+static uint32_t FCntUpLimit = 0;
+
+static bool FCntUpLimitChanged = false;
+
+static LoRaMacCryptoNvmData_t NvmCryptoData;
+
+/*!
+ * Channel array of the region group in the NVM image, stored as the channels
+ * that differ from the const defaults of the region
+ */
+static struct nvm_channel_plan NvmChannelPlan;
+
+/*!
+ * Time the last uplink was handed to LmHandlerSend( ), pending until the
+ * latency to the radio switching to transmit is recorded
+ */
+static uint64_t SendTime = 0;
+
+static bool SendTimePending = false;
+
+static struct lorawan_send_stats SendStats;
+
+#if PICO_LORAWAN_FAST_AES
+/*!
+ * Uplink the AES blocks were precomputed for, the payload size and port are
+ * guessed from the last uplink
+ */
+static bool UplinkPrecomputed = false;
+
+static uint32_t PrecomputedFCntUp = 0;
+
+static uint32_t PrecomputedDevAddr = 0;
+
+static uint8_t PrecomputedSize = 0;
+
+static uint8_t PrecomputedPort = 1;
+
+static void PrecomputeUplink( void );
+#endif
+
+/*!
+ * Confirmed uplink waiting for completion, from lorawan_send_confirmed( ) to
+ * the MCPS confirm after its last retransmission
+ */
+typedef struct ConfirmedUplink_s
+{
+    bool Used;
+    int Handle;
+    lorawan_confirmed_callback_t Callback;
+    void* Context;
+    uint32_t TxCount;       // radio transmissions before the first one of this uplink
+    uint64_t TxOnAirTime;   // radio time on air before the first one of this uplink
+} ConfirmedUplink_t;
+
+static ConfirmedUplink_t ConfirmedUplinks[PICO_LORAWAN_CONFIRMED_IN_FLIGHT];
+
+/*!
+ * Confirmed uplink handed to the MAC, NULL for none
+ */
+static ConfirmedUplink_t* ConfirmedActive = NULL;
+
+static int ConfirmedHandle = 0;
+
+/*!
+ * Uplink queue entry, the queue is drained from lorawan_process( ) by
+ * priority, then in order
+ */
+typedef struct UplinkQueueEntry_s
+{
+    bool Used;
+    uint8_t Priority;
+    uint8_t Port;
+    uint8_t BufferSize;
+    uint32_t Sequence;
+    uint64_t Deadline;      // 0 for none
+    ConfirmedUplink_t* Confirmed;   // NULL for unconfirmed
+    bool Flushed;           // an empty frame already sent the MAC commands ahead of it
+    uint8_t Buffer[LORAWAN_APP_DATA_BUFFER_MAX_SIZE];
+} UplinkQueueEntry_t;
+
+static UplinkQueueEntry_t UplinkQueue[PICO_LORAWAN_UPLINK_QUEUE_SIZE];
+
+static uint32_t UplinkSequence = 0;
+
+static struct lorawan_uplink_queue_stats UplinkQueueStats;
+
+/*!
+ * Queue entry handed out by lorawan_tx_acquire( ), not in the queue until
+ * lorawan_tx_commit( )
+ */
+static UplinkQueueEntry_t* UplinkAcquired = NULL;
+static uint8_t UplinkAcquiredMaxLen = 0;
+
+/*!
+ * Queue entry being handed to the MAC, it must not be evicted meanwhile
+ */
+static UplinkQueueEntry_t* UplinkSending = NULL;
+
+/*!
+ * Status of the last MCPS request, and when a duty cycle restricted uplink
+ * may be retried
+ */
+static LoRaMacStatus_t McpsRequestStatus = LORAMAC_STATUS_OK;
+
+static uint64_t UplinkRetryTime = 0;
+
+/*!
+ * The queue is shared with the MAC on the other core, or in its own task. Tasks
+ * take a mutex, they may be preempted while holding the queue.
+ */
+#define UPLINK_QUEUE_LOCK( )        uint32_t uplinkQueueMask; UplinkQueueLock( &uplinkQueueMask )
+#define UPLINK_QUEUE_UNLOCK( )      UplinkQueueUnlock( &uplinkQueueMask )
+
+static void UplinkQueueLock( uint32_t* mask );
+
+static void UplinkQueueUnlock( uint32_t* mask );
+
+static int UplinkQueuePut( const void* data, uint8_t dataLen, uint8_t port, enum lorawan_uplink_priority priority, uint32_t deadlineMs, ConfirmedUplink_t* confirmed );
+
+static UplinkQueueEntry_t* UplinkQueueAlloc( enum lorawan_uplink_priority priority );
+
+static void UplinkQueueCommit( UplinkQueueEntry_t* entry, uint8_t dataLen, uint8_t port, enum lorawan_uplink_priority priority, uint32_t deadlineMs, ConfirmedUplink_t* confirmed );
+
+static void UplinkQueueRemove( UplinkQueueEntry_t* entry );
+
+static UplinkQueueEntry_t* UplinkQueueNext( uint64_t now );
+
+static uint32_t UplinkQueueDepth( void );
+
+static void UplinkQueueRelease( UplinkQueueEntry_t* entry, uint32_t* counter );
+
+static void UplinkQueueProcess( void );
+
+static void UplinkQueueKick( void );
+
+static uint8_t TxPossibleSize( void );
+
+static void ConfirmedComplete( ConfirmedUplink_t* confirmed, LmHandlerTxParams_t* params );
+
+/*!
+ * RX window timing measurements, kept in the NVM after the LoRaMac-node
+ * context, so a reset does not go back to wide windows
+ */
+typedef struct RxCalibration_s
+{
+    uint16_t Samples[LORAWAN_RX_CALIBRATION_DATARATES];         // by uplink datarate, up to PICO_LORAWAN_RX_CALIBRATION_SAMPLES
+    uint16_t MaxOpenErrorUs[LORAWAN_RX_CALIBRATION_DATARATES];  // largest RX window open error against the MAC schedule
+    uint16_t DriftSamples;
+    uint16_t MaxDriftPpm;       // downlink preamble against the receive delay after TX done
+    uint32_t Crc32;
+} RxCalibration_t;
+
+#define LORAWAN_RX_CALIBRATION_NVM_ADDR             (sizeof(LoRaMacNvmData_t))
+
+// bytes of the NVM image in use, the backend must hold at least that many
+#define LORAWAN_NVM_SIZE                            (LORAWAN_RX_CALIBRATION_NVM_ADDR + sizeof(RxCalibration_t))
+
+_Static_assert(LORAWAN_NVM_SIZE <= EEPROM_MCU_IMAGE_SIZE, "the LoRaMac-node context and the RX calibration do not fit in the NVM image");
+
+static RxCalibration_t RxCalibration;
+
+/*!
+ * RX error the MAC computed the windows of the last uplink with, in ms
+ */
+static uint32_t RxErrorInUse = LORAWAN_DEFAULT_RX_ERROR;
+
+static struct lorawan_rx_timing_stats RxTimingStats;
+
+static void RxCalibrationLoad( void );
+
+static void RxCalibrationStore( void );
+
+static uint32_t RxCalibrationGetError( int8_t datarate );
+
+static void RxCalibrationMeasureWindows( int8_t datarate );
+
+static void RxCalibrationMeasureDownlink( uint8_t rxSlot );
+
+static uint8_t* OnEepromWrite( uint16_t addr, uint8_t* buffer, uint16_t size );
 
 const char* lorawan_default_dev_eui(char* dev_eui)
 {
@@ -199,19 +573,116 @@ const char* lorawan_default_dev_eui(char* dev_eui)
     return dev_eui;
 }
 
+int lorawan_os_init(const struct lorawan_os* os, uint32_t timeout_ms)
+{
+#if PICO_LORAWAN_CORE1
+    // the MAC already has core 1 to itself
+    return -1;
+#else
+    if (Os != NULL) {
+        return -1;
+    }
+
+    MacSemaphore = os->semaphore_create();
+    MacReplySemaphore = os->semaphore_create();
+    MacMailboxMutex = os->mutex_create();
+    EventSemaphore = os->semaphore_create();
+    UplinkQueueMutex = os->mutex_create();
+
+    if (MacSemaphore == NULL || MacReplySemaphore == NULL || MacMailboxMutex == NULL ||
+        EventSemaphore == NULL || UplinkQueueMutex == NULL) {
+        return -1;
+    }
+
+    OsTimeoutMs = timeout_ms;
+    Os = os;
+
+    return 0;
+#endif
+}
+
+int lorawan_nvm_set_backend(const struct lorawan_nvm_backend* backend, void* context)
+{
+    if (backend != NULL && (backend->init == NULL || backend->read == NULL ||
+                            backend->write == NULL || backend->flush == NULL)) {
+        return -1;
+    }
+
+    EepromMcuSetBackend(backend, context);
+
+    return 0;
+}
+
 int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacRegion_t region)
 {
-    EepromMcuInit();
+    BoardInitMcu();
+
+#if PICO_LORAWAN_CORE1
+    if (get_core_num() == 0 && !Core1Launched) {
+        // core 1 writes flash, core 0 must be paused meanwhile
+        multicore_lockout_victim_init();
+        multicore_launch_core1(Core1Main);
+
+        Core1Launched = true;
+    }
+#else
+    if (Os != NULL && __atomic_load_n(&MacTask, __ATOMIC_ACQUIRE) == NULL) {
+        void* task = Os->task_create(MacTaskMain, NULL);
+
+        if (task == NULL) {
+            return -1;
+        }
+
+        // MacTaskMain( ) may have published it already, it is the same handle
+        __atomic_store_n(&MacTask, task, __ATOMIC_RELEASE);
+    }
+#endif
+
+    if (MacRemote()) {
+        MacSx1276Settings = sx1276_settings;
+
+        return MacCall(MAC_COMMAND_INIT, region, 0);
+    }
+
+    // NvmDataMgmt stores the groups of LoRaMacNvmData_t one after the other,
+    // from address 0
+    NvmChannelPlan.address = offsetof(LoRaMacNvmData_t, RegionGroup2) + offsetof(RegionNvmDataGroup2_t, Channels);
+    NvmChannelPlan.channel_count = REGION_NVM_MAX_NB_CHANNELS;
+    NvmChannelPlan.entry_size = sizeof(ChannelParams_t);
+    NvmChannelPlan.defaults = nvm_region_channels(region, &NvmChannelPlan.default_count);
+    NvmChannelPlan.region = region;
+
+    EepromMcuSetChannelPlan((NvmChannelPlan.defaults != NULL) ? &NvmChannelPlan : NULL);
+
+    if (EepromMcuInit(LORAWAN_NVM_SIZE) != SUCCESS) {
+        return -1;
+    }
+
+    RxCalibrationLoad();
 
     RtcInit();
-    SpiInit(
-        &SX1276.Spi,
-        (SpiId_t)((sx1276_settings->spi.inst == spi0) ? 0 : 1),
-        sx1276_settings->spi.mosi /*MOSI*/,
-        sx1276_settings->spi.miso /*MISO*/,
-        sx1276_settings->spi.sck /*SCK*/, 
-        NC
-    );
+
+    if (sx1276_settings->spi.pio != NULL) {
+        if (!SpiPioInit(
+            &SX1276.Spi,
+            sx1276_settings->spi.pio,
+            sx1276_settings->spi.mosi /*MOSI*/,
+            sx1276_settings->spi.miso /*MISO*/,
+            sx1276_settings->spi.sck /*SCK*/,
+            sx1276_settings->spi.nss /*NSS*/
+        )) {
+            return -1;
+        }
+    } else {
+        SpiInit(
+            &SX1276.Spi,
+            (SpiId_t)((sx1276_settings->spi.inst == spi0) ? 0 : 1),
+            sx1276_settings->spi.mosi /*MOSI*/,
+            sx1276_settings->spi.miso /*MISO*/,
+            sx1276_settings->spi.sck /*SCK*/, 
+            NC
+        );
+    }
 
     SX1276.Spi.Nss.pin = sx1276_settings->spi.nss;
     SX1276.Reset.pin = sx1276_settings->reset;
@@ -232,8 +703,10 @@ int lorawan_init(const struct lorawan_sx1276_settings* sx1276_settings, LoRaMacR
         return -1;
     }
 
-    // Set system maximum tolerated rx error in milliseconds
-    LmHandlerSetSystemMaxRxError( 20 );
+    // Set system maximum tolerated rx error in milliseconds, until the
+    // datarate of an uplink is calibrated
+    RxErrorInUse = LORAWAN_DEFAULT_RX_ERROR;
+    LmHandlerSetSystemMaxRxError( RxErrorInUse );
 
     // The LoRa-Alliance Compliance protocol package should always be
     // initialized and activated.
@@ -260,6 +733,17 @@ int lorawan_init_otaa(const struct lorawan_sx1276_settings* sx1276_settings, LoR
 
 int lorawan_join()
 {
+    if (MacRemote()) {
+        __atomic_store_n(&MacJoinRequested, true, __ATOMIC_RELEASE);
+        MacWake();
+
+        return 0;
+    }
+
+    // the join accept delays are longer than the measured ones
+    RxErrorInUse = LORAWAN_DEFAULT_RX_ERROR;
+    LmHandlerSetSystemMaxRxError( RxErrorInUse );
+
     LmHandlerJoin( );
 
     return 0;
@@ -267,6 +751,10 @@ int lorawan_join()
 
 int lorawan_is_joined()
 {
+    if (MacRemote()) {
+        return __atomic_load_n(&MacJoined, __ATOMIC_ACQUIRE);
+    }
+
     return (LmHandlerJoinStatus() == LORAMAC_HANDLER_SET);
 }
 
@@ -274,9 +762,17 @@ int lorawan_process()
 {
     int sleep = 0;
 
+    // core 1 or the MAC task processes the MAC events, nothing to do here
+    if (MacRemote()) {
+        return 1;
+    }
+
     // Processes the LoRaMac events
     LmHandlerProcess( );
 
+    // Hands queued uplinks to the MAC once it is free
+    UplinkQueueProcess( );
+
     CRITICAL_SECTION_BEGIN( );
     if( IsMacProcessPending == 1 )
     {
@@ -290,6 +786,26 @@ int lorawan_process()
     }
     CRITICAL_SECTION_END( );
 
+    // NVM writes and maintenance (erasing flash ahead of time) stall the CPU,
+    // only do them when nothing else is pending and the MAC is not waiting for
+    // a window
+    if (sleep && !LmHandlerIsBusy()) {
+#if PICO_LORAWAN_FAST_AES
+        PrecomputeUplink();
+#endif
+
+        // under LORAWAN_NVM_FLUSH_IMMEDIATE only the RX calibration or a
+        // failed flush is left pending, a frame counter block whatever the
+        // policy
+        if (NvmPendingChanges && (FCntUpLimitChanged ||
+                                  NvmFlushPolicy == LORAWAN_NVM_FLUSH_ON_IDLE ||
+                                  NvmFlushPolicy == LORAWAN_NVM_FLUSH_IMMEDIATE)) {
+            lorawan_nvm_sync();
+        } else {
+            EepromMcuProcess();
+        }
+    }
+
     return sleep;
 }
 
@@ -302,69 +818,503 @@ int lorawan_process_timeout_ms(uint32_t timeout_ms)
     do {
         lorawan_process();
 
-        if (AppRxData.Port) {
+        if (DownlinkRingDepth(__atomic_load_n(&DownlinkHead, __ATOMIC_ACQUIRE), DownlinkTail) > 0) {
             return 0;
         } else if (joined != lorawan_is_joined()) {
             return 0;
         }
-    } while (!best_effort_wfe_or_timeout(timeout_time));
+    } while (!EventWaitUntil(timeout_time));
     
     return 1; // timed out
 }
 
-int lorawan_send_unconfirmed(const void* data, uint8_t data_len, uint8_t app_port)
+uint32_t lorawan_wait_event(uint32_t mask, uint32_t timeout_ms)
 {
-    LmHandlerAppData_t appData;
+    absolute_time_t timeout_time = make_timeout_time_ms(timeout_ms);
+    uint32_t events;
+
+    do {
+        lorawan_process();
 
-    appData.Port = app_port;
-    appData.BufferSize = data_len;
-    appData.Buffer = (uint8_t*)data;
+        events = __atomic_fetch_and(&Events, ~mask, __ATOMIC_ACQ_REL) & mask;
 
-    if (LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG) != LORAMAC_HANDLER_SUCCESS) {
-        return -1;
-    }
+        if (events) {
+            return events;
+        }
+    } while (!EventWaitUntil(timeout_time));
 
-    return 0;
+    return 0; // timed out
 }
 
-int lorawan_receive(void* data, uint8_t data_len, uint8_t* app_port)
+int lorawan_sleep_until_next_event(uint32_t max_sleep_ms)
 {
-    *app_port = AppRxData.Port;
-    if (*app_port == 0) {
-        return -1;
-    }
+    uint64_t start;
+    uint64_t end;
+    uint64_t wakeTime = 0;
+    uint64_t alarmTime;
 
-    int receive_length = AppRxData.BufferSize;
+    // the MAC sleeps on core 1 or in its task by itself, wait for it to raise
+    // an event
+    if (MacRemote()) {
+        start = to_us_since_boot(get_absolute_time());
 
-    if (data_len < receive_length) {
-        receive_length = data_len;
-    }
+        EventWaitUntil((max_sleep_ms != 0) ? make_timeout_time_ms(max_sleep_ms) : at_the_end_of_time);
 
-    memcpy(data, AppRxData.Buffer, receive_length);
-    AppRxData.Port = 0;
+        SleepStats.sleeps++;
+        SleepStats.total_us += to_us_since_boot(get_absolute_time()) - start;
 
-    return receive_length;
-}
+        return 0;
+    }
 
-void lorawan_debug(bool debug)
-{
+    // only sleep once there is nothing left to process
+    if (lorawan_process() == 0) {
+        return 1;
+    }
+
+    CRITICAL_SECTION_BEGIN( );
+    if( IsMacProcessPending == 1 )
+    {
+        CRITICAL_SECTION_END( );
+        return 1;
+    }
+
+    start = to_us_since_boot(get_absolute_time());
+
+    // the earliest LoRaMac timer
+    if (RtcGetAlarmTime(&alarmTime)) {
+        wakeTime = alarmTime;
+    }
+
+    // duty cycle restricted uplinks wait for a time the MAC does not track
+    if (UplinkQueueStats.depth > 0 && UplinkRetryTime > start && (wakeTime == 0 || UplinkRetryTime < wakeTime)) {
+        wakeTime = UplinkRetryTime;
+    }
+
+    if (max_sleep_ms != 0 && (wakeTime == 0 || start + (uint64_t)max_sleep_ms * 1000 < wakeTime)) {
+        wakeTime = start + (uint64_t)max_sleep_ms * 1000;
+    }
+
+    BoardSleepUntil(wakeTime);
+
+    end = to_us_since_boot(get_absolute_time());
+    CRITICAL_SECTION_END( );
+
+    SleepStats.sleeps++;
+    SleepStats.total_us += end - start;
+
+    if (wakeTime > start) {
+        SleepStats.expected_us += wakeTime - start;
+        SleepStats.actual_us += end - start;
+
+        if (end < wakeTime) {
+            SleepStats.early_wakes++;
+        }
+    }
+
+    return 0;
+}
+
+void lorawan_sleep_get_stats(struct lorawan_sleep_stats* stats)
+{
+    *stats = SleepStats;
+}
+
+int lorawan_send_unconfirmed(const void* data, uint8_t data_len, uint8_t app_port)
+{
+    return lorawan_send_unconfirmed_queued(data, data_len, app_port, LORAWAN_UPLINK_PRIORITY_TELEMETRY, 0);
+}
+
+int lorawan_send_unconfirmed_queued(const void* data, uint8_t data_len, uint8_t app_port, enum lorawan_uplink_priority priority, uint32_t deadline_ms)
+{
+    return UplinkQueuePut(data, data_len, app_port, priority, deadline_ms, NULL);
+}
+
+int lorawan_send_confirmed(const void* data, uint8_t data_len, uint8_t app_port, enum lorawan_uplink_priority priority, lorawan_confirmed_callback_t callback, void* context)
+{
+    ConfirmedUplink_t* confirmed = NULL;
+    int handle;
+
+    // the MAC would refuse it at the current datarate, and the slot would be
+    // held until then for nothing
+    if (data_len > TxPossibleSize()) {
+        return -1;
+    }
+
+    UPLINK_QUEUE_LOCK( );
+    for (int i = 0; i < PICO_LORAWAN_CONFIRMED_IN_FLIGHT; i++) {
+        if (!ConfirmedUplinks[i].Used) {
+            confirmed = &ConfirmedUplinks[i];
+            break;
+        }
+    }
+
+    if (confirmed != NULL) {
+        handle = ConfirmedHandle;
+        ConfirmedHandle = (ConfirmedHandle + 1) & INT32_MAX;
+
+        confirmed->Used = true;
+        confirmed->Handle = handle;
+        confirmed->Callback = callback;
+        confirmed->Context = context;
+    }
+    UPLINK_QUEUE_UNLOCK( );
+
+    if (confirmed == NULL) {
+        return -1;
+    }
+
+    if (UplinkQueuePut(data, data_len, app_port, priority, 0, confirmed) < 0) {
+        // other cores or tasks look for a free slot under the lock
+        UPLINK_QUEUE_LOCK( );
+        confirmed->Used = false;
+        UPLINK_QUEUE_UNLOCK( );
+
+        return -1;
+    }
+
+    return handle;
+}
+
+void* lorawan_tx_acquire(uint8_t* max_len)
+{
+    UplinkQueueEntry_t* entry;
+    uint8_t maxLen;
+
+    if (!lorawan_is_joined()) {
+        return NULL;
+    }
+
+    maxLen = MIN(TxPossibleSize(), LORAWAN_APP_DATA_BUFFER_MAX_SIZE);
+
+    UPLINK_QUEUE_LOCK( );
+    if (UplinkAcquired == NULL) {
+        UplinkAcquired = UplinkQueueAlloc(LORAWAN_UPLINK_PRIORITY_TELEMETRY);
+    }
+
+    entry = UplinkAcquired;
+    UplinkAcquiredMaxLen = maxLen;
+    UPLINK_QUEUE_UNLOCK( );
+
+    if (entry == NULL) {
+        return NULL;
+    }
+
+    *max_len = maxLen;
+
+    return entry->Buffer;
+}
+
+int lorawan_tx_commit(uint8_t data_len, uint8_t app_port)
+{
+    UplinkQueueEntry_t* entry;
+
+    UPLINK_QUEUE_LOCK( );
+    entry = UplinkAcquired;
+
+    // a longer message stays acquired, to be committed shorter or released
+    if (entry != NULL && data_len <= UplinkAcquiredMaxLen) {
+        UplinkAcquired = NULL;
+        UplinkQueueCommit(entry, data_len, app_port, LORAWAN_UPLINK_PRIORITY_TELEMETRY, 0, NULL);
+    } else {
+        entry = NULL;
+    }
+    UPLINK_QUEUE_UNLOCK( );
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    // sent right away when the MAC is free
+    UplinkQueueKick();
+
+    return 0;
+}
+
+static int UplinkQueuePut( const void* data, uint8_t dataLen, uint8_t port, enum lorawan_uplink_priority priority, uint32_t deadlineMs, ConfirmedUplink_t* confirmed )
+{
+    UplinkQueueEntry_t* entry;
+
+    if (dataLen > LORAWAN_APP_DATA_BUFFER_MAX_SIZE || !lorawan_is_joined()) {
+        return -1;
+    }
+
+    // the MAC may be taking an entry out of the queue
+    UPLINK_QUEUE_LOCK( );
+    entry = UplinkQueueAlloc(priority);
+
+    if (entry != NULL) {
+        memcpy(entry->Buffer, data, dataLen);
+        UplinkQueueCommit(entry, dataLen, port, priority, deadlineMs, confirmed);
+    } else {
+        UplinkQueueStats.dropped_full++;
+    }
+    UPLINK_QUEUE_UNLOCK( );
+
+    if (entry == NULL) {
+        return -1;
+    }
+
+    // sent right away when the MAC is free
+    UplinkQueueKick();
+
+    return 0;
+}
+
+static UplinkQueueEntry_t* UplinkQueueAlloc( enum lorawan_uplink_priority priority )
+{
+    UplinkQueueEntry_t* entry = NULL;
+
+    for (int i = 0; i < PICO_LORAWAN_UPLINK_QUEUE_SIZE; i++) {
+        if (!UplinkQueue[i].Used && &UplinkQueue[i] != UplinkAcquired) {
+            return &UplinkQueue[i];
+        }
+    }
+
+    // a full queue makes room for an alarm by dropping the oldest unconfirmed telemetry
+    if (priority == LORAWAN_UPLINK_PRIORITY_ALARM) {
+        for (int i = 0; i < PICO_LORAWAN_UPLINK_QUEUE_SIZE; i++) {
+            if (UplinkQueue[i].Used && UplinkQueue[i].Priority == LORAWAN_UPLINK_PRIORITY_TELEMETRY && UplinkQueue[i].Confirmed == NULL &&
+                &UplinkQueue[i] != UplinkSending && (entry == NULL || UplinkQueue[i].Sequence < entry->Sequence)) {
+                entry = &UplinkQueue[i];
+            }
+        }
+
+        if (entry != NULL) {
+            UplinkQueueRemove(entry);
+            UplinkQueueStats.dropped_full++;
+        }
+    }
+
+    return entry;
+}
+
+static void UplinkQueueCommit( UplinkQueueEntry_t* entry, uint8_t dataLen, uint8_t port, enum lorawan_uplink_priority priority, uint32_t deadlineMs, ConfirmedUplink_t* confirmed )
+{
+    uint64_t now = to_us_since_boot(get_absolute_time());
+
+    entry->Used = true;
+    entry->Priority = priority;
+    entry->Port = port;
+    entry->BufferSize = dataLen;
+    entry->Sequence = UplinkSequence++;
+    entry->Deadline = (deadlineMs != 0) ? (now + (uint64_t)deadlineMs * 1000) : 0;
+    entry->Confirmed = confirmed;
+    entry->Flushed = false;
+
+    UplinkQueueStats.queued++;
+    UplinkQueueStats.depth++;
+
+    if (UplinkQueueStats.depth > UplinkQueueStats.max_depth) {
+        UplinkQueueStats.max_depth = UplinkQueueStats.depth;
+    }
+}
+
+void lorawan_uplink_queue_get_stats(struct lorawan_uplink_queue_stats* stats)
+{
+    UPLINK_QUEUE_LOCK( );
+    *stats = UplinkQueueStats;
+    UPLINK_QUEUE_UNLOCK( );
+}
+
+int lorawan_receive(void* data, uint8_t data_len, uint8_t* app_port)
+{
+    const struct lorawan_downlink* downlink = lorawan_receive_borrow();
+
+    if (downlink == NULL) {
+        *app_port = 0;
+        return -1;
+    }
+
+    int receive_length = downlink->size;
+
+    if (data_len < receive_length) {
+        receive_length = data_len;
+    }
+
+    *app_port = downlink->port;
+    memcpy(data, downlink->data, receive_length);
+
+    lorawan_receive_release();
+
+    return receive_length;
+}
+
+void lorawan_tx_release()
+{
+    // the entry was never marked used, it is free again once it is not the
+    // acquired one
+    UPLINK_QUEUE_LOCK( );
+    UplinkAcquired = NULL;
+    UPLINK_QUEUE_UNLOCK( );
+}
+
+const struct lorawan_downlink* lorawan_receive_borrow()
+{
+    uint32_t tail = DownlinkTail;
+
+    // pairs with the release in OnRxData( ), the frame is complete
+    if (DownlinkRingDepth(__atomic_load_n(&DownlinkHead, __ATOMIC_ACQUIRE), tail) == 0) {
+        return NULL;
+    }
+
+    return &DownlinkRing[tail % PICO_LORAWAN_DOWNLINK_RING_SIZE];
+}
+
+void lorawan_receive_release()
+{
+    uint32_t tail = DownlinkTail;
+
+    if (DownlinkRingDepth(__atomic_load_n(&DownlinkHead, __ATOMIC_ACQUIRE), tail) == 0) {
+        return;
+    }
+
+    // the slot may be written again once the new tail is seen
+    __atomic_store_n(&DownlinkTail, (tail + 1) % (2 * PICO_LORAWAN_DOWNLINK_RING_SIZE), __ATOMIC_RELEASE);
+}
+
+void lorawan_downlink_get_stats(struct lorawan_downlink_stats* stats)
+{
+    *stats = DownlinkStats;
+    stats->depth = DownlinkRingDepth(__atomic_load_n(&DownlinkHead, __ATOMIC_ACQUIRE),
+                                     __atomic_load_n(&DownlinkTail, __ATOMIC_ACQUIRE));
+}
+
+static uint32_t DownlinkRingDepth( uint32_t head, uint32_t tail )
+{
+    return (head + 2 * PICO_LORAWAN_DOWNLINK_RING_SIZE - tail) % (2 * PICO_LORAWAN_DOWNLINK_RING_SIZE);
+}
+
+void lorawan_debug(bool debug)
+{
     Debug = debug;
 }
 
 int lorawan_erase_nvm()
 {
+    if (MacRemote()) {
+        return MacCall(MAC_COMMAND_ERASE_NVM, 0, 0);
+    }
+
     if (!NvmDataMgmtFactoryReset()) {
         return -1;
     }
 
-    EepromMcuFlush();
+    memset(&RxCalibration, 0x00, sizeof(RxCalibration));
+    RxCalibrationStore();
+
+    return lorawan_nvm_sync();
+}
+
+int lorawan_nvm_set_flush_policy(enum lorawan_nvm_flush_policy policy, uint32_t interval)
+{
+    if (policy == LORAWAN_NVM_FLUSH_EVERY_N && interval == 0) {
+        return -1;
+    }
+
+    if (MacRemote()) {
+        return MacCall(MAC_COMMAND_NVM_SET_FLUSH_POLICY, policy, interval);
+    }
+
+    NvmFlushPolicy = policy;
+    NvmFlushInterval = interval;
+
+    // changes held back by the previous policy are written by the new one
+    if (policy == LORAWAN_NVM_FLUSH_IMMEDIATE && NvmPendingChanges) {
+        return lorawan_nvm_sync();
+    }
+
+    return 0;
+}
+
+int lorawan_nvm_set_fcnt_reservation(uint16_t frames)
+{
+    // the network server must still accept the frame after the jump
+    if (frames > LORAWAN_MAX_FCNT_GAP) {
+        return -1;
+    }
+
+    if (MacRemote()) {
+        return MacCall(MAC_COMMAND_NVM_SET_FCNT_RESERVATION, frames, 0);
+    }
+
+    FCntReservation = frames;
+    FCntUpLimit = 0;
+
+    EepromMcuSetWriteHook((frames > 1) ? OnEepromWrite : NULL);
+
+    return 0;
+}
+
+int lorawan_nvm_sync()
+{
+    if (MacRemote()) {
+        return MacCall(MAC_COMMAND_NVM_SYNC, 0, 0);
+    }
+
+    // the changes stay pending until they are in flash, the next store, idle
+    // or uplink tries again
+    if (EepromMcuFlush() != SUCCESS) {
+        return -1;
+    }
+
+    NvmPendingChanges = 0;
+    FCntUpLimitChanged = false;
+
+    EventSet(LORAWAN_EVENT_NVM_WRITTEN);
 
     return 0;
 }
 
+void lorawan_get_send_stats(struct lorawan_send_stats* stats)
+{
+#if PICO_LORAWAN_FAST_AES
+    struct aes_precompute_stats aes_stats;
+
+    aes_precompute_get_stats(&aes_stats);
+
+    SendStats.precomputed_blocks = aes_stats.blocks;
+    SendStats.precomputed_hits = aes_stats.hits;
+#endif
+
+    *stats = SendStats;
+}
+
+void lorawan_rx_timing_get_stats(struct lorawan_rx_timing_stats* stats)
+{
+    *stats = RxTimingStats;
+}
+
+void lorawan_nvm_get_stats(struct lorawan_nvm_stats* stats)
+{
+    EepromMcuStats_t eeprom_stats;
+
+    EepromMcuGetStats(&eeprom_stats);
+
+    stats->flushes = eeprom_stats.Flushes;
+    stats->skipped_flushes = eeprom_stats.SkippedFlushes;
+    stats->erases = eeprom_stats.Erases;
+    stats->skipped_erases = eeprom_stats.SkippedErases;
+    stats->pages_programmed = eeprom_stats.PagesProgrammed;
+    stats->max_sector_erases = eeprom_stats.MaxSectorErases;
+    stats->max_flush_time_us = eeprom_stats.MaxFlushTimeUs;
+    stats->total_flush_time_us = eeprom_stats.TotalFlushTimeUs;
+    stats->max_irq_latency_us = BoardIrqGetMaxLatency();
+    stats->dropped_irqs = BoardIrqGetDrops();
+    stats->ram_bytes = eeprom_stats.RamBytes;
+    stats->max_ram_bytes = eeprom_stats.MaxRamBytes;
+    stats->bytes_written = eeprom_stats.BytesWritten;
+}
+
 static void OnMacProcessNotify( void )
 {
     IsMacProcessPending = 1;
+
+#if !PICO_LORAWAN_CORE1
+    // called from the radio and timer interrupts too
+    if (__atomic_load_n(&MacTask, __ATOMIC_ACQUIRE) != NULL) {
+        MacWake();
+    }
+#endif
 }
 
 static void OnNvmDataChange( LmHandlerNvmContextStates_t state, uint16_t size )
@@ -373,7 +1323,45 @@ static void OnNvmDataChange( LmHandlerNvmContextStates_t state, uint16_t size )
         DisplayNvmDataChange( state, size );
     }
 
-    EepromMcuFlush();
+    if (state != LORAMAC_HANDLER_NVM_STORE) {
+        return;
+    }
+
+    NvmPendingChanges++;
+
+    // a new frame counter block must be in flash before the next uplink,
+    // whatever the policy
+    if (FCntUpLimitChanged ||
+        NvmFlushPolicy == LORAWAN_NVM_FLUSH_IMMEDIATE ||
+        (NvmFlushPolicy == LORAWAN_NVM_FLUSH_EVERY_N && NvmPendingChanges >= NvmFlushInterval)) {
+        lorawan_nvm_sync();
+    }
+}
+
+static uint8_t* OnEepromWrite( uint16_t addr, uint8_t* buffer, uint16_t size )
+{
+    uint32_t fcnt_up;
+
+    // NvmDataMgmt writes the crypto context as a whole, at the start of the NVM
+    if (addr != 0 || size != sizeof(NvmCryptoData)) {
+        return buffer;
+    }
+
+    memcpy(&NvmCryptoData, buffer, sizeof(NvmCryptoData));
+
+    fcnt_up = NvmCryptoData.FCntList.FCntUp;
+
+    // start a new block when the next frame would leave the current one, or
+    // the counter went back (new session)
+    if ((fcnt_up + 1) >= FCntUpLimit || (fcnt_up + FCntReservation) < FCntUpLimit) {
+        FCntUpLimit = (fcnt_up > (UINT32_MAX - FCntReservation)) ? UINT32_MAX : (fcnt_up + FCntReservation);
+        FCntUpLimitChanged = true;
+    }
+
+    NvmCryptoData.FCntList.FCntUp = FCntUpLimit;
+    NvmCryptoData.Crc32 = Crc32((uint8_t*)&NvmCryptoData, sizeof(NvmCryptoData) - sizeof(NvmCryptoData.Crc32));
+
+    return (uint8_t*)&NvmCryptoData;
 }
 
 static void OnNetworkParametersChange( CommissioningParams_t* params )
@@ -561,6 +1549,12 @@ static void OnMacMcpsRequest( LoRaMacStatus_t status, McpsReq_t *mcpsReq, TimerT
     if (Debug) {
         DisplayMacMcpsRequestUpdate( status, mcpsReq, nextTxIn );
     }
+
+    McpsRequestStatus = status;
+
+    if (status == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED) {
+        UplinkRetryTime = to_us_since_boot(get_absolute_time()) + (uint64_t)nextTxIn * 1000;
+    }
 }
 
 static void OnMacMlmeRequest( LoRaMacStatus_t status, MlmeReq_t *mlmeReq, TimerTime_t nextTxIn )
@@ -583,14 +1577,55 @@ static void OnJoinRequest( LmHandlerJoinParams_t* params )
     else
     {
         LmHandlerRequestClass( LORAWAN_DEFAULT_CLASS );
+
+        // joined before the event is seen by the application
+        MacPublish();
+
+        EventSet(LORAWAN_EVENT_JOINED);
     }
+
+#if PICO_LORAWAN_FAST_AES
+    // new session keys
+    UplinkPrecomputed = false;
+#endif
 }
 
 static void OnTxData( LmHandlerTxParams_t* params )
 {
+    uint64_t tx_start_time = SX1276BoardGetTxStartTime();
+
     if (Debug) {
         DisplayTxUpdate( params );
     }
+
+    if (params->IsMcpsConfirm) {
+        // both RX windows are over
+        RxCalibrationMeasureWindows(params->Datarate);
+
+        EventSet(LORAWAN_EVENT_TX_DONE);
+    }
+
+    // the MAC confirms a confirmed uplink after its last retransmission
+    if (params->IsMcpsConfirm && ConfirmedActive != NULL) {
+        ConfirmedUplink_t* confirmed = ConfirmedActive;
+
+        ConfirmedActive = NULL;
+        ConfirmedComplete(confirmed, params);
+    }
+
+    if (SendTimePending && tx_start_time >= SendTime) {
+        uint32_t latency = (uint32_t)(tx_start_time - SendTime);
+
+        SendStats.sends++;
+        SendStats.last_latency_us = latency;
+        SendStats.total_latency_us += latency;
+
+        if (latency > SendStats.max_latency_us) {
+            SendStats.max_latency_us = latency;
+        }
+
+        SendTimePending = false;
+    }
 }
 
 static void OnRxData( LmHandlerAppData_t* appData, LmHandlerRxParams_t* params )
@@ -599,9 +1634,44 @@ static void OnRxData( LmHandlerAppData_t* appData, LmHandlerRxParams_t* params )
         DisplayRxUpdate( appData, params );
     }
 
-    memcpy(AppRxData.Buffer, appData->Buffer, appData->BufferSize);
-    AppRxData.BufferSize = appData->BufferSize;
-    AppRxData.Port = appData->Port;
+    uint32_t head = DownlinkHead;
+    uint32_t depth;
+    struct lorawan_downlink* downlink;
+
+    RxCalibrationMeasureDownlink(params->RxSlot);
+
+    // no application payload, MAC commands only
+    if (appData->Port == 0) {
+        return;
+    }
+
+    // pairs with the release in lorawan_receive_release( ), the slot is free
+    depth = DownlinkRingDepth(head, __atomic_load_n(&DownlinkTail, __ATOMIC_ACQUIRE));
+
+    if (depth == PICO_LORAWAN_DOWNLINK_RING_SIZE) {
+        DownlinkStats.dropped_full++;
+        return;
+    }
+
+    downlink = &DownlinkRing[head % PICO_LORAWAN_DOWNLINK_RING_SIZE];
+    downlink->port = appData->Port;
+    downlink->size = appData->BufferSize;
+    downlink->rssi = params->Rssi;
+    downlink->snr = params->Snr;
+    downlink->rx_slot = params->RxSlot;
+    downlink->datarate = params->Datarate;
+    downlink->downlink_counter = params->DownlinkCounter;
+    memcpy(downlink->data, appData->Buffer, appData->BufferSize);
+
+    DownlinkStats.received++;
+
+    if (depth + 1 > DownlinkStats.max_depth) {
+        DownlinkStats.max_depth = depth + 1;
+    }
+
+    __atomic_store_n(&DownlinkHead, (head + 1) % (2 * PICO_LORAWAN_DOWNLINK_RING_SIZE), __ATOMIC_RELEASE);
+
+    EventSet(LORAWAN_EVENT_RX);
 }
 
 static void OnClassChange( DeviceClass_t deviceClass )
@@ -610,6 +1680,8 @@ static void OnClassChange( DeviceClass_t deviceClass )
         DisplayClassUpdate( deviceClass );
     }
 
+    EventSet(LORAWAN_EVENT_CLASS_CHANGED);
+
     // Inform the server as soon as possible that the end-device has switched to ClassB
     LmHandlerAppData_t appData =
     {
@@ -642,17 +1714,19 @@ static void OnBeaconStatusChange( LoRaMacHandlerBeaconParams_t* params )
     if (Debug) {
         DisplayBeaconUpdate( params );
     }
+
+    EventSet(LORAWAN_EVENT_BEACON);
 }
 
 #if( LMH_SYS_TIME_UPDATE_NEW_API == 1 )
 static void OnSysTimeUpdate( bool isSynchronized, int32_t timeCorrection )
 {
-
+    EventSet(LORAWAN_EVENT_TIME_SYNC);
 }
 #else
 static void OnSysTimeUpdate( void )
 {
-
+    EventSet(LORAWAN_EVENT_TIME_SYNC);
 }
 #endif
 
@@ -670,3 +1744,806 @@ static void OnPingSlotPeriodicityChanged( uint8_t pingSlotPeriodicity )
 {
     LmHandlerParams.PingSlotPeriodicity = pingSlotPeriodicity;
 }
+
+#if PICO_LORAWAN_FAST_AES
+static void StoreUint32( uint8_t* buffer, uint32_t value )
+{
+    buffer[0] = value & 0xff;
+    buffer[1] = (value >> 8) & 0xff;
+    buffer[2] = (value >> 16) & 0xff;
+    buffer[3] = (value >> 24) & 0xff;
+}
+
+static void PrecomputeUplink( void )
+{
+    MibRequestConfirm_t mibReq;
+    LoRaMacNvmData_t* nvm;
+    const uint8_t* payloadKey = NULL;
+    const uint8_t* micKey = NULL;
+    uint32_t fCntUp;
+    uint8_t block[16];
+
+    if (!lorawan_is_joined()) {
+        return;
+    }
+
+    mibReq.Type = MIB_NVM_CTXS;
+    LoRaMacMibGetRequestConfirm( &mibReq );
+    nvm = mibReq.Param.Contexts;
+
+    // the frame counter LoRaMacCryptoGetFCntUp( ) gives the next uplink
+    fCntUp = nvm->Crypto.FCntList.FCntUp + 1;
+
+    if (UplinkPrecomputed && fCntUp == PrecomputedFCntUp && nvm->MacGroup2.DevAddr == PrecomputedDevAddr) {
+        return;
+    }
+
+    for (int i = 0; i < sizeof(nvm->SecureElement.KeyList) / sizeof(nvm->SecureElement.KeyList[0]); i++) {
+        Key_t* key = &nvm->SecureElement.KeyList[i];
+
+        if (key->KeyID == ((PrecomputedPort == 0) ? NWK_S_ENC_KEY : APP_S_KEY)) {
+            payloadKey = key->KeyValue;
+        } else if (key->KeyID == F_NWK_S_INT_KEY) {
+            micKey = key->KeyValue;
+        }
+    }
+
+    if (payloadKey == NULL || micKey == NULL) {
+        return;
+    }
+
+    aes_precompute_clear();
+
+    // L of the CMAC subkeys, the encryption of a zero block
+    memset(block, 0x00, sizeof(block));
+    aes_precompute(micKey, block);
+
+    // B0 of the MIC, as built by ComputeCmacB0( ), for a frame without FOpts:
+    // MHDR, FHDR and FPort in front of the payload. Direction 0 is uplink.
+    block[0] = 0x49;
+    StoreUint32(&block[6], nvm->MacGroup2.DevAddr);
+    StoreUint32(&block[10], fCntUp);
+    block[15] = 9 + PrecomputedSize;
+    aes_precompute(micKey, block);
+
+    // keystream blocks Ai of the FRMPayload, as built by PayloadEncrypt( )
+    block[0] = 0x01;
+    block[14] = 0x00;
+
+    for (int i = 0; (i * 16) < PrecomputedSize && (i + 2) < AES_PRECOMPUTE_SIZE; i++) {
+        block[15] = i + 1;
+        aes_precompute(payloadKey, block);
+    }
+
+    UplinkPrecomputed = true;
+    PrecomputedFCntUp = fCntUp;
+    PrecomputedDevAddr = nvm->MacGroup2.DevAddr;
+}
+#endif
+
+static void UplinkQueueRemove( UplinkQueueEntry_t* entry )
+{
+    entry->Used = false;
+
+    UplinkQueueStats.depth--;
+}
+
+static uint32_t UplinkQueueDepth( void )
+{
+    uint32_t depth;
+
+    UPLINK_QUEUE_LOCK( );
+    depth = UplinkQueueStats.depth;
+    UPLINK_QUEUE_UNLOCK( );
+
+    return depth;
+}
+
+static UplinkQueueEntry_t* UplinkQueueNext( uint64_t now )
+{
+    UplinkQueueEntry_t* entry = NULL;
+
+    UPLINK_QUEUE_LOCK( );
+    for (int i = 0; i < PICO_LORAWAN_UPLINK_QUEUE_SIZE; i++) {
+        UplinkQueueEntry_t* candidate = &UplinkQueue[i];
+
+        if (!candidate->Used) {
+            continue;
+        }
+
+        if (candidate->Deadline != 0 && now > candidate->Deadline) {
+            UplinkQueueRemove(candidate);
+            UplinkQueueStats.dropped_expired++;
+            continue;
+        }
+
+        if (entry == NULL || candidate->Priority > entry->Priority ||
+            (candidate->Priority == entry->Priority && candidate->Sequence < entry->Sequence)) {
+            entry = candidate;
+        }
+    }
+
+    UplinkSending = entry;
+    UPLINK_QUEUE_UNLOCK( );
+
+    return entry;
+}
+
+static void UplinkQueueRelease( UplinkQueueEntry_t* entry, uint32_t* counter )
+{
+    UPLINK_QUEUE_LOCK( );
+    // kept in the queue when not counted as done
+    if (counter != NULL) {
+        UplinkQueueRemove(entry);
+        (*counter)++;
+    }
+
+    UplinkSending = NULL;
+    UPLINK_QUEUE_UNLOCK( );
+}
+
+static void UplinkQueueProcess( void )
+{
+    uint64_t now;
+
+    if (UplinkQueueDepth() == 0 || LmHandlerIsBusy()) {
+        return;
+    }
+
+    now = to_us_since_boot(get_absolute_time());
+
+    if (now < UplinkRetryTime) {
+        return;
+    }
+
+    // the frame counters of the next uplink are past the block in flash, a
+    // reset would reuse them
+    if (FCntUpLimitChanged && lorawan_nvm_sync() != 0) {
+        return;
+    }
+
+    while (UplinkQueueDepth() > 0) {
+        UplinkQueueEntry_t* entry = UplinkQueueNext(now);
+        LmHandlerAppData_t appData;
+        MibRequestConfirm_t mibReq;
+        LoRaMacTxInfo_t txInfo;
+        bool flush = false;
+        uint32_t txCount;
+        uint64_t txOnAirTime;
+        uint64_t sendStart;
+
+        if (entry == NULL) {
+            return;
+        }
+
+        // LmHandlerSend( ) sends an empty frame instead of an uplink that no
+        // longer fits, the datarate may have dropped or MAC commands be
+        // pending since it was queued
+        if (LoRaMacQueryTxPossible(entry->BufferSize, &txInfo) != LORAMAC_STATUS_OK) {
+            if (entry->Flushed || entry->BufferSize > txInfo.CurrentPossiblePayloadSize) {
+                // too long for the datarate, try the next
+                if (entry->Confirmed != NULL) {
+                    ConfirmedComplete(entry->Confirmed, NULL);
+                }
+
+                UplinkQueueRelease(entry, &UplinkQueueStats.dropped_rejected);
+                continue;
+            }
+
+            // fits without the MAC commands, they go out first in an empty
+            // frame, and the entry is sent after it
+            flush = true;
+        }
+
+        appData.Port = entry->Port;
+        appData.BufferSize = flush ? 0 : entry->BufferSize;
+        appData.Buffer = flush ? NULL : entry->Buffer;
+
+        // the narrowest RX windows measured to be safe at this datarate, ADR
+        // may still step it down in the MAC
+        mibReq.Type = MIB_CHANNELS_DATARATE;
+        LoRaMacMibGetRequestConfirm(&mibReq);
+
+        RxErrorInUse = RxCalibrationGetError(mibReq.Param.ChannelsDatarate);
+        RxTimingStats.rx_error_ms = RxErrorInUse;
+        LmHandlerSetSystemMaxRxError(RxErrorInUse);
+
+        // the radio may already transmit before LmHandlerSend( ) returns
+        txCount = SX1276BoardGetTxCount();
+        txOnAirTime = SX1276BoardGetTxOnAirTime();
+
+        // LmHandlerSend( ) fails without a request when the MAC is busy
+        McpsRequestStatus = LORAMAC_STATUS_BUSY;
+
+        // the latency is of the MAC and radio, the time spent queued is not
+        // the MAC's doing
+        sendStart = to_us_since_boot(get_absolute_time());
+
+        if (LmHandlerSend(&appData, (entry->Confirmed != NULL && !flush) ? LORAMAC_HANDLER_CONFIRMED_MSG : LORAMAC_HANDLER_UNCONFIRMED_MSG) == LORAMAC_HANDLER_SUCCESS) {
+            if (flush) {
+                entry->Flushed = true;
+                UplinkQueueRelease(entry, NULL);
+                return;
+            }
+
+            SendTime = sendStart;
+            SendTimePending = true;
+
+            if (entry->Confirmed != NULL) {
+                entry->Confirmed->TxCount = txCount;
+                entry->Confirmed->TxOnAirTime = txOnAirTime;
+                ConfirmedActive = entry->Confirmed;
+            }
+
+#if PICO_LORAWAN_FAST_AES
+            if (entry->BufferSize != PrecomputedSize || entry->Port != PrecomputedPort) {
+                PrecomputedSize = entry->BufferSize;
+                PrecomputedPort = entry->Port;
+                UplinkPrecomputed = false;
+            }
+#endif
+
+            UplinkQueueRelease(entry, &UplinkQueueStats.sent);
+
+            return;
+        }
+
+        if (McpsRequestStatus == LORAMAC_STATUS_BUSY ||
+            McpsRequestStatus == LORAMAC_STATUS_DUTYCYCLE_RESTRICTED ||
+            McpsRequestStatus == LORAMAC_STATUS_NO_NETWORK_JOINED) {
+            // kept for a later lorawan_process( )
+            UplinkQueueRelease(entry, NULL);
+            return;
+        }
+
+        // refused for good, for example no channel enabled for the datarate,
+        // try the next
+        if (entry->Confirmed != NULL) {
+            ConfirmedComplete(entry->Confirmed, NULL);
+        }
+
+        UplinkQueueRelease(entry, &UplinkQueueStats.dropped_rejected);
+    }
+}
+
+static void UplinkQueueKick( void )
+{
+    // the MAC picks it up from its lorawan_process( )
+    if (MacRemote()) {
+        MacWake();
+        return;
+    }
+
+    UplinkQueueProcess();
+}
+
+static uint8_t TxPossibleSize( void )
+{
+    LoRaMacTxInfo_t txInfo;
+
+    if (MacRemote()) {
+        return __atomic_load_n(&MacTxPossibleSize, __ATOMIC_ACQUIRE);
+    }
+
+    // room left at the current datarate, after pending MAC commands
+    txInfo.MaxPossibleApplicationDataSize = 0;
+    LoRaMacQueryTxPossible(0, &txInfo);
+
+    return txInfo.MaxPossibleApplicationDataSize;
+}
+
+static void ConfirmedComplete( ConfirmedUplink_t* confirmed, LmHandlerTxParams_t* params )
+{
+    struct lorawan_confirmed_result result;
+    uint32_t transmissions;
+
+    memset(&result, 0x00, sizeof(result));
+
+    if (params != NULL) {
+        transmissions = SX1276BoardGetTxCount() - confirmed->TxCount;
+
+        result.sent = true;
+        result.ack_received = params->AckReceived;
+        result.retransmissions = (transmissions > 1) ? (transmissions - 1) : 0;
+        result.datarate = params->Datarate;
+        result.airtime_us = (uint32_t)(SX1276BoardGetTxOnAirTime() - confirmed->TxOnAirTime);
+    }
+
+    // free before the callback, so it can send the next one, other cores or
+    // tasks look for a free slot under the lock
+    UPLINK_QUEUE_LOCK( );
+    confirmed->Used = false;
+    UPLINK_QUEUE_UNLOCK( );
+
+    if (confirmed->Callback != NULL) {
+        confirmed->Callback(confirmed->Handle, &result, confirmed->Context);
+    }
+}
+
+static void RxCalibrationLoad( void )
+{
+    EepromMcuReadBuffer(LORAWAN_RX_CALIBRATION_NVM_ADDR, (uint8_t*)&RxCalibration, sizeof(RxCalibration));
+
+    // erased, or never stored
+    if (RxCalibration.Crc32 != Crc32((uint8_t*)&RxCalibration, sizeof(RxCalibration) - sizeof(RxCalibration.Crc32))) {
+        memset(&RxCalibration, 0x00, sizeof(RxCalibration));
+    }
+}
+
+static void RxCalibrationStore( void )
+{
+    RxCalibration.Crc32 = Crc32((uint8_t*)&RxCalibration, sizeof(RxCalibration) - sizeof(RxCalibration.Crc32));
+
+    EepromMcuWriteBuffer(LORAWAN_RX_CALIBRATION_NVM_ADDR, (uint8_t*)&RxCalibration, sizeof(RxCalibration));
+
+    // not worth a flush of its own while the MAC waits for its RX windows,
+    // it counts towards LORAWAN_NVM_FLUSH_EVERY_N like a context change
+    NvmPendingChanges++;
+}
+
+static uint32_t RxCalibrationGetError( int8_t datarate )
+{
+    MibRequestConfirm_t mibReq;
+    uint32_t driftPpm = RxCalibration.MaxDriftPpm;
+    uint32_t errorUs;
+
+    if (PICO_LORAWAN_RX_CALIBRATION_SAMPLES == 0 || datarate < 0 || datarate >= LORAWAN_RX_CALIBRATION_DATARATES ||
+        RxCalibration.Samples[datarate] < PICO_LORAWAN_RX_CALIBRATION_SAMPLES) {
+        return LORAWAN_DEFAULT_RX_ERROR;
+    }
+
+    // too few downlinks to rule out the usual crystal tolerance
+    if (RxCalibration.DriftSamples < PICO_LORAWAN_RX_CALIBRATION_SAMPLES && driftPpm < LORAWAN_DEFAULT_CLOCK_DRIFT_PPM) {
+        driftPpm = LORAWAN_DEFAULT_CLOCK_DRIFT_PPM;
+    }
+
+    // the clock drifts until the later window
+    mibReq.Type = MIB_RECEIVE_DELAY_2;
+    LoRaMacMibGetRequestConfirm(&mibReq);
+
+    errorUs = RxCalibration.MaxOpenErrorUs[datarate] + driftPpm * mibReq.Param.ReceiveDelay2 / 1000 + LORAWAN_RX_ERROR_MARGIN_US;
+
+    return (errorUs + 999) / 1000;
+}
+
+static void RxCalibrationMeasureWindows( int8_t datarate )
+{
+    SX1276BoardRxWindow_t windows[SX1276_BOARD_RX_WINDOWS];
+    uint8_t count = SX1276BoardGetRxWindows(windows);
+    uint64_t txDoneTime = SX1276BoardGetTxDoneTime();
+    MibRequestConfirm_t mibReq;
+    uint32_t receiveDelay1;
+    uint32_t receiveDelay2;
+    uint8_t minRxSymbols;
+    bool changed = false;
+
+    if (count == 0 || txDoneTime == 0) {
+        return;
+    }
+
+    mibReq.Type = MIB_RECEIVE_DELAY_1;
+    LoRaMacMibGetRequestConfirm(&mibReq);
+    receiveDelay1 = mibReq.Param.ReceiveDelay1;
+
+    mibReq.Type = MIB_RECEIVE_DELAY_2;
+    LoRaMacMibGetRequestConfirm(&mibReq);
+    receiveDelay2 = mibReq.Param.ReceiveDelay2;
+
+    mibReq.Type = MIB_MIN_RX_SYMBOLS;
+    LoRaMacMibGetRequestConfirm(&mibReq);
+    minRxSymbols = mibReq.Param.MinRxSymbols;
+
+    RxTimingStats.uplinks++;
+
+    for (uint8_t i = 0; i < count; i++) {
+        SX1276BoardRxWindow_t* window = &windows[i];
+        uint64_t sinceTxDone = window->OpenTime - txDoneTime;
+        uint32_t timeout;
+        uint32_t defaultTimeout;
+        int32_t offset;
+        int32_t defaultOffset;
+        uint32_t receiveDelay;
+        int64_t error;
+        uint32_t absError;
+        bool complete = false;
+        bool widened = false;
+
+        // FSK, or not a window of this uplink
+        if (window->SymbolTime == 0 || window->OpenTime < txDoneTime || sinceTxDone > (receiveDelay2 + 1000) * 1000ull) {
+            continue;
+        }
+
+        receiveDelay = (sinceTxDone < (receiveDelay1 + receiveDelay2) * 500ull) ? receiveDelay1 : receiveDelay2;
+
+        // where the MAC meant to open the window, and would have with the default error
+        RegionCommonComputeRxWindowParameters(window->SymbolTime, minRxSymbols, RxErrorInUse, Radio.GetWakeupTime(), &timeout, &offset);
+        RegionCommonComputeRxWindowParameters(window->SymbolTime, minRxSymbols, LORAWAN_DEFAULT_RX_ERROR, Radio.GetWakeupTime(), &defaultTimeout, &defaultOffset);
+
+        error = (int64_t)sinceTxDone - ((int64_t)receiveDelay + offset) * 1000;
+        absError = (error < 0) ? -error : error;
+
+        RxTimingStats.windows++;
+        RxTimingStats.last_open_error_us = error;
+
+        if (absError > RxTimingStats.max_open_error_us) {
+            RxTimingStats.max_open_error_us = absError;
+        }
+
+        // a window that received stays on until RX done either way, one that
+        // timed out for its number of symbols
+        if (window->DoneTime != 0) {
+            RxTimingStats.rx_on_saved_us += (int64_t)(offset - defaultOffset) * 1000;
+        } else {
+            RxTimingStats.rx_on_saved_us += ((int64_t)defaultTimeout - timeout) * window->SymbolTime;
+        }
+
+        if (datarate < 0 || datarate >= LORAWAN_RX_CALIBRATION_DATARATES) {
+            continue;
+        }
+
+        if (absError > UINT16_MAX) {
+            absError = UINT16_MAX;
+        }
+
+        if (RxCalibration.Samples[datarate] < PICO_LORAWAN_RX_CALIBRATION_SAMPLES) {
+            RxCalibration.Samples[datarate]++;
+            complete = (RxCalibration.Samples[datarate] == PICO_LORAWAN_RX_CALIBRATION_SAMPLES);
+        }
+
+        if (absError > RxCalibration.MaxOpenErrorUs[datarate]) {
+            RxCalibration.MaxOpenErrorUs[datarate] = absError;
+            widened = true;
+        }
+
+        // RxCalibrationGetError( ) only uses a datarate once its count is
+        // complete, until then samples lost to a reset are measured again
+        if (RxCalibration.Samples[datarate] == PICO_LORAWAN_RX_CALIBRATION_SAMPLES && (complete || widened)) {
+            changed = true;
+        }
+    }
+
+    if (changed && PICO_LORAWAN_RX_CALIBRATION_SAMPLES > 0) {
+        RxCalibrationStore();
+    }
+}
+
+// LoRa time on air of a downlink, explicit header and no payload CRC, see the SX1276 datasheet
+static uint32_t RxTimeOnAir( uint32_t symbolTime, uint8_t size )
+{
+    int32_t sf = SX1276.Settings.LoRa.Datarate;
+    int32_t bitsPerSymbol = 4 * (sf - (SX1276.Settings.LoRa.LowDatarateOptimize ? 2 : 0));
+    int32_t bits = 8 * size - 4 * sf + 28;
+    int32_t symbols = 8;
+
+    if (bits > 0) {
+        symbols += ((bits + bitsPerSymbol - 1) / bitsPerSymbol) * (SX1276.Settings.LoRa.Coderate + 4);
+    }
+
+    // the preamble is followed by 4.25 symbols of sync word
+    return ((SX1276.Settings.LoRa.PreambleLen * 4 + 17) * symbolTime) / 4 + symbols * symbolTime;
+}
+
+static void RxCalibrationMeasureDownlink( uint8_t rxSlot )
+{
+    SX1276BoardRxWindow_t windows[SX1276_BOARD_RX_WINDOWS];
+    uint8_t count = SX1276BoardGetRxWindows(windows);
+    uint64_t txDoneTime = SX1276BoardGetTxDoneTime();
+    SX1276BoardRxWindow_t* window;
+    MibRequestConfirm_t mibReq;
+    uint32_t receiveDelay;
+    uint64_t preambleTime;
+    int64_t drift;
+    uint32_t driftPpm;
+    bool changed = false;
+
+    if ((rxSlot != RX_SLOT_WIN_1 && rxSlot != RX_SLOT_WIN_2) || count == 0 || txDoneTime == 0) {
+        return;
+    }
+
+    // received in the last window opened
+    window = &windows[count - 1];
+
+    if (window->DoneTime == 0 || window->SymbolTime == 0) {
+        return;
+    }
+
+    if (rxSlot == RX_SLOT_WIN_1) {
+        mibReq.Type = MIB_RECEIVE_DELAY_1;
+        LoRaMacMibGetRequestConfirm(&mibReq);
+        receiveDelay = mibReq.Param.ReceiveDelay1;
+    } else {
+        mibReq.Type = MIB_RECEIVE_DELAY_2;
+        LoRaMacMibGetRequestConfirm(&mibReq);
+        receiveDelay = mibReq.Param.ReceiveDelay2;
+    }
+
+    // the gateway starts the preamble the receive delay after the end of the uplink
+    preambleTime = window->DoneTime - RxTimeOnAir(window->SymbolTime, SX1276.Settings.LoRaPacketHandler.Size);
+    drift = (int64_t)(preambleTime - txDoneTime) - (int64_t)receiveDelay * 1000;
+    driftPpm = (uint32_t)(((drift < 0) ? -drift : drift) * 1000 / receiveDelay);
+
+    RxTimingStats.downlinks++;
+
+    if (driftPpm > RxTimingStats.max_drift_ppm) {
+        RxTimingStats.max_drift_ppm = driftPpm;
+    }
+
+    if (PICO_LORAWAN_RX_CALIBRATION_SAMPLES == 0) {
+        return;
+    }
+
+    if (driftPpm > UINT16_MAX) {
+        driftPpm = UINT16_MAX;
+    }
+
+    if (RxCalibration.DriftSamples < PICO_LORAWAN_RX_CALIBRATION_SAMPLES) {
+        RxCalibration.DriftSamples++;
+        changed = (RxCalibration.DriftSamples == PICO_LORAWAN_RX_CALIBRATION_SAMPLES);
+    }
+
+    if (driftPpm > RxCalibration.MaxDriftPpm) {
+        RxCalibration.MaxDriftPpm = driftPpm;
+        changed = true;
+    }
+
+    if (changed) {
+        RxCalibrationStore();
+    }
+}
+
+static void EventSet( uint32_t events )
+{
+    __atomic_fetch_or(&Events, events, __ATOMIC_RELEASE);
+
+    // wakes the application from lorawan_wait_event( )
+#if PICO_LORAWAN_CORE1
+    __sev();
+#else
+    if (__atomic_load_n(&MacTask, __ATOMIC_ACQUIRE) != NULL) {
+        Os->semaphore_give(EventSemaphore);
+    }
+#endif
+}
+
+static bool EventWaitUntil( absolute_time_t timeoutTime )
+{
+#if !PICO_LORAWAN_CORE1
+    int64_t timeoutUs;
+
+    if (MacRemote()) {
+        timeoutUs = absolute_time_diff_us(get_absolute_time(), timeoutTime);
+
+        if (timeoutUs <= 0) {
+            return true;
+        }
+
+        if (timeoutUs >= (int64_t)LORAWAN_OS_WAIT_FOREVER * 1000) {
+            return !Os->semaphore_take(EventSemaphore, LORAWAN_OS_WAIT_FOREVER);
+        }
+
+        return !Os->semaphore_take(EventSemaphore, (uint32_t)((timeoutUs + 999) / 1000));
+    }
+#endif
+
+    return best_effort_wfe_or_timeout(timeoutTime);
+}
+
+static bool MacRemote( void )
+{
+#if PICO_LORAWAN_CORE1
+    return Core1Launched && get_core_num() == 0;
+#else
+    void* task = __atomic_load_n(&MacTask, __ATOMIC_ACQUIRE);
+
+    return task != NULL && Os->task_self() != task;
+#endif
+}
+
+static void MacWake( void )
+{
+#if PICO_LORAWAN_CORE1
+    __sev();
+#else
+    Os->semaphore_give(MacSemaphore);
+#endif
+}
+
+static int MacCall( MacCommand_t command, uint32_t arg0, uint32_t arg1 )
+{
+    uint32_t request;
+    int result = -1;
+
+#if !PICO_LORAWAN_CORE1
+    Os->mutex_lock(MacMailboxMutex);
+
+    // a call that timed out may still be running
+    if (!MacWaitReply(MacMailbox.Request)) {
+        Os->mutex_unlock(MacMailboxMutex);
+
+        return -1;
+    }
+#endif
+
+    request = MacMailbox.Request + 1;
+
+    MacMailbox.Command = command;
+    MacMailbox.Args[0] = arg0;
+    MacMailbox.Args[1] = arg1;
+
+    // pairs with the acquire in MacServe( ), the command is complete
+    __atomic_store_n(&MacMailbox.Request, request, __ATOMIC_RELEASE);
+    MacWake();
+
+    if (MacWaitReply(request)) {
+        result = MacMailbox.Result;
+    }
+
+#if !PICO_LORAWAN_CORE1
+    Os->mutex_unlock(MacMailboxMutex);
+#endif
+
+    return result;
+}
+
+static bool MacWaitReply( uint32_t request )
+{
+    while (__atomic_load_n(&MacMailbox.Reply, __ATOMIC_ACQUIRE) != request) {
+#if PICO_LORAWAN_CORE1
+        __wfe();
+#else
+        if (!Os->semaphore_take(MacReplySemaphore, OsTimeoutMs)) {
+            return false;
+        }
+#endif
+    }
+
+    return true;
+}
+
+static void MacServe( void )
+{
+    uint32_t request = __atomic_load_n(&MacMailbox.Request, __ATOMIC_ACQUIRE);
+    int result = -1;
+
+    if (request != MacMailbox.Reply) {
+        switch (MacMailbox.Command) {
+            case MAC_COMMAND_INIT:
+                result = lorawan_init(MacSx1276Settings, (LoRaMacRegion_t)MacMailbox.Args[0]);
+                MacRunning = (result == 0);
+
+                if (MacRunning) {
+                    MacPublish();
+                }
+                break;
+
+            case MAC_COMMAND_ERASE_NVM:
+                result = lorawan_erase_nvm();
+                break;
+
+            case MAC_COMMAND_NVM_SYNC:
+                result = lorawan_nvm_sync();
+                break;
+
+            case MAC_COMMAND_NVM_SET_FLUSH_POLICY:
+                result = lorawan_nvm_set_flush_policy((enum lorawan_nvm_flush_policy)MacMailbox.Args[0], MacMailbox.Args[1]);
+                break;
+
+            case MAC_COMMAND_NVM_SET_FCNT_RESERVATION:
+                result = lorawan_nvm_set_fcnt_reservation((uint16_t)MacMailbox.Args[0]);
+                break;
+        }
+
+        MacMailbox.Result = result;
+
+        // pairs with the acquire in MacWaitReply( )
+        __atomic_store_n(&MacMailbox.Reply, request, __ATOMIC_RELEASE);
+
+#if PICO_LORAWAN_CORE1
+        __sev();
+#else
+        Os->semaphore_give(MacReplySemaphore);
+#endif
+    }
+
+    if (MacRunning && __atomic_exchange_n(&MacJoinRequested, false, __ATOMIC_ACQ_REL)) {
+        lorawan_join();
+    }
+}
+
+static void MacPublish( void )
+{
+    __atomic_store_n(&MacJoined, LmHandlerJoinStatus() == LORAMAC_HANDLER_SET, __ATOMIC_RELEASE);
+    __atomic_store_n(&MacTxPossibleSize, TxPossibleSize(), __ATOMIC_RELEASE);
+}
+
+static void MacLoop( void )
+{
+    for (;;) {
+        int sleep = 1;
+
+        MacServe();
+
+        if (MacRunning) {
+            sleep = lorawan_process();
+
+            MacPublish();
+        }
+
+        if (sleep) {
+            MacIdle();
+        }
+    }
+}
+
+static void MacIdle( void )
+{
+    uint64_t now = to_us_since_boot(get_absolute_time());
+    uint64_t wakeTime = 0;
+
+    // duty cycle restricted uplinks wait for a time the MAC does not track
+    if (UplinkQueueDepth() > 0 && UplinkRetryTime > now) {
+        wakeTime = UplinkRetryTime;
+    }
+
+#if PICO_LORAWAN_CORE1
+    // woken by the radio and timer interrupts of this core, or by core 0
+    if (wakeTime != 0) {
+        best_effort_wfe_or_timeout(from_us_since_boot(wakeTime));
+    } else {
+        __wfe();
+    }
+#else
+    // woken by the radio and timer interrupts, or by an API call, that may
+    // have come in while processing
+    if (Os->semaphore_take(MacSemaphore, 0)) {
+        return;
+    }
+
+    // the virtual clock of the host port only moves while the MAC waits
+    if (BoardAdvanceTime(wakeTime)) {
+        return;
+    }
+
+    Os->semaphore_take(MacSemaphore, (wakeTime != 0) ? (uint32_t)((wakeTime - now + 999) / 1000) : LORAWAN_OS_WAIT_FOREVER);
+#endif
+}
+
+#if PICO_LORAWAN_CORE1
+static void Core1Main( void )
+{
+    MacLoop();
+}
+#else
+static void MacTaskMain( void* arg )
+{
+    // before task_create( ) returns to lorawan_init( ), interrupts may
+    // already need to wake this task
+    __atomic_store_n(&MacTask, Os->task_self(), __ATOMIC_RELEASE);
+
+    MacLoop();
+}
+#endif
+
+static void UplinkQueueLock( uint32_t* mask )
+{
+#if !PICO_LORAWAN_CORE1
+    if (Os != NULL) {
+        Os->mutex_lock(UplinkQueueMutex);
+        return;
+    }
+#endif
+
+    BoardCriticalSectionBegin(mask);
+}
+
+static void UplinkQueueUnlock( uint32_t* mask )
+{
+#if !PICO_LORAWAN_CORE1
+    if (Os != NULL) {
+        Os->mutex_unlock(UplinkQueueMutex);
+        return;
+    }
+#endif
+
+    BoardCriticalSectionEnd(mask);
+}
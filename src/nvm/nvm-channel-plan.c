@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <string.h>
+
+#include "nvm-channel-plan.h"
+
+static uint32_t array_size(const struct nvm_channel_plan* plan)
+{
+    return (uint32_t)plan->channel_count * plan->entry_size;
+}
+
+static int delta_find(const struct nvm_channel_plan* plan, uint16_t channel)
+{
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->index[i] == channel) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void default_get(const struct nvm_channel_plan* plan, uint16_t channel, uint8_t* entry)
+{
+    if (plan->defaults != NULL && channel < plan->default_count) {
+        memcpy(entry, (const uint8_t*)plan->defaults + channel * plan->entry_size, plan->entry_size);
+    } else {
+        memset(entry, 0x00, plan->entry_size);
+    }
+}
+
+static void channel_get(const struct nvm_channel_plan* plan, uint16_t channel, uint8_t* entry)
+{
+    int i = delta_find(plan, channel);
+
+    if (i >= 0) {
+        memcpy(entry, plan->deltas[i], plan->entry_size);
+    } else {
+        default_get(plan, channel, entry);
+    }
+}
+
+// the channel after size bytes of data were written at offset of the array
+static void channel_patch(const struct nvm_channel_plan* plan, uint16_t channel, uint32_t offset, const uint8_t* data, uint32_t size, uint8_t* entry)
+{
+    uint32_t start = (uint32_t)channel * plan->entry_size;
+    uint32_t end = start + plan->entry_size;
+    uint32_t lo = (offset > start) ? offset : start;
+    uint32_t hi = (offset + size < end) ? offset + size : end;
+
+    channel_get(plan, channel, entry);
+
+    if (lo < hi) {
+        memcpy(entry + (lo - start), data + (lo - offset), hi - lo);
+    }
+}
+
+// false if the channel needs a delta and the record is full
+static bool delta_set(struct nvm_channel_plan* plan, uint16_t channel, const uint8_t* entry)
+{
+    uint8_t fallback[NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE];
+    int i = delta_find(plan, channel);
+
+    default_get(plan, channel, fallback);
+
+    if (memcmp(entry, fallback, plan->entry_size) == 0) {
+        if (i >= 0) {
+            plan->count--;
+
+            memmove(&plan->index[i], &plan->index[i + 1], plan->count - i);
+            memmove(plan->deltas[i], plan->deltas[i + 1], (plan->count - i) * sizeof(plan->deltas[0]));
+        }
+
+        return true;
+    }
+
+    if (i < 0) {
+        if (plan->count == plan->max_deltas) {
+            return false;
+        }
+
+        // keep the index ascending
+        for (i = plan->count; i > 0 && plan->index[i - 1] > channel; i--) {
+            plan->index[i] = plan->index[i - 1];
+            memcpy(plan->deltas[i], plan->deltas[i - 1], sizeof(plan->deltas[0]));
+        }
+
+        plan->index[i] = channel;
+        plan->count++;
+    }
+
+    memcpy(plan->deltas[i], entry, plan->entry_size);
+
+    return true;
+}
+
+static int record_load(struct nvm_channel_plan* plan)
+{
+    uint8_t header[NVM_CHANNEL_PLAN_HEADER_SIZE];
+    uint32_t address = plan->address + NVM_CHANNEL_PLAN_HEADER_SIZE;
+    uint32_t magic;
+    uint8_t count;
+
+    if (plan->loaded) {
+        return 0;
+    }
+
+    if (plan->read(plan->context, plan->address, header, sizeof(header)) != 0) {
+        return -1;
+    }
+
+    magic = header[0] | (header[1] << 8) | (header[2] << 16) | ((uint32_t)header[3] << 24);
+    count = header[5];
+
+    plan->raw = true;
+    plan->count = 0;
+
+    if (magic == NVM_CHANNEL_PLAN_MAGIC && header[4] == plan->region && count <= plan->max_deltas) {
+        plan->raw = false;
+
+        for (uint8_t i = 0; i < count; i++) {
+            if (plan->read(plan->context, address, &plan->index[i], 1) != 0 ||
+                plan->read(plan->context, address + 1, plan->deltas[i], plan->entry_size) != 0) {
+                return -1;
+            }
+
+            // torn, handed back as it is, the CRC of the region group fails
+            if (plan->index[i] >= plan->channel_count || (i > 0 && plan->index[i] <= plan->index[i - 1])) {
+                plan->raw = true;
+                break;
+            }
+
+            address += 1 + plan->entry_size;
+        }
+
+        plan->count = plan->raw ? 0 : count;
+    }
+
+    plan->loaded = true;
+
+    return 0;
+}
+
+static int record_store(struct nvm_channel_plan* plan, uint32_t* written)
+{
+    uint8_t record[NVM_CHANNEL_PLAN_HEADER_SIZE + NVM_CHANNEL_PLAN_MAX_DELTAS * (1 + NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE)];
+    uint32_t size = NVM_CHANNEL_PLAN_HEADER_SIZE;
+
+    record[0] = NVM_CHANNEL_PLAN_MAGIC & 0xff;
+    record[1] = (NVM_CHANNEL_PLAN_MAGIC >> 8) & 0xff;
+    record[2] = (NVM_CHANNEL_PLAN_MAGIC >> 16) & 0xff;
+    record[3] = (NVM_CHANNEL_PLAN_MAGIC >> 24) & 0xff;
+    record[4] = plan->region;
+    record[5] = plan->count;
+    record[6] = 0x00;
+    record[7] = 0x00;
+
+    for (uint8_t i = 0; i < plan->count; i++) {
+        record[size] = plan->index[i];
+        memcpy(&record[size + 1], plan->deltas[i], plan->entry_size);
+
+        size += 1 + plan->entry_size;
+    }
+
+    if (plan->write(plan->context, plan->address, record, size) != 0) {
+        return -1;
+    }
+
+    plan->raw = false;
+    *written += size;
+
+    return 0;
+}
+
+// the record is full, the array is stored as it is
+static int array_store(struct nvm_channel_plan* plan, uint32_t offset, const uint8_t* data, uint32_t size, uint32_t* written)
+{
+    uint8_t entry[NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE];
+
+    for (uint16_t channel = 0; channel < plan->channel_count; channel++) {
+        channel_patch(plan, channel, offset, data, size, entry);
+
+        if (plan->write(plan->context, plan->address + channel * plan->entry_size, entry, plan->entry_size) != 0) {
+            return -1;
+        }
+
+        *written += plan->entry_size;
+    }
+
+    plan->raw = true;
+    plan->count = 0;
+
+    return 0;
+}
+
+int nvm_channel_plan_init(struct nvm_channel_plan* plan)
+{
+    uint32_t room;
+
+    plan->loaded = false;
+
+    if (plan->entry_size == 0 || plan->entry_size > NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE ||
+        plan->channel_count > 256 || plan->default_count > plan->channel_count ||
+        array_size(plan) < NVM_CHANNEL_PLAN_HEADER_SIZE || plan->address + array_size(plan) > 0x10000) {
+        return -1;
+    }
+
+    room = (array_size(plan) - NVM_CHANNEL_PLAN_HEADER_SIZE) / (1 + plan->entry_size);
+    plan->max_deltas = (room < NVM_CHANNEL_PLAN_MAX_DELTAS) ? room : NVM_CHANNEL_PLAN_MAX_DELTAS;
+
+    return 0;
+}
+
+int nvm_channel_plan_read(struct nvm_channel_plan* plan, uint16_t address, uint8_t* data, uint16_t size)
+{
+    uint32_t start = plan->address;
+    uint32_t end = start + array_size(plan);
+    uint32_t lo = (address > start) ? address : start;
+    uint32_t hi = ((uint32_t)address + size < end) ? (uint32_t)address + size : end;
+    uint8_t entry[NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE];
+
+    if (lo >= hi) {
+        return plan->read(plan->context, address, data, size);
+    }
+
+    if (record_load(plan) != 0) {
+        return -1;
+    }
+
+    if (plan->raw) {
+        return plan->read(plan->context, address, data, size);
+    }
+
+    if (address < lo && plan->read(plan->context, address, data, lo - address) != 0) {
+        return -1;
+    }
+
+    if ((uint32_t)address + size > hi && plan->read(plan->context, hi, data + (hi - address), address + size - hi) != 0) {
+        return -1;
+    }
+
+    for (uint32_t i = lo; i < hi; ) {
+        uint16_t channel = (i - start) / plan->entry_size;
+        uint32_t skip = (i - start) % plan->entry_size;
+        uint32_t n = (plan->entry_size - skip < hi - i) ? plan->entry_size - skip : hi - i;
+
+        channel_get(plan, channel, entry);
+        memcpy(data + (i - address), entry + skip, n);
+
+        i += n;
+    }
+
+    return 0;
+}
+
+int nvm_channel_plan_write(struct nvm_channel_plan* plan, uint16_t address, const uint8_t* data, uint16_t size, uint32_t* written)
+{
+    uint32_t start = plan->address;
+    uint32_t end = start + array_size(plan);
+    uint32_t lo = (address > start) ? address : start;
+    uint32_t hi = ((uint32_t)address + size < end) ? (uint32_t)address + size : end;
+    uint8_t current[NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE];
+    uint8_t entry[NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE];
+    bool changed;
+
+    *written = 0;
+
+    if (lo >= hi) {
+        if (plan->write(plan->context, address, data, size) != 0) {
+            return -1;
+        }
+
+        *written = size;
+
+        return 0;
+    }
+
+    if (record_load(plan) != 0) {
+        return -1;
+    }
+
+    if (address < lo) {
+        if (plan->write(plan->context, address, data, lo - address) != 0) {
+            return -1;
+        }
+
+        *written += lo - address;
+    }
+
+    if ((uint32_t)address + size > hi) {
+        if (plan->write(plan->context, hi, data + (hi - address), address + size - hi) != 0) {
+            return -1;
+        }
+
+        *written += address + size - hi;
+    }
+
+    data += lo - address;
+
+    // only a write of the whole array turns it back into a record
+    if (plan->raw && (lo != start || hi != end)) {
+        if (plan->write(plan->context, lo, data, hi - lo) != 0) {
+            return -1;
+        }
+
+        *written += hi - lo;
+
+        return 0;
+    }
+
+    // every channel is written, the ones left at their defaults need no delta
+    changed = plan->raw;
+
+    if (plan->raw) {
+        plan->count = 0;
+    }
+
+    for (uint32_t channel = (lo - start) / plan->entry_size; channel * plan->entry_size < hi - start; channel++) {
+        channel_get(plan, channel, current);
+        channel_patch(plan, channel, lo - start, data, hi - lo, entry);
+
+        if (memcmp(entry, current, plan->entry_size) == 0) {
+            continue;
+        }
+
+        changed = true;
+
+        if (!delta_set(plan, channel, entry)) {
+            return array_store(plan, lo - start, data, hi - lo, written);
+        }
+    }
+
+    // nothing to write when the channels did not change
+    if (!changed) {
+        return 0;
+    }
+
+    return record_store(plan, written);
+}
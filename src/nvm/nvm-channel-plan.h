@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _NVM_CHANNEL_PLAN_H_
+#define _NVM_CHANNEL_PLAN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Channel array of the LoRaMac-node NVM context, stored as the channels that
+ * differ from the defaults of the region.
+ *
+ * LoRaMac-node stores the region group of its context as it is, with room
+ * for up to 96 channels. Most of them keep the defaults the region set up:
+ * all of them in US915 and AU915, where the network only masks channels, and
+ * all but the CFList ones in the other regions. This layer sits between the
+ * EEPROM emulation and its backend. It stores the array as a record of the
+ * channels that differ from a const table of defaults, and hands the array
+ * back as it was when it is read.
+ *
+ * The record starts at the address of the array, with a magic number where
+ * the frequency of the first channel would be:
+ *
+ *   magic (4), region (1), count (1), reserved (2),
+ *   count times: channel index (1), channel (entry_size)
+ *
+ * The array is stored as it is, and read back as it is, when more channels
+ * differ than the record has room for, or when the image holds no record of
+ * this region, like the images written before this layer. A write of the
+ * whole array turns it back into a record when it can.
+ */
+
+#define NVM_CHANNEL_PLAN_MAGIC          (0x4c504843)    // 1.28 GHz, never a channel frequency
+#define NVM_CHANNEL_PLAN_HEADER_SIZE    (8)
+#define NVM_CHANNEL_PLAN_MAX_DELTAS     (16)
+#define NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE (16)
+
+struct nvm_channel_plan {
+    // set before nvm_channel_plan_init()
+    uint16_t address;               // of the channel array in the image
+    uint16_t channel_count;         // up to 256
+    uint16_t entry_size;            // bytes of a channel
+    const void* defaults;           // default_count channels, the ones after them default to zeros
+    uint16_t default_count;
+    uint8_t region;
+
+    int (*read)(void* context, uint16_t address, void* data, uint16_t size);        // -1 on failure
+    int (*write)(void* context, uint16_t address, const void* data, uint16_t size);
+    void* context;
+
+    // the record, loaded from the image on first use
+    bool loaded;
+    bool raw;                       // the image holds the array as it is
+    uint8_t max_deltas;
+    uint8_t count;
+    uint8_t index[NVM_CHANNEL_PLAN_MAX_DELTAS];     // ascending
+    uint8_t deltas[NVM_CHANNEL_PLAN_MAX_DELTAS][NVM_CHANNEL_PLAN_MAX_ENTRY_SIZE];
+};
+
+/*!
+ * \brief Checks the layout and forgets the record, the image is read again
+ *        on the next access
+ *
+ * \retval 0 on success, -1 invalid layout
+ */
+int nvm_channel_plan_init(struct nvm_channel_plan* plan);
+
+/*!
+ * \brief Reads from the image, the channel array as it was written
+ *
+ * \retval 0 on success, -1 if the backend failed
+ */
+int nvm_channel_plan_read(struct nvm_channel_plan* plan, uint16_t address, uint8_t* data, uint16_t size);
+
+/*!
+ * \brief Writes to the image, the part in the channel array as changes to
+ *        the record
+ *
+ * \param [OUT] written Number of bytes handed to the backend
+ *
+ * \retval 0 on success, -1 if the backend failed
+ */
+int nvm_channel_plan_write(struct nvm_channel_plan* plan, uint16_t address, const uint8_t* data, uint16_t size, uint32_t* written);
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvm-cow.h"
+
+// flash is compared in chunks of this size, to keep them off the stack
+#define NVM_COW_CHUNK_SIZE  (32)
+
+static uint32_t page_count(const struct nvm_cow* cow)
+{
+    return cow->flash->sector_size / cow->flash->page_size;
+}
+
+static bool flash_equals(const struct nvm_cow* cow, uint32_t offset, const uint8_t* data, uint32_t size)
+{
+    uint8_t chunk[NVM_COW_CHUNK_SIZE];
+
+    for (uint32_t i = 0; i < size; i += NVM_COW_CHUNK_SIZE) {
+        uint32_t n = (size - i < NVM_COW_CHUNK_SIZE) ? size - i : NVM_COW_CHUNK_SIZE;
+
+        cow->flash->read(cow->flash->context, offset + i, chunk, n);
+
+        if (memcmp(chunk, data + i, n) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// programming can only clear bits
+static bool flash_is_programmable(const struct nvm_cow* cow, uint32_t offset, const uint8_t* data, uint32_t size)
+{
+    uint8_t chunk[NVM_COW_CHUNK_SIZE];
+
+    for (uint32_t i = 0; i < size; i += NVM_COW_CHUNK_SIZE) {
+        uint32_t n = (size - i < NVM_COW_CHUNK_SIZE) ? size - i : NVM_COW_CHUNK_SIZE;
+
+        cow->flash->read(cow->flash->context, offset + i, chunk, n);
+
+        for (uint32_t j = 0; j < n; j++) {
+            if ((chunk[j] & data[i + j]) != data[i + j]) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool flash_is_blank(const struct nvm_cow* cow, uint32_t offset, uint32_t size)
+{
+    uint8_t chunk[NVM_COW_CHUNK_SIZE];
+
+    for (uint32_t i = 0; i < size; i += NVM_COW_CHUNK_SIZE) {
+        uint32_t n = (size - i < NVM_COW_CHUNK_SIZE) ? size - i : NVM_COW_CHUNK_SIZE;
+
+        cow->flash->read(cow->flash->context, offset + i, chunk, n);
+
+        for (uint32_t j = 0; j < n; j++) {
+            if (chunk[j] != 0xff) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool buffer_is_blank(const uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        if (data[i] != 0xff) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int page_load(struct nvm_cow* cow, uint32_t page)
+{
+    uint32_t page_size = cow->flash->page_size;
+    uint8_t* buffer = malloc(page_size);
+
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    cow->flash->read(cow->flash->context, page * page_size, buffer, page_size);
+    cow->pages[page] = buffer;
+
+    cow->stats.buffer_bytes += page_size;
+
+    if (cow->stats.buffer_bytes > cow->stats.max_buffer_bytes) {
+        cow->stats.max_buffer_bytes = cow->stats.buffer_bytes;
+    }
+
+    return 0;
+}
+
+static void page_free(struct nvm_cow* cow, uint32_t page)
+{
+    free(cow->pages[page]);
+    cow->pages[page] = NULL;
+
+    cow->stats.buffer_bytes -= cow->flash->page_size;
+}
+
+int nvm_cow_init(struct nvm_cow* cow, const struct nvm_journal_flash* flash)
+{
+    if (flash->sector_count != 1 || flash->page_size == 0 || flash->sector_size % flash->page_size != 0 ||
+        flash->sector_size / flash->page_size > NVM_COW_MAX_PAGES) {
+        return -1;
+    }
+
+    memset(cow, 0x00, sizeof(*cow));
+    cow->flash = flash;
+
+    return 0;
+}
+
+void nvm_cow_read(struct nvm_cow* cow, uint32_t offset, uint8_t* data, uint32_t size)
+{
+    uint32_t page_size = cow->flash->page_size;
+
+    while (size > 0) {
+        uint32_t page = offset / page_size;
+        uint32_t page_offset = offset % page_size;
+        uint32_t n = (size < page_size - page_offset) ? size : page_size - page_offset;
+
+        if (cow->pages[page] != NULL) {
+            memcpy(data, cow->pages[page] + page_offset, n);
+        } else {
+            cow->flash->read(cow->flash->context, offset, data, n);
+        }
+
+        offset += n;
+        data += n;
+        size -= n;
+    }
+}
+
+int nvm_cow_write(struct nvm_cow* cow, uint32_t offset, const uint8_t* data, uint32_t size)
+{
+    uint32_t page_size = cow->flash->page_size;
+
+    while (size > 0) {
+        uint32_t page = offset / page_size;
+        uint32_t page_offset = offset % page_size;
+        uint32_t n = (size < page_size - page_offset) ? size : page_size - page_offset;
+
+        if (cow->pages[page] == NULL) {
+            // rewriting what flash already holds needs no buffer
+            if (flash_equals(cow, offset, data, n)) {
+                offset += n;
+                data += n;
+                size -= n;
+                continue;
+            }
+
+            if (page_load(cow, page) != 0) {
+                return -1;
+            }
+        }
+
+        memcpy(cow->pages[page] + page_offset, data, n);
+
+        offset += n;
+        data += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+int nvm_cow_flush(struct nvm_cow* cow)
+{
+    uint32_t page_size = cow->flash->page_size;
+    uint32_t changed = 0;
+    bool erase = false;
+
+    for (uint32_t page = 0; page < page_count(cow); page++) {
+        if (cow->pages[page] == NULL) {
+            continue;
+        }
+
+        // changed back since it was buffered
+        if (flash_equals(cow, page * page_size, cow->pages[page], page_size)) {
+            page_free(cow, page);
+            continue;
+        }
+
+        changed |= (1u << page);
+
+        if (!erase && !flash_is_programmable(cow, page * page_size, cow->pages[page], page_size)) {
+            erase = true;
+        }
+    }
+
+    if (changed == 0) {
+        return 0;
+    }
+
+    if (erase) {
+        // the erase takes the pages that weren't changed with it
+        for (uint32_t page = 0; page < page_count(cow); page++) {
+            if (cow->pages[page] == NULL && !flash_is_blank(cow, page * page_size, page_size)) {
+                if (page_load(cow, page) != 0) {
+                    return -1;
+                }
+            }
+        }
+
+        if (cow->flash->erase(cow->flash->context, 0) != 0) {
+            return -1;
+        }
+    } else {
+        cow->stats.skipped_erases++;
+    }
+
+    for (uint32_t page = 0; page < page_count(cow); page++) {
+        if (cow->pages[page] == NULL) {
+            continue;
+        }
+
+        if (erase ? !buffer_is_blank(cow->pages[page], page_size) : (changed & (1u << page))) {
+            if (cow->flash->program(cow->flash->context, page * page_size, cow->pages[page], page_size) != 0) {
+                return -1;
+            }
+        }
+    }
+
+    for (uint32_t page = 0; page < page_count(cow); page++) {
+        if (cow->pages[page] != NULL) {
+            page_free(cow, page);
+        }
+    }
+
+    return 0;
+}
+
+bool nvm_cow_is_dirty(const struct nvm_cow* cow)
+{
+    for (uint32_t page = 0; page < page_count(cow); page++) {
+        if (cow->pages[page] != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _NVM_COW_H_
+#define _NVM_COW_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "nvm-journal.h"
+
+/*
+ * Copy-on-write NVM image, without a RAM copy of it.
+ *
+ * The image is kept in a single flash sector and read straight from flash.
+ * The first write to a page copies it into a page buffer taken from the
+ * heap, later reads and writes of that page use the buffer. A flush writes
+ * the buffered pages back and frees them. When a change sets bits and the
+ * sector must be erased, the other pages that aren't blank are buffered for
+ * the duration of the flush, so they can be programmed again.
+ */
+
+#define NVM_COW_MAX_PAGES   (32)
+
+struct nvm_cow_stats {
+    uint32_t skipped_erases;
+    uint32_t buffer_bytes;      // held in page buffers now
+    uint32_t max_buffer_bytes;
+};
+
+struct nvm_cow {
+    const struct nvm_journal_flash* flash;  // sector_count must be 1
+
+    uint8_t* pages[NVM_COW_MAX_PAGES];
+
+    struct nvm_cow_stats stats;
+};
+
+/*!
+ * \brief Initializes the image, no flash is read or written
+ *
+ * \retval 0 on success, -1 invalid configuration
+ */
+int nvm_cow_init(struct nvm_cow* cow, const struct nvm_journal_flash* flash);
+
+/*!
+ * \brief Reads from the image, page buffers first, flash otherwise
+ */
+void nvm_cow_read(struct nvm_cow* cow, uint32_t offset, uint8_t* data, uint32_t size);
+
+/*!
+ * \brief Updates the image, buffering the pages with bytes that change
+ *
+ * \retval 0 on success, -1 if a page buffer could not be allocated, the
+ *         bytes of that page and the ones after it are left unchanged
+ */
+int nvm_cow_write(struct nvm_cow* cow, uint32_t offset, const uint8_t* data, uint32_t size);
+
+/*!
+ * \brief Writes the buffered pages to flash and frees them
+ *
+ * \retval 0 on success, -1 on failure, the buffers are kept for a retry
+ */
+int nvm_cow_flush(struct nvm_cow* cow);
+
+/*!
+ * \brief Checks if there are changes that have not been flushed
+ */
+bool nvm_cow_is_dirty(const struct nvm_cow* cow);
+
+#endif
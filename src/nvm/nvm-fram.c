@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+
+#include "nvm-fram.h"
+
+#define FRAM_BAUDRATE   (10 * 1000 * 1000)
+
+#define FRAM_CMD_WREN   (0x06)
+#define FRAM_CMD_WRDI   (0x04)
+#define FRAM_CMD_RDSR   (0x05)
+#define FRAM_CMD_READ   (0x03)
+#define FRAM_CMD_WRITE  (0x02)
+
+#define FRAM_SR_WEL     (0x02)
+
+// writes since the last flush, they are already in the FRAM
+static bool nvm_fram_dirty;
+
+static void nvm_fram_command(const struct lorawan_nvm_fram_settings* fram, uint8_t command)
+{
+    gpio_put(fram->nss, 0);
+    spi_write_blocking(fram->inst, &command, 1);
+    gpio_put(fram->nss, 1);
+}
+
+static void nvm_fram_begin(const struct lorawan_nvm_fram_settings* fram, uint8_t command, uint16_t address)
+{
+    uint8_t header[3] = { command, address >> 8, address & 0xff };
+
+    gpio_put(fram->nss, 0);
+    spi_write_blocking(fram->inst, header, sizeof(header));
+}
+
+static int nvm_fram_init(void* context)
+{
+    const struct lorawan_nvm_fram_settings* fram = context;
+    uint8_t command = FRAM_CMD_RDSR;
+    uint8_t status;
+
+    spi_init(fram->inst, FRAM_BAUDRATE);
+
+    gpio_set_function(fram->mosi, GPIO_FUNC_SPI);
+    gpio_set_function(fram->miso, GPIO_FUNC_SPI);
+    gpio_set_function(fram->sck, GPIO_FUNC_SPI);
+
+    gpio_init(fram->nss);
+    gpio_put(fram->nss, 1);
+    gpio_set_dir(fram->nss, GPIO_OUT);
+
+    // the FRAM has no ID command on every part, check that it latches the
+    // write enable instead
+    nvm_fram_command(fram, FRAM_CMD_WREN);
+
+    gpio_put(fram->nss, 0);
+    spi_write_blocking(fram->inst, &command, 1);
+    spi_read_blocking(fram->inst, 0x00, &status, 1);
+    gpio_put(fram->nss, 1);
+
+    nvm_fram_command(fram, FRAM_CMD_WRDI);
+
+    nvm_fram_dirty = false;
+
+    return (status & FRAM_SR_WEL) ? 0 : -1;
+}
+
+static int nvm_fram_read(void* context, uint16_t address, void* data, uint16_t size)
+{
+    const struct lorawan_nvm_fram_settings* fram = context;
+
+    if ((uint32_t)address + size > fram->size) {
+        return -1;
+    }
+
+    nvm_fram_begin(fram, FRAM_CMD_READ, address);
+    spi_read_blocking(fram->inst, 0x00, data, size);
+    gpio_put(fram->nss, 1);
+
+    return 0;
+}
+
+static int nvm_fram_write(void* context, uint16_t address, const void* data, uint16_t size)
+{
+    const struct lorawan_nvm_fram_settings* fram = context;
+
+    if ((uint32_t)address + size > fram->size) {
+        return -1;
+    }
+
+    // the write enable latch is cleared at the end of every write
+    nvm_fram_command(fram, FRAM_CMD_WREN);
+
+    nvm_fram_begin(fram, FRAM_CMD_WRITE, address);
+    spi_write_blocking(fram->inst, data, size);
+    gpio_put(fram->nss, 1);
+
+    nvm_fram_dirty = true;
+
+    return 0;
+}
+
+static uint32_t nvm_fram_size(void* context)
+{
+    const struct lorawan_nvm_fram_settings* fram = context;
+
+    return fram->size;
+}
+
+static int nvm_fram_flush(void* context)
+{
+    if (!nvm_fram_dirty) {
+        return 1;
+    }
+
+    nvm_fram_dirty = false;
+
+    return 0;
+}
+
+const struct lorawan_nvm_backend lorawan_nvm_fram = {
+    .init = nvm_fram_init,
+    .read = nvm_fram_read,
+    .write = nvm_fram_write,
+    .flush = nvm_fram_flush,
+    .process = NULL,
+    .size = nvm_fram_size
+};
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _NVM_FRAM_H_
+#define _NVM_FRAM_H_
+
+#include "pico/lorawan.h"
+
+struct lorawan_nvm_fram_settings {
+    spi_inst_t* inst;   // may be the bus of the SX1276, with its own nss
+    uint mosi;
+    uint miso;
+    uint sck;
+    uint nss;
+    uint32_t size;      // bytes, 16 bit addressed parts up to 64 KB
+};
+
+/*!
+ * NVM backend for lorawan_nvm_set_backend( ) on an SPI FRAM, such as the
+ * MB85RS64V or FM25V02. Writes go to the FRAM right away, byte by byte, it is
+ * never erased. The context is a struct lorawan_nvm_fram_settings.
+ */
+extern const struct lorawan_nvm_backend lorawan_nvm_fram;
+
+#endif
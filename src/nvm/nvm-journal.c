@@ -0,0 +1,546 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "nvm-journal.h"
+
+#define NVM_JOURNAL_MAGIC           (0x4a4e4c50) // "PLNJ"
+#define NVM_JOURNAL_RECORD_ALIGN    (4)
+#define NVM_JOURNAL_ERASED_FIELD    (0xffff)
+
+// set in the size of the last record of a flush, the records of a flush are
+// only replayed once it is there, so a flush is all or nothing
+#define NVM_JOURNAL_RECORD_LAST     (0x8000)
+
+// compact in the background once the active sector is this full (percent)
+#define NVM_JOURNAL_COMPACT_THRESHOLD (75)
+
+struct nvm_journal_sector_header {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t image_size;
+    uint16_t reserved;
+    uint32_t crc;
+};
+
+struct nvm_journal_record_header {
+    uint16_t offset;
+    uint16_t size;
+    uint32_t crc;
+};
+
+static uint32_t crc32_update(uint32_t crc, const void* data, uint32_t size)
+{
+    const uint8_t* bytes = data;
+
+    while (size--) {
+        crc ^= *bytes++;
+
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+
+    return crc;
+}
+
+static uint32_t record_size(const struct nvm_journal_record_header* header)
+{
+    return header->size & ~NVM_JOURNAL_RECORD_LAST;
+}
+
+static uint32_t record_crc(const struct nvm_journal_record_header* header, const uint8_t* data)
+{
+    uint32_t crc = 0xffffffff;
+
+    crc = crc32_update(crc, header, offsetof(struct nvm_journal_record_header, crc));
+    crc = crc32_update(crc, data, record_size(header));
+
+    return ~crc;
+}
+
+static uint32_t header_crc(const struct nvm_journal_sector_header* header)
+{
+    return ~crc32_update(0xffffffff, header, offsetof(struct nvm_journal_sector_header, crc));
+}
+
+static uint32_t align_up(uint32_t value, uint32_t align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+static uint32_t sector_base(const struct nvm_journal* journal, int32_t sector)
+{
+    return (uint32_t)sector * journal->flash->sector_size;
+}
+
+static int32_t next_sector(const struct nvm_journal* journal)
+{
+    return (journal->active_sector + 1) % (int32_t)journal->flash->sector_count;
+}
+
+static bool range_is_blank(const struct nvm_journal* journal, uint32_t offset, uint32_t size)
+{
+    const struct nvm_journal_flash* flash = journal->flash;
+    uint8_t buffer[128];
+
+    while (size) {
+        uint32_t length = (size > sizeof(buffer)) ? sizeof(buffer) : size;
+
+        flash->read(flash->context, offset, buffer, length);
+
+        for (uint32_t i = 0; i < length; i++) {
+            if (buffer[i] != 0xff) {
+                return false;
+            }
+        }
+
+        offset += length;
+        size -= length;
+    }
+
+    return true;
+}
+
+static bool sector_is_blank(const struct nvm_journal* journal, int32_t sector)
+{
+    return range_is_blank(journal, sector_base(journal, sector), journal->flash->sector_size);
+}
+
+static void mark_dirty(struct nvm_journal* journal, uint32_t chunk)
+{
+    journal->dirty[chunk / 32] |= (1u << (chunk % 32));
+}
+
+static bool is_dirty(const struct nvm_journal* journal, uint32_t chunk)
+{
+    return (journal->dirty[chunk / 32] & (1u << (chunk % 32))) != 0;
+}
+
+/*
+ * Page writer, bytes are gathered in a page sized buffer that is programmed
+ * once full. Bytes of the page outside of the record stay 0xff, so programming
+ * a partially used page again leaves the existing records untouched.
+ */
+static void writer_flush_page(struct nvm_journal* journal)
+{
+    const struct nvm_journal_flash* flash = journal->flash;
+
+    if (!journal->page_used) {
+        return;
+    }
+
+    if (flash->program(flash->context, journal->page_offset, journal->page, flash->page_size) != 0) {
+        journal->error = -1;
+    }
+
+    journal->stats.pages_programmed++;
+    journal->page_used = false;
+}
+
+static void writer_put(struct nvm_journal* journal, uint32_t offset, const void* data, uint32_t size)
+{
+    const struct nvm_journal_flash* flash = journal->flash;
+    const uint8_t* bytes = data;
+
+    while (size) {
+        uint32_t page_offset = offset & ~(flash->page_size - 1);
+        uint32_t in_page = offset - page_offset;
+        uint32_t length = flash->page_size - in_page;
+
+        if (length > size) {
+            length = size;
+        }
+
+        if (!journal->page_used || journal->page_offset != page_offset) {
+            writer_flush_page(journal);
+
+            memset(journal->page, 0xff, flash->page_size);
+            journal->page_offset = page_offset;
+            journal->page_used = true;
+        }
+
+        memcpy(journal->page + in_page, bytes, length);
+
+        offset += length;
+        bytes += length;
+        size -= length;
+    }
+}
+
+static void append_record(struct nvm_journal* journal, uint32_t offset, uint32_t size, bool last)
+{
+    uint32_t base = sector_base(journal, journal->active_sector);
+    struct nvm_journal_record_header header = {
+        .offset = offset,
+        .size = size | (last ? NVM_JOURNAL_RECORD_LAST : 0)
+    };
+
+    header.crc = record_crc(&header, journal->image + offset);
+
+    writer_put(journal, base + journal->write_offset, &header, sizeof(header));
+    writer_put(journal, base + journal->write_offset + sizeof(header), journal->image + offset, size);
+
+    journal->write_offset += align_up(sizeof(header) + size, NVM_JOURNAL_RECORD_ALIGN);
+    journal->stats.records++;
+}
+
+static uint32_t snapshot_size(const struct nvm_journal* journal)
+{
+    uint32_t size = journal->image_size;
+
+    // trailing erased bytes are implied
+    while (size && journal->image[size - 1] == 0xff) {
+        size--;
+    }
+
+    return align_up(size, NVM_JOURNAL_RECORD_ALIGN);
+}
+
+static uint32_t compacted_size(const struct nvm_journal* journal)
+{
+    return sizeof(struct nvm_journal_sector_header) + sizeof(struct nvm_journal_record_header) + snapshot_size(journal);
+}
+
+static int erase_next(struct nvm_journal* journal)
+{
+    const struct nvm_journal_flash* flash = journal->flash;
+    int32_t sector = next_sector(journal);
+
+    if (journal->next_erased) {
+        return 0;
+    }
+
+    if (!sector_is_blank(journal, sector)) {
+        if (flash->erase(flash->context, sector_base(journal, sector)) != 0) {
+            return -1;
+        }
+
+        journal->stats.erases++;
+    }
+
+    journal->next_erased = true;
+
+    return 0;
+}
+
+static int compact(struct nvm_journal* journal)
+{
+    struct nvm_journal_sector_header header;
+    uint32_t size = snapshot_size(journal);
+
+    if (compacted_size(journal) > journal->flash->sector_size) {
+        return -1;
+    }
+
+    if (erase_next(journal) != 0) {
+        return -1;
+    }
+
+    journal->active_sector = next_sector(journal);
+    journal->seq++;
+    journal->write_offset = sizeof(header);
+    journal->next_erased = false;
+    journal->compact_pending = false;
+    journal->error = 0;
+
+    header.magic = NVM_JOURNAL_MAGIC;
+    header.seq = journal->seq;
+    header.image_size = journal->image_size;
+    header.reserved = 0xffff;
+    header.crc = header_crc(&header);
+
+    writer_put(journal, sector_base(journal, journal->active_sector), &header, sizeof(header));
+    append_record(journal, 0, size, true);
+    writer_flush_page(journal);
+
+    journal->stats.compactions++;
+
+    if (journal->error) {
+        // the sector is left in an unknown state, start over in the next one
+        journal->compact_pending = true;
+        return -1;
+    }
+
+    memset(journal->dirty, 0x00, sizeof(journal->dirty));
+
+    return 0;
+}
+
+/*
+ * \retval 1 valid record, 0 end of the journal, -1 damaged record
+ */
+static int read_record(struct nvm_journal* journal, uint32_t offset, struct nvm_journal_record_header* header, bool apply)
+{
+    const struct nvm_journal_flash* flash = journal->flash;
+    uint32_t crc = 0xffffffff;
+    uint32_t size;
+
+    if ((offset + sizeof(*header)) > flash->sector_size) {
+        return 0;
+    }
+
+    flash->read(flash->context, sector_base(journal, journal->active_sector) + offset, header, sizeof(*header));
+
+    if (header->offset == NVM_JOURNAL_ERASED_FIELD && header->size == NVM_JOURNAL_ERASED_FIELD) {
+        return 0;
+    }
+
+    size = record_size(header);
+
+    if ((header->offset + size) > journal->image_size ||
+        (offset + sizeof(*header) + size) > flash->sector_size) {
+        return -1;
+    }
+
+    // check the record before touching the image
+    crc = crc32_update(crc, header, offsetof(struct nvm_journal_record_header, crc));
+
+    for (uint32_t i = 0; i < size; i += sizeof(journal->page)) {
+        uint32_t length = size - i;
+
+        if (length > sizeof(journal->page)) {
+            length = sizeof(journal->page);
+        }
+
+        flash->read(flash->context, sector_base(journal, journal->active_sector) + offset + sizeof(*header) + i, journal->page, length);
+        crc = crc32_update(crc, journal->page, length);
+    }
+
+    if (~crc != header->crc) {
+        return -1;
+    }
+
+    if (apply) {
+        flash->read(flash->context, sector_base(journal, journal->active_sector) + offset + sizeof(*header), journal->image + header->offset, size);
+    }
+
+    return 1;
+}
+
+static bool replay_sector(struct nvm_journal* journal, int32_t sector)
+{
+    struct nvm_journal_record_header record;
+    uint32_t offset = sizeof(struct nvm_journal_sector_header);
+    uint32_t committed;
+    int result;
+
+    journal->active_sector = sector;
+
+    // the first record must be a snapshot, check it before overwriting the image
+    if (read_record(journal, offset, &record, false) != 1 || record.offset != 0 ||
+        !(record.size & NVM_JOURNAL_RECORD_LAST)) {
+        return false;
+    }
+
+    // find the end of the last flush that made it to flash completely
+    committed = offset;
+
+    while ((result = read_record(journal, offset, &record, false)) == 1) {
+        offset += align_up(sizeof(record) + record_size(&record), NVM_JOURNAL_RECORD_ALIGN);
+
+        if (record.size & NVM_JOURNAL_RECORD_LAST) {
+            committed = offset;
+        }
+    }
+
+    memset(journal->image, 0xff, journal->image_size);
+
+    for (uint32_t apply = sizeof(struct nvm_journal_sector_header); apply < committed; ) {
+        read_record(journal, apply, &record, true);
+
+        apply += align_up(sizeof(record) + record_size(&record), NVM_JOURNAL_RECORD_ALIGN);
+    }
+
+    journal->write_offset = offset;
+
+    // a damaged record, the records of an incomplete flush, or anything but
+    // erased flash after the last record, is a torn write and new records
+    // can't be appended behind it
+    if (result < 0 || offset != committed ||
+        !range_is_blank(journal, sector_base(journal, sector) + offset, journal->flash->sector_size - offset)) {
+        journal->compact_pending = true;
+    }
+
+    return true;
+}
+
+int nvm_journal_init(struct nvm_journal* journal, const struct nvm_journal_flash* flash, uint8_t* image, uint32_t image_size)
+{
+    uint32_t tried = 0;
+
+    if (flash->sector_count < 2 || flash->sector_count > 32 || flash->page_size > NVM_JOURNAL_MAX_PAGE_SIZE ||
+        image_size > NVM_JOURNAL_MAX_IMAGE_SIZE || (image_size % NVM_JOURNAL_CHUNK_SIZE)) {
+        return -1;
+    }
+
+    memset(journal, 0x00, sizeof(*journal));
+
+    journal->flash = flash;
+    journal->image = image;
+    journal->image_size = image_size;
+    journal->active_sector = -1;
+
+    // try the sectors from the newest to the oldest, until one replays
+    for (uint32_t attempt = 0; attempt < flash->sector_count; attempt++) {
+        struct nvm_journal_sector_header header;
+        int32_t newest = -1;
+        uint32_t newest_seq = 0;
+
+        for (uint32_t sector = 0; sector < flash->sector_count; sector++) {
+            if (tried & (1u << sector)) {
+                continue;
+            }
+
+            flash->read(flash->context, sector_base(journal, sector), &header, sizeof(header));
+
+            if (header.magic != NVM_JOURNAL_MAGIC || header.crc != header_crc(&header) ||
+                header.image_size != image_size) {
+                tried |= (1u << sector);
+                continue;
+            }
+
+            if (newest < 0 || (int32_t)(header.seq - newest_seq) > 0) {
+                newest = sector;
+                newest_seq = header.seq;
+            }
+        }
+
+        if (newest < 0) {
+            break;
+        }
+
+        tried |= (1u << newest);
+
+        if (replay_sector(journal, newest)) {
+            journal->seq = newest_seq;
+            journal->next_erased = sector_is_blank(journal, next_sector(journal));
+
+            return 0;
+        }
+    }
+
+    journal->active_sector = -1;
+    journal->seq = 0;
+    journal->next_erased = sector_is_blank(journal, next_sector(journal));
+
+    return 1;
+}
+
+void nvm_journal_write(struct nvm_journal* journal, uint32_t offset, const uint8_t* data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++) {
+        if (journal->image[offset + i] != data[i]) {
+            journal->image[offset + i] = data[i];
+
+            mark_dirty(journal, (offset + i) / NVM_JOURNAL_CHUNK_SIZE);
+        }
+    }
+}
+
+void nvm_journal_mark_all(struct nvm_journal* journal)
+{
+    for (uint32_t chunk = 0; chunk < journal->image_size / NVM_JOURNAL_CHUNK_SIZE; chunk++) {
+        mark_dirty(journal, chunk);
+    }
+}
+
+bool nvm_journal_is_dirty(const struct nvm_journal* journal)
+{
+    for (uint32_t i = 0; i < sizeof(journal->dirty) / sizeof(journal->dirty[0]); i++) {
+        if (journal->dirty[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int nvm_journal_flush(struct nvm_journal* journal)
+{
+    uint32_t chunks = journal->image_size / NVM_JOURNAL_CHUNK_SIZE;
+    uint32_t needed = 0;
+    uint32_t runs = 0;
+
+    if (!nvm_journal_is_dirty(journal)) {
+        return 0;
+    }
+
+    journal->stats.flushes++;
+
+    // size up the delta records, one per run of dirty chunks
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        uint32_t run = 0;
+
+        while ((chunk + run) < chunks && is_dirty(journal, chunk + run)) {
+            run++;
+        }
+
+        if (run) {
+            needed += align_up(sizeof(struct nvm_journal_record_header) + run * NVM_JOURNAL_CHUNK_SIZE, NVM_JOURNAL_RECORD_ALIGN);
+            runs++;
+            chunk += run;
+        }
+    }
+
+    if (journal->active_sector < 0 || journal->compact_pending ||
+        (journal->write_offset + needed) > journal->flash->sector_size) {
+        return compact(journal);
+    }
+
+    journal->error = 0;
+
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        uint32_t run = 0;
+
+        while ((chunk + run) < chunks && is_dirty(journal, chunk + run)) {
+            run++;
+        }
+
+        if (run) {
+            append_record(journal, chunk * NVM_JOURNAL_CHUNK_SIZE, run * NVM_JOURNAL_CHUNK_SIZE, --runs == 0);
+            chunk += run;
+        }
+    }
+
+    writer_flush_page(journal);
+
+    if (journal->error) {
+        journal->compact_pending = true;
+        return -1;
+    }
+
+    memset(journal->dirty, 0x00, sizeof(journal->dirty));
+
+    return 0;
+}
+
+bool nvm_journal_process(struct nvm_journal* journal)
+{
+    uint32_t erases = journal->stats.erases;
+
+    if (!journal->next_erased) {
+        if (erase_next(journal) == 0) {
+            journal->stats.background_erases += journal->stats.erases - erases;
+        }
+
+        return true;
+    }
+
+    if (journal->active_sector >= 0 &&
+        (journal->compact_pending ||
+        ((journal->write_offset * 100) > (journal->flash->sector_size * NVM_JOURNAL_COMPACT_THRESHOLD) &&
+        compacted_size(journal) < journal->write_offset))) {
+        compact(journal);
+
+        return true;
+    }
+
+    return false;
+}
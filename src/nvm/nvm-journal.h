@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _NVM_JOURNAL_H_
+#define _NVM_JOURNAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Append-only, wear-leveled NVM journal.
+ *
+ * The NVM image is stored over a ring of flash sectors. Every sector starts
+ * with a header and a full snapshot of the image, followed by delta records
+ * that only hold the bytes that changed since. When the active sector is
+ * full, the image is compacted into a fresh snapshot in the next sector of
+ * the ring. Sectors are erased ahead of time by nvm_journal_process(), so
+ * flushes normally only program pages.
+ *
+ * On boot, the sector with the highest sequence number and a valid
+ * snapshot is replayed up to the last flush whose records are all valid, a
+ * flush interrupted by a power loss is dropped as a whole.
+ */
+
+#define NVM_JOURNAL_MAX_IMAGE_SIZE  (4096)
+#define NVM_JOURNAL_MAX_PAGE_SIZE   (256)
+
+// granularity of the dirty tracking, and of the delta records
+#define NVM_JOURNAL_CHUNK_SIZE      (16)
+
+struct nvm_journal_flash {
+    uint32_t sector_size;
+    uint32_t page_size;
+    uint32_t sector_count;
+
+    void* context;
+
+    // offsets are relative to the start of the ring, erase and program are
+    // always sector and page aligned
+    void (*read)(void* context, uint32_t offset, void* data, uint32_t size);
+    int (*erase)(void* context, uint32_t offset);
+    int (*program)(void* context, uint32_t offset, const void* data, uint32_t size);
+};
+
+struct nvm_journal_stats {
+    uint32_t flushes;
+    uint32_t records;
+    uint32_t compactions;
+    uint32_t erases;
+    uint32_t background_erases;
+    uint32_t pages_programmed;
+};
+
+struct nvm_journal {
+    const struct nvm_journal_flash* flash;
+
+    uint8_t* image;
+    uint32_t image_size;
+
+    uint32_t dirty[NVM_JOURNAL_MAX_IMAGE_SIZE / NVM_JOURNAL_CHUNK_SIZE / 32];
+
+    int32_t active_sector;  // -1 when no sector holds a valid snapshot
+    uint32_t seq;
+    uint32_t write_offset;  // within the active sector
+    bool next_erased;
+    bool compact_pending;   // the active sector has a damaged tail
+
+    uint8_t page[NVM_JOURNAL_MAX_PAGE_SIZE];
+    uint32_t page_offset;
+    bool page_used;
+    int error;
+
+    struct nvm_journal_stats stats;
+};
+
+/*!
+ * \brief Recovers the newest valid image from flash into image
+ *
+ * \retval 0 image recovered, 1 no journal found (image is left untouched),
+ *         -1 invalid configuration
+ */
+int nvm_journal_init(struct nvm_journal* journal, const struct nvm_journal_flash* flash, uint8_t* image, uint32_t image_size);
+
+/*!
+ * \brief Updates the image, marking the bytes that changed for the next flush
+ */
+void nvm_journal_write(struct nvm_journal* journal, uint32_t offset, const uint8_t* data, uint32_t size);
+
+/*!
+ * \brief Marks the whole image for the next flush
+ */
+void nvm_journal_mark_all(struct nvm_journal* journal);
+
+/*!
+ * \brief Appends the changes to flash, compacting to the next sector when the
+ *        active one is full
+ *
+ * \retval 0 on success, -1 on failure
+ */
+int nvm_journal_flush(struct nvm_journal* journal);
+
+/*!
+ * \brief Performs background maintenance, erasing the next sector of the ring
+ *        and compacting the active sector when it is nearly full
+ *
+ * \retval true if flash was erased or programmed
+ */
+bool nvm_journal_process(struct nvm_journal* journal);
+
+/*!
+ * \brief Checks if there are changes that have not been flushed
+ */
+bool nvm_journal_is_dirty(const struct nvm_journal* journal);
+
+#endif
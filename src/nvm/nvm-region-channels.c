@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <stddef.h>
+
+#include "nvm-region-channels.h"
+
+#ifdef REGION_AS923
+#include "RegionAS923.h"
+#endif
+#ifdef REGION_AU915
+#include "RegionAU915.h"
+#endif
+#ifdef REGION_CN779
+#include "RegionCN779.h"
+#endif
+#ifdef REGION_EU433
+#include "RegionEU433.h"
+#endif
+#ifdef REGION_EU868
+#include "RegionEU868.h"
+#endif
+#ifdef REGION_IN865
+#include "RegionIN865.h"
+#endif
+#ifdef REGION_KR920
+#include "RegionKR920.h"
+#endif
+#ifdef REGION_RU864
+#include "RegionRU864.h"
+#endif
+#ifdef REGION_US915
+#include "RegionUS915.h"
+#endif
+
+#define ARRAY_LENGTH(a)     (sizeof(a) / sizeof((a)[0]))
+
+#define CHANNELS_8(m, i)    m(i), m(i + 1), m(i + 2), m(i + 3), m(i + 4), m(i + 5), m(i + 6), m(i + 7)
+
+// as RegionXXInitDefaults( ) sets them up, the network only masks the fixed
+// plans of US915 and AU915, and adds channels to the others with a CFList
+
+#ifdef REGION_AS923
+static const ChannelParams_t as923_channels[] = { AS923_LC1, AS923_LC2 };
+#endif
+
+#ifdef REGION_AU915
+#define AU915_125KHZ(i)     { 915200000 + (i) * 200000, 0, { (DR_5 << 4) | DR_0 }, 0 }
+#define AU915_500KHZ(i)     { 915900000 + (i) * 1600000, 0, { (DR_6 << 4) | DR_6 }, 0 }
+
+static const ChannelParams_t au915_channels[] = {
+    CHANNELS_8(AU915_125KHZ, 0), CHANNELS_8(AU915_125KHZ, 8), CHANNELS_8(AU915_125KHZ, 16), CHANNELS_8(AU915_125KHZ, 24),
+    CHANNELS_8(AU915_125KHZ, 32), CHANNELS_8(AU915_125KHZ, 40), CHANNELS_8(AU915_125KHZ, 48), CHANNELS_8(AU915_125KHZ, 56),
+    CHANNELS_8(AU915_500KHZ, 0)
+};
+
+_Static_assert(ARRAY_LENGTH(au915_channels) == AU915_MAX_NB_CHANNELS, "AU915 has 64 + 8 channels");
+#endif
+
+#ifdef REGION_CN779
+static const ChannelParams_t cn779_channels[] = { CN779_LC1, CN779_LC2, CN779_LC3 };
+#endif
+
+#ifdef REGION_EU433
+static const ChannelParams_t eu433_channels[] = { EU433_LC1, EU433_LC2, EU433_LC3 };
+#endif
+
+#ifdef REGION_EU868
+static const ChannelParams_t eu868_channels[] = { EU868_LC1, EU868_LC2, EU868_LC3 };
+#endif
+
+#ifdef REGION_IN865
+static const ChannelParams_t in865_channels[] = { IN865_LC1, IN865_LC2, IN865_LC3 };
+#endif
+
+#ifdef REGION_KR920
+static const ChannelParams_t kr920_channels[] = { KR920_LC1, KR920_LC2, KR920_LC3 };
+#endif
+
+#ifdef REGION_RU864
+static const ChannelParams_t ru864_channels[] = { RU864_LC1, RU864_LC2 };
+#endif
+
+#ifdef REGION_US915
+#define US915_125KHZ(i)     { 902300000 + (i) * 200000, 0, { (DR_3 << 4) | DR_0 }, 0 }
+#define US915_500KHZ(i)     { 903000000 + (i) * 1600000, 0, { (DR_4 << 4) | DR_4 }, 0 }
+
+static const ChannelParams_t us915_channels[] = {
+    CHANNELS_8(US915_125KHZ, 0), CHANNELS_8(US915_125KHZ, 8), CHANNELS_8(US915_125KHZ, 16), CHANNELS_8(US915_125KHZ, 24),
+    CHANNELS_8(US915_125KHZ, 32), CHANNELS_8(US915_125KHZ, 40), CHANNELS_8(US915_125KHZ, 48), CHANNELS_8(US915_125KHZ, 56),
+    CHANNELS_8(US915_500KHZ, 0)
+};
+
+_Static_assert(ARRAY_LENGTH(us915_channels) == US915_MAX_NB_CHANNELS, "US915 has 64 + 8 channels");
+#endif
+
+const ChannelParams_t* nvm_region_channels(LoRaMacRegion_t region, uint16_t* count)
+{
+    switch (region) {
+#ifdef REGION_AS923
+    case LORAMAC_REGION_AS923:
+        *count = ARRAY_LENGTH(as923_channels);
+        return as923_channels;
+#endif
+#ifdef REGION_AU915
+    case LORAMAC_REGION_AU915:
+        *count = ARRAY_LENGTH(au915_channels);
+        return au915_channels;
+#endif
+#ifdef REGION_CN779
+    case LORAMAC_REGION_CN779:
+        *count = ARRAY_LENGTH(cn779_channels);
+        return cn779_channels;
+#endif
+#ifdef REGION_EU433
+    case LORAMAC_REGION_EU433:
+        *count = ARRAY_LENGTH(eu433_channels);
+        return eu433_channels;
+#endif
+#ifdef REGION_EU868
+    case LORAMAC_REGION_EU868:
+        *count = ARRAY_LENGTH(eu868_channels);
+        return eu868_channels;
+#endif
+#ifdef REGION_IN865
+    case LORAMAC_REGION_IN865:
+        *count = ARRAY_LENGTH(in865_channels);
+        return in865_channels;
+#endif
+#ifdef REGION_KR920
+    case LORAMAC_REGION_KR920:
+        *count = ARRAY_LENGTH(kr920_channels);
+        return kr920_channels;
+#endif
+#ifdef REGION_RU864
+    case LORAMAC_REGION_RU864:
+        *count = ARRAY_LENGTH(ru864_channels);
+        return ru864_channels;
+#endif
+#ifdef REGION_US915
+    case LORAMAC_REGION_US915:
+        *count = ARRAY_LENGTH(us915_channels);
+        return us915_channels;
+#endif
+    default:
+        // CN470 picks its channels from one of several plans at join
+        *count = 0;
+        return NULL;
+    }
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _NVM_REGION_CHANNELS_H_
+#define _NVM_REGION_CHANNELS_H_
+
+#include <stdint.h>
+
+#include "LoRaMac.h"
+
+/*!
+ * \brief Gets the channels a region sets up in the NVM context of
+ *        LoRaMac-node, the defaults of struct nvm_channel_plan
+ *
+ * \param [OUT] count Number of channels in the table
+ *
+ * \retval Const table of the channels, NULL for the regions without one, or
+ *         not built
+ */
+const ChannelParams_t* nvm_region_channels(LoRaMacRegion_t region, uint16_t* count);
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+/*
+ * Not part of the library. pico_lorawan_region_sizes compiles this once per
+ * region, with only that region enabled, each object below in a section of
+ * its own. Their sizes are the RAM LoRaMac-node keeps for the NVM context in
+ * a single region build, and the bytes of it stored in the EEPROM image. The
+ * channel plan is in the region groups, US915, AU915 and CN470 size them for
+ * their fixed plans of up to 96 channels.
+ */
+
+#include "LoRaMac.h"
+
+LoRaMacNvmData_t NvmSizeProbeContext;
+
+RegionNvmDataGroup1_t NvmSizeProbeRegionGroup1;
+
+RegionNvmDataGroup2_t NvmSizeProbeRegionGroup2;
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "os-pthreads.h"
+
+/*!
+ * Binary semaphore, giving it twice before it is taken gives it once
+ */
+typedef struct OsPthreadsSemaphore_s
+{
+    pthread_mutex_t Mutex;
+    pthread_cond_t Cond;
+    bool Given;
+} OsPthreadsSemaphore_t;
+
+static void* os_pthreads_mutex_create(void)
+{
+    pthread_mutex_t* mutex = malloc(sizeof(pthread_mutex_t));
+
+    if (mutex != NULL) {
+        pthread_mutex_init(mutex, NULL);
+    }
+
+    return mutex;
+}
+
+static void os_pthreads_mutex_lock(void* mutex)
+{
+    pthread_mutex_lock((pthread_mutex_t*)mutex);
+}
+
+static void os_pthreads_mutex_unlock(void* mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t*)mutex);
+}
+
+static void* os_pthreads_semaphore_create(void)
+{
+    OsPthreadsSemaphore_t* semaphore = malloc(sizeof(OsPthreadsSemaphore_t));
+    pthread_condattr_t attr;
+
+    if (semaphore == NULL) {
+        return NULL;
+    }
+
+    // timeouts are not affected by changes of the wall clock
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&semaphore->Mutex, NULL);
+    pthread_cond_init(&semaphore->Cond, &attr);
+    semaphore->Given = false;
+
+    pthread_condattr_destroy(&attr);
+
+    return semaphore;
+}
+
+static bool os_pthreads_semaphore_take(void* semaphore, uint32_t timeout_ms)
+{
+    OsPthreadsSemaphore_t* s = (OsPthreadsSemaphore_t*)semaphore;
+    struct timespec deadline;
+    bool taken;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&s->Mutex);
+    while (!s->Given && timeout_ms != 0) {
+        if (timeout_ms == LORAWAN_OS_WAIT_FOREVER) {
+            pthread_cond_wait(&s->Cond, &s->Mutex);
+        } else if (pthread_cond_timedwait(&s->Cond, &s->Mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    taken = s->Given;
+    s->Given = false;
+    pthread_mutex_unlock(&s->Mutex);
+
+    return taken;
+}
+
+static void os_pthreads_semaphore_give(void* semaphore)
+{
+    OsPthreadsSemaphore_t* s = (OsPthreadsSemaphore_t*)semaphore;
+
+    // the simulated interrupts of the host port run on the MAC thread, a
+    // mutex is fine here
+    pthread_mutex_lock(&s->Mutex);
+    s->Given = true;
+    pthread_cond_signal(&s->Cond);
+    pthread_mutex_unlock(&s->Mutex);
+}
+
+typedef struct OsPthreadsTask_s
+{
+    void (*Entry)(void* arg);
+    void* Arg;
+} OsPthreadsTask_t;
+
+static void* os_pthreads_task_entry(void* arg)
+{
+    OsPthreadsTask_t task = *(OsPthreadsTask_t*)arg;
+
+    free(arg);
+
+    task.Entry(task.Arg);
+
+    return NULL;
+}
+
+static void* os_pthreads_task_create(void (*entry)(void* arg), void* arg)
+{
+    OsPthreadsTask_t* task = malloc(sizeof(OsPthreadsTask_t));
+    pthread_t thread;
+
+    if (task == NULL) {
+        return NULL;
+    }
+
+    task->Entry = entry;
+    task->Arg = arg;
+
+    if (pthread_create(&thread, NULL, os_pthreads_task_entry, task) != 0) {
+        free(task);
+
+        return NULL;
+    }
+
+    pthread_detach(thread);
+
+    // pthread_t is an integer on Linux, handles compare with ==
+    return (void*)(uintptr_t)thread;
+}
+
+static void* os_pthreads_task_self(void)
+{
+    return (void*)(uintptr_t)pthread_self();
+}
+
+const struct lorawan_os lorawan_os_pthreads = {
+    .mutex_create = os_pthreads_mutex_create,
+    .mutex_lock = os_pthreads_mutex_lock,
+    .mutex_unlock = os_pthreads_mutex_unlock,
+    .semaphore_create = os_pthreads_semaphore_create,
+    .semaphore_take = os_pthreads_semaphore_take,
+    .semaphore_give = os_pthreads_semaphore_give,
+    .task_create = os_pthreads_task_create,
+    .task_self = os_pthreads_task_self,
+};
@@ -0,0 +1,19 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ */
+
+#ifndef _OS_PTHREADS_H_
+#define _OS_PTHREADS_H_
+
+#include "pico/lorawan.h"
+
+/*!
+ * OS adapter for lorawan_os_init( ) on POSIX threads, the MAC task is a
+ * detached thread. Used by the host port, an RTOS provides its own.
+ */
+extern const struct lorawan_os lorawan_os_pthreads;
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of confirmed uplinks. The simulated network server acknowledges
+ * each confirmed uplink on a set transmission, or never, and the result the
+ * callback gets must match what it saw on air: whether the ACK came, how
+ * many times the frame was retransmitted, the datarate of the last
+ * transmission, and the time on air of all of them.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/lorawan.h"
+
+#include "cmac.h"
+#include "sim-clock.h"
+#include "sx1276-sim.h"
+
+#define LORAWAN_REGION                  LORAMAC_REGION_US915
+#define LORAWAN_DEV_ADDR                0x26011bda
+#define LORAWAN_DEV_ADDR_STR            "26011BDA"
+#define LORAWAN_NETWORK_SESSION_KEY     "2B7E151628AED2A6ABF7158809CF4F3C"
+#define LORAWAN_APP_SESSION_KEY         "3C4FCF098815F7ABA6D2AE2816157E2B"
+
+#define NVM_PATH                        "confirmed_uplink.bin"
+
+// transmissions of a confirmed uplink without an ACK, the network sets it
+// with the redundancy of a LinkADRReq
+#define NB_TRANS                        3
+
+#define CONFIRMED_PORT                  2
+// the network server transmits at the start of RX1, 1 s after the uplink ends
+#define ACK_RX1_DELAY_US                1000000
+#define CONFIRMED_TIMEOUT_MS            60000
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+// the SX1276 model does not care about pins, any distinct numbers do
+struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = spi0,
+        .mosi = 19,
+        .miso = 16,
+        .sck  = 18,
+        .nss  = 8
+    },
+    .reset = 9,
+    .dio0  = 7,
+    .dio1  = 10
+};
+
+const struct lorawan_abp_settings abp_settings = {
+    .device_address = LORAWAN_DEV_ADDR_STR,
+    .network_session_key = LORAWAN_NETWORK_SESSION_KEY,
+    .app_session_key = LORAWAN_APP_SESSION_KEY,
+    .channel_mask = NULL
+};
+
+static uint8_t network_session_key[16];
+static uint32_t downlink_counter = 0;
+
+// what the network server saw of the confirmed uplink in flight
+static struct {
+    uint32_t ack_on;            // transmission to acknowledge, 0 for none
+    bool seen;
+    uint16_t fcnt;
+    uint32_t transmissions;
+    uint64_t airtime_us;
+    int8_t datarate;            // of the last transmission
+} server;
+
+static uint64_t tx_on_air_us = 0;
+
+static struct {
+    uint32_t calls;
+    int handle;
+    struct lorawan_confirmed_result result;
+} callback;
+
+static void parse_key(const char* str, uint8_t* key)
+{
+    for (int i = 0; i < 16; i++) {
+        unsigned int b;
+
+        sscanf(str + i * 2, "%2x", &b);
+
+        key[i] = b;
+    }
+}
+
+// CR 4/5, 8 symbol preamble, explicit header and CRC, as LoRaMac-node sends
+static uint64_t time_on_air_us(int sf, uint32_t bandwidth, uint8_t size)
+{
+    double symbol = (double)(1 << sf) * 1e6 / bandwidth;
+    double payload = ceil((8.0 * size - 4.0 * sf + 28 + 16) / (4.0 * sf));
+
+    if (payload < 0) {
+        payload = 0;
+    }
+
+    return (uint64_t)((8 + 4.25 + 8 + payload * 5) * symbol);
+}
+
+// DR0 to DR3 are SF10 to SF7 on the 125 kHz channels, DR4 SF8 on the 500 kHz ones
+static int8_t us915_datarate(uint8_t size, uint32_t frequency, uint64_t airtime_us)
+{
+    int8_t datarate = -1;
+    uint64_t best = UINT64_MAX;
+
+    if (frequency >= 903000000 && ((frequency - 903000000) % 1600000) == 0) {
+        return (llabs((long long)(time_on_air_us(8, 500000, size) - airtime_us)) < 1000) ? 4 : -1;
+    }
+
+    for (int8_t dr = 0; dr <= 3; dr++) {
+        uint64_t error = llabs((long long)(time_on_air_us(10 - dr, 125000, size) - airtime_us));
+
+        if (error < best) {
+            best = error;
+            datarate = dr;
+        }
+    }
+
+    return (best < 1000) ? datarate : -1;
+}
+
+static void build_block(uint8_t* block, uint32_t counter, uint8_t length)
+{
+    memset(block, 0x00, 16);
+
+    block[0] = 0x49;
+    block[5] = 1; // downlink
+    block[6] = (LORAWAN_DEV_ADDR >> 0) & 0xff;
+    block[7] = (LORAWAN_DEV_ADDR >> 8) & 0xff;
+    block[8] = (LORAWAN_DEV_ADDR >> 16) & 0xff;
+    block[9] = (LORAWAN_DEV_ADDR >> 24) & 0xff;
+    block[10] = (counter >> 0) & 0xff;
+    block[11] = (counter >> 8) & 0xff;
+    block[12] = (counter >> 16) & 0xff;
+    block[13] = (counter >> 24) & 0xff;
+    block[15] = length;
+}
+
+// an unconfirmed LoRaWAN 1.0.x data downlink with the ACK bit, and no FPort
+static uint8_t build_ack(uint8_t* frame)
+{
+    AES_CMAC_CTX cmac;
+    uint8_t block[16];
+    uint8_t mic[16];
+    uint8_t length = 0;
+
+    frame[length++] = 0x60;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 0) & 0xff;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 8) & 0xff;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 16) & 0xff;
+    frame[length++] = (LORAWAN_DEV_ADDR >> 24) & 0xff;
+    frame[length++] = 0x20;
+    frame[length++] = (downlink_counter >> 0) & 0xff;
+    frame[length++] = (downlink_counter >> 8) & 0xff;
+
+    build_block(block, downlink_counter, length);
+
+    AES_CMAC_Init(&cmac);
+    AES_CMAC_SetKey(&cmac, network_session_key);
+    AES_CMAC_Update(&cmac, block, sizeof(block));
+    AES_CMAC_Update(&cmac, frame, length);
+    AES_CMAC_Final(mic, &cmac);
+
+    memcpy(frame + length, mic, 4);
+    length += 4;
+
+    downlink_counter++;
+
+    return length;
+}
+
+static void on_uplink(const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context)
+{
+    SX1276SimStats_t stats;
+    uint64_t airtime_us;
+    uint8_t frame[16];
+    uint16_t fcnt;
+
+    // time on air of this transmission, whatever it carried
+    SX1276SimGetStats(&stats);
+    airtime_us = stats.TxOnAirUs - tx_on_air_us;
+    tx_on_air_us = stats.TxOnAirUs;
+
+    // only look at confirmed data uplinks
+    if (size < 12 || (buffer[0] & 0xe0) != 0x80) {
+        return;
+    }
+
+    fcnt = buffer[6] | (buffer[7] << 8);
+
+    // a retransmission keeps the frame counter
+    if (!server.seen || fcnt != server.fcnt) {
+        server.seen = true;
+        server.fcnt = fcnt;
+        server.transmissions = 0;
+        server.airtime_us = 0;
+    }
+
+    server.transmissions++;
+    server.airtime_us += airtime_us;
+    server.datarate = us915_datarate(size, frequency, airtime_us);
+
+    TEST_ASSERT(server.datarate >= 0);
+
+    if (server.transmissions == server.ack_on) {
+        SX1276SimQueueRxFrameAt(frame, build_ack(frame), -60, 8, SimClockNow() + ACK_RX1_DELAY_US);
+    }
+}
+
+static void on_confirmed(int handle, const struct lorawan_confirmed_result* result, void* context)
+{
+    callback.calls++;
+    callback.handle = handle;
+    callback.result = *result;
+}
+
+static void send_confirmed(uint32_t ack_on)
+{
+    uint32_t data = ack_on;
+    int handle;
+
+    memset(&callback, 0x00, sizeof(callback));
+    server.ack_on = ack_on;
+    server.transmissions = 0;
+
+    handle = lorawan_send_confirmed(&data, sizeof(data), CONFIRMED_PORT, LORAWAN_UPLINK_PRIORITY_TELEMETRY, on_confirmed, NULL);
+    TEST_ASSERT(handle >= 0);
+
+    for (int i = 0; i < CONFIRMED_TIMEOUT_MS / 1000 && callback.calls == 0; i++) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    printf("confirmed uplink: ACK on transmission %u, %u transmissions, ack %d, %u retransmissions, DR%d, %u us on air\n",
+        ack_on, server.transmissions, callback.result.ack_received, callback.result.retransmissions,
+        callback.result.datarate, callback.result.airtime_us);
+
+    TEST_ASSERT(callback.calls == 1);
+    TEST_ASSERT(callback.handle == handle);
+    TEST_ASSERT(callback.result.sent);
+
+    // acknowledged on the transmission the server picked, or retransmitted
+    // until NbTrans ran out
+    TEST_ASSERT(callback.result.ack_received == (ack_on != 0));
+    TEST_ASSERT(server.transmissions == ((ack_on != 0) ? ack_on : NB_TRANS));
+    TEST_ASSERT(callback.result.retransmissions == server.transmissions - 1);
+
+    TEST_ASSERT(callback.result.datarate == server.datarate);
+    TEST_ASSERT(llabs((long long)callback.result.airtime_us - (long long)server.airtime_us) <= 10 * server.transmissions);
+
+    // and nothing more is sent for it
+    for (int i = 0; i < 10; i++) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    TEST_ASSERT(callback.calls == 1);
+    TEST_ASSERT(server.transmissions == ((ack_on != 0) ? ack_on : NB_TRANS));
+}
+
+int main(int argc, char** argv)
+{
+    struct lorawan_uplink_queue_stats stats;
+    MibRequestConfirm_t mibReq;
+
+    parse_key(LORAWAN_NETWORK_SESSION_KEY, network_session_key);
+
+    unlink(NVM_PATH);
+    setenv("PICO_LORAWAN_HOST_EEPROM", NVM_PATH, 1);
+
+    SX1276SimSetTxHandler(on_uplink, NULL);
+
+    TEST_ASSERT(lorawan_init_abp(&sx1276_settings, LORAWAN_REGION, &abp_settings) == 0);
+
+    lorawan_join();
+
+    while (!lorawan_is_joined()) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    mibReq.Type = MIB_CHANNELS_NB_TRANS;
+    mibReq.Param.ChannelsNbTrans = NB_TRANS;
+    TEST_ASSERT(LoRaMacMibSetRequestConfirm(&mibReq) == LORAMAC_STATUS_OK);
+
+    // acknowledged right away, after a retransmission, and never
+    send_confirmed(1);
+    send_confirmed(2);
+    send_confirmed(0);
+
+    lorawan_uplink_queue_get_stats(&stats);
+
+    TEST_ASSERT(stats.sent == 3);
+    TEST_ASSERT(stats.depth == 0);
+
+    unlink(NVM_PATH);
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the uplink frame counter reservation. Each boot of the device
+ * runs in a child process, that loses power at a random point in virtual
+ * time, with its NVM kept in a file across boots. The network server, in
+ * the parent process, checks that no uplink frame counter is ever reused,
+ * and that a boot skips at most the rest of a reservation block.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pico/lorawan.h"
+
+#include "sim-clock.h"
+#include "sx1276-sim.h"
+
+#define LORAWAN_REGION                  LORAMAC_REGION_US915
+#define LORAWAN_DEV_ADDR_STR            "26011BDA"
+#define LORAWAN_NETWORK_SESSION_KEY     "2B7E151628AED2A6ABF7158809CF4F3C"
+#define LORAWAN_APP_SESSION_KEY         "3C4FCF098815F7ABA6D2AE2816157E2B"
+
+#define NVM_PATH                        "fcnt_power_loss.bin"
+
+#define FCNT_RESERVATION                16
+#define BOOTS                           100
+#define UPLINKS_PER_BOOT                50
+// an uplink cycle takes about 3 seconds
+#define UPLINK_CYCLE_MS                 3000
+
+#define EXIT_POWER_LOSS                 3
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+// the SX1276 model does not care about pins, any distinct numbers do
+struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = spi0,
+        .mosi = 19,
+        .miso = 16,
+        .sck  = 18,
+        .nss  = 8
+    },
+    .reset = 9,
+    .dio0  = 7,
+    .dio1  = 10
+};
+
+const struct lorawan_abp_settings abp_settings = {
+    .device_address = LORAWAN_DEV_ADDR_STR,
+    .network_session_key = LORAWAN_NETWORK_SESSION_KEY,
+    .app_session_key = LORAWAN_APP_SESSION_KEY,
+    .channel_mask = NULL
+};
+
+// to the network server, in the parent
+static int server_pipe = -1;
+
+static void on_uplink(const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context)
+{
+    uint16_t fcnt;
+
+    // only look at data uplinks
+    if (size < 12 || (buffer[0] & 0xe0) != 0x40) {
+        return;
+    }
+
+    fcnt = buffer[6] | (buffer[7] << 8);
+
+    // unbuffered, the uplink is on air before power can be lost
+    TEST_ASSERT(write(server_pipe, &fcnt, sizeof(fcnt)) == sizeof(fcnt));
+}
+
+static void on_power_loss(void* context)
+{
+    // skip atexit handlers and stdio buffers, like a brown-out would
+    _exit(EXIT_POWER_LOSS);
+}
+
+// one boot of the device, until power is lost or all uplinks are sent
+static int device_boot(uint64_t power_loss_ms)
+{
+    SimClockEvent_t power_loss;
+    uint32_t sent = 0;
+
+    SX1276SimSetTxHandler(on_uplink, NULL);
+
+    if (power_loss_ms) {
+        SimClockEventInit(&power_loss, on_power_loss, NULL);
+        SimClockSchedule(&power_loss, SimClockNow() + power_loss_ms * 1000);
+    }
+
+    TEST_ASSERT(lorawan_nvm_set_fcnt_reservation(FCNT_RESERVATION) == 0);
+    TEST_ASSERT(lorawan_init_abp(&sx1276_settings, LORAWAN_REGION, &abp_settings) == 0);
+
+    lorawan_join();
+
+    while (!lorawan_is_joined()) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    while (sent < UPLINKS_PER_BOOT) {
+        if (lorawan_send_unconfirmed(&sent, sizeof(sent), 2) == 0) {
+            sent++;
+        }
+
+        lorawan_process_timeout_ms(UPLINK_CYCLE_MS);
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    bool fcnt_seen = false;
+    uint16_t last_fcnt = 0;
+    uint32_t uplinks = 0;
+    uint32_t power_losses = 0;
+
+    srand(1);
+
+    unlink(NVM_PATH);
+    setenv("PICO_LORAWAN_HOST_EEPROM", NVM_PATH, 1);
+
+    for (int boot = 0; boot < BOOTS; boot++) {
+        // the last boot runs to the end
+        uint64_t power_loss_ms = (boot < (BOOTS - 1)) ? 1 + rand() % (UPLINKS_PER_BOOT * UPLINK_CYCLE_MS) : 0;
+        bool first = true;
+        uint16_t fcnt;
+        int fds[2];
+        int status;
+        pid_t pid;
+
+        TEST_ASSERT(pipe(fds) == 0);
+
+        fflush(stdout);
+        pid = fork();
+        TEST_ASSERT(pid >= 0);
+
+        if (pid == 0) {
+            close(fds[0]);
+            server_pipe = fds[1];
+
+            exit(device_boot(power_loss_ms));
+        }
+
+        close(fds[1]);
+
+        while (read(fds[0], &fcnt, sizeof(fcnt)) == sizeof(fcnt)) {
+            if (fcnt_seen) {
+                uint16_t gap = fcnt - last_fcnt - 1;
+
+                if (first) {
+                    // the rest of the block reserved before power was lost
+                    // is skipped, nothing more
+                    TEST_ASSERT(gap <= 2 * FCNT_RESERVATION);
+                } else {
+                    TEST_ASSERT(gap == 0);
+                }
+            }
+
+            fcnt_seen = true;
+            last_fcnt = fcnt;
+            first = false;
+            uplinks++;
+        }
+
+        close(fds[0]);
+
+        TEST_ASSERT(waitpid(pid, &status, 0) == pid);
+        TEST_ASSERT(WIFEXITED(status));
+
+        if (power_loss_ms) {
+            TEST_ASSERT(WEXITSTATUS(status) == EXIT_POWER_LOSS);
+            power_losses++;
+        } else {
+            TEST_ASSERT(WEXITSTATUS(status) == 0);
+        }
+    }
+
+    printf("fcnt power loss: %u uplinks over %u power losses, last frame counter %u\n", uplinks, power_losses, last_fcnt);
+
+    TEST_ASSERT(uplinks >= UPLINKS_PER_BOOT);
+
+    unlink(NVM_PATH);
+
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the channel plan records of the NVM image. The channel array
+ * must read back as it was written, through reboots, whether it is stored as
+ * a record of deltas or as it is, and images without a record must be read
+ * as they are.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvm-channel-plan.h"
+
+#define IMAGE_SIZE      (4096)
+
+// laid out like the region group of a US915 build
+#define ARRAY_ADDRESS   (1000)
+#define CHANNEL_COUNT   (96)
+#define DEFAULT_COUNT   (72)
+#define REGION          (8)
+
+#define ARRAY_SIZE      (CHANNEL_COUNT * sizeof(struct channel))
+#define ARRAY_END       (ARRAY_ADDRESS + ARRAY_SIZE)
+
+#define FUZZ_WRITES     (20000)
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+// like ChannelParams_t of LoRaMac-node
+struct channel {
+    uint32_t frequency;
+    uint32_t rx1_frequency;
+    int8_t dr_range;
+    uint8_t band;
+};
+
+static struct channel defaults[DEFAULT_COUNT];
+
+// what the backend holds, and what the stack wrote
+static uint8_t image[IMAGE_SIZE];
+static uint8_t shadow[IMAGE_SIZE];
+
+static struct nvm_channel_plan plan;
+
+static int image_read(void* context, uint16_t address, void* data, uint16_t size)
+{
+    TEST_ASSERT((uint32_t)address + size <= IMAGE_SIZE);
+
+    memcpy(data, image + address, size);
+
+    return 0;
+}
+
+static int image_write(void* context, uint16_t address, const void* data, uint16_t size)
+{
+    TEST_ASSERT((uint32_t)address + size <= IMAGE_SIZE);
+
+    memcpy(image + address, data, size);
+
+    return 0;
+}
+
+static void reboot(uint8_t region)
+{
+    memset(&plan, 0x00, sizeof(plan));
+
+    plan.address = ARRAY_ADDRESS;
+    plan.channel_count = CHANNEL_COUNT;
+    plan.entry_size = sizeof(struct channel);
+    plan.defaults = defaults;
+    plan.default_count = DEFAULT_COUNT;
+    plan.region = region;
+    plan.read = image_read;
+    plan.write = image_write;
+
+    TEST_ASSERT(nvm_channel_plan_init(&plan) == 0);
+}
+
+static uint32_t stack_write(uint16_t address, const void* data, uint16_t size)
+{
+    uint32_t written;
+
+    memcpy(shadow + address, data, size);
+
+    TEST_ASSERT(nvm_channel_plan_write(&plan, address, data, size, &written) == 0);
+
+    return written;
+}
+
+static uint32_t channel_write(uint16_t channel, const struct channel* value)
+{
+    return stack_write(ARRAY_ADDRESS + channel * sizeof(struct channel), value, sizeof(*value));
+}
+
+static uint32_t array_write(void)
+{
+    return stack_write(ARRAY_ADDRESS, shadow + ARRAY_ADDRESS, ARRAY_SIZE);
+}
+
+static void check_image(void)
+{
+    static uint8_t data[IMAGE_SIZE];
+
+    TEST_ASSERT(nvm_channel_plan_read(&plan, 0, data, IMAGE_SIZE) == 0);
+    TEST_ASSERT(memcmp(data, shadow, IMAGE_SIZE) == 0);
+
+    // and byte by byte, like the CRC check of NvmDataMgmt
+    for (uint32_t i = ARRAY_ADDRESS - 4; i < ARRAY_END + 4; i++) {
+        TEST_ASSERT(nvm_channel_plan_read(&plan, i, data, 1) == 0);
+        TEST_ASSERT(data[0] == shadow[i]);
+    }
+}
+
+static bool is_record(void)
+{
+    uint32_t magic;
+
+    memcpy(&magic, image + ARRAY_ADDRESS, sizeof(magic));
+
+    return magic == NVM_CHANNEL_PLAN_MAGIC;
+}
+
+static void init_defaults(void)
+{
+    memset(defaults, 0x00, sizeof(defaults));
+
+    for (int i = 0; i < DEFAULT_COUNT - 8; i++) {
+        defaults[i].frequency = 902300000 + i * 200000;
+        defaults[i].dr_range = 0x30;
+    }
+
+    for (int i = DEFAULT_COUNT - 8; i < DEFAULT_COUNT; i++) {
+        defaults[i].frequency = 903000000 + (i - (DEFAULT_COUNT - 8)) * 1600000;
+        defaults[i].dr_range = 0x44;
+    }
+}
+
+static void test_fresh_image(void)
+{
+    uint32_t written;
+
+    memset(image, 0xff, sizeof(image));
+    memcpy(shadow, image, sizeof(shadow));
+    reboot(REGION);
+
+    // erased, read as it is
+    check_image();
+
+    // the region sets up its defaults, only the header is stored
+    memcpy(shadow + ARRAY_ADDRESS, defaults, sizeof(defaults));
+    memset(shadow + ARRAY_ADDRESS + sizeof(defaults), 0x00, ARRAY_SIZE - sizeof(defaults));
+
+    written = array_write();
+
+    TEST_ASSERT(written == NVM_CHANNEL_PLAN_HEADER_SIZE);
+    TEST_ASSERT(is_record());
+    check_image();
+
+    // nothing changed, nothing written
+    TEST_ASSERT(array_write() == 0);
+
+    reboot(REGION);
+    check_image();
+}
+
+static void test_deltas(void)
+{
+    struct channel channel = { 868100000, 0, 0x50, 1 };
+    uint32_t written;
+
+    // a CFList channel past the defaults, and a default one moved
+    written = channel_write(80, &channel);
+    TEST_ASSERT(written == NVM_CHANNEL_PLAN_HEADER_SIZE + 1 + sizeof(struct channel));
+
+    channel = defaults[3];
+    channel.rx1_frequency = 923300000;
+    written = channel_write(3, &channel);
+    TEST_ASSERT(written == NVM_CHANNEL_PLAN_HEADER_SIZE + 2 * (1 + sizeof(struct channel)));
+
+    check_image();
+
+    // the whole group stored again, with a field around the array
+    written = stack_write(ARRAY_ADDRESS - 4, shadow + ARRAY_ADDRESS - 4, ARRAY_SIZE + 8);
+    TEST_ASSERT(written == 8);
+
+    reboot(REGION);
+    check_image();
+
+    // back to its default, the delta is dropped
+    written = channel_write(3, &defaults[3]);
+    TEST_ASSERT(written == NVM_CHANNEL_PLAN_HEADER_SIZE + 1 + sizeof(struct channel));
+
+    reboot(REGION);
+    check_image();
+}
+
+static void test_overflow(void)
+{
+    struct channel channel = { 0 };
+
+    // more deltas than the record holds, stored as it is
+    for (uint16_t i = 0; i < NVM_CHANNEL_PLAN_MAX_DELTAS + 4; i++) {
+        channel.frequency = 433175000 + i * 200000;
+        channel_write(i, &channel);
+    }
+
+    TEST_ASSERT(!is_record());
+    TEST_ASSERT(memcmp(image + ARRAY_ADDRESS, shadow + ARRAY_ADDRESS, ARRAY_SIZE) == 0);
+    check_image();
+
+    reboot(REGION);
+    check_image();
+
+    // partial writes stay as they are
+    channel_write(0, &defaults[0]);
+    TEST_ASSERT(!is_record());
+    check_image();
+
+    // until the whole array fits a record again
+    memcpy(shadow + ARRAY_ADDRESS, defaults, sizeof(defaults));
+    array_write();
+
+    TEST_ASSERT(is_record());
+
+    reboot(REGION);
+    check_image();
+}
+
+static void test_legacy_image(void)
+{
+    uint8_t data[ARRAY_SIZE];
+
+    // written before the records, the array as it is
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++) {
+        image[i] = rand();
+    }
+
+    memcpy(image + ARRAY_ADDRESS, defaults, sizeof(defaults));
+    memset(image + ARRAY_ADDRESS + sizeof(defaults), 0x00, ARRAY_SIZE - sizeof(defaults));
+    memcpy(shadow, image, sizeof(shadow));
+
+    reboot(REGION);
+    check_image();
+
+    array_write();
+    TEST_ASSERT(is_record());
+
+    // a record of another region is not decoded with these defaults
+    reboot(REGION + 1);
+
+    TEST_ASSERT(nvm_channel_plan_read(&plan, ARRAY_ADDRESS, data, ARRAY_SIZE) == 0);
+    TEST_ASSERT(memcmp(data, image + ARRAY_ADDRESS, ARRAY_SIZE) == 0);
+
+    // until the stack stores its own
+    array_write();
+    check_image();
+
+    reboot(REGION + 1);
+    check_image();
+}
+
+static void test_fuzz(void)
+{
+    uint8_t data[ARRAY_SIZE + 64];
+    uint32_t records = 0;
+
+    // back from the other region
+    reboot(REGION);
+    array_write();
+
+    for (uint32_t i = 0; i < FUZZ_WRITES; i++) {
+        uint16_t channel = rand() % CHANNEL_COUNT;
+        uint16_t address = ARRAY_ADDRESS + channel * sizeof(struct channel);
+        uint16_t size = sizeof(struct channel);
+        int kind = rand() % 10;
+
+        if (kind < 8) {
+            // mostly channels going back to their defaults, so records come and go
+            if (channel < DEFAULT_COUNT) {
+                memcpy(data, &defaults[channel], size);
+            } else {
+                memset(data, 0x00, size);
+            }
+        } else if (kind == 8) {
+            // any bytes, in and around the array
+            if (rand() % 2 == 0) {
+                address = ARRAY_ADDRESS - 32 + rand() % (ARRAY_SIZE + 64);
+                size = 1 + rand() % 32;
+            }
+
+            for (uint16_t j = 0; j < size; j++) {
+                data[j] = rand();
+            }
+        } else {
+            // the whole region group stored again
+            address = ARRAY_ADDRESS - 4;
+            size = ARRAY_SIZE + 8;
+
+            memcpy(data, shadow + address, size);
+        }
+
+        stack_write(address, data, size);
+
+        if (rand() % 100 == 0) {
+            reboot(REGION);
+        }
+
+        if (i % 100 == 0) {
+            check_image();
+        }
+
+        records += is_record();
+    }
+
+    check_image();
+
+    printf("channel plan: %u of %u writes left a record\n", records, FUZZ_WRITES);
+
+    // both ways of storing the array were exercised
+    TEST_ASSERT(records > 0 && records < FUZZ_WRITES);
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+
+    init_defaults();
+
+    test_fresh_image();
+    test_deltas();
+    test_overflow();
+    test_legacy_image();
+    test_fuzz();
+
+    printf("channel plan: all tests passed\n");
+
+    return 0;
+}
@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the copy-on-write NVM image of PICO_LORAWAN_NVM_LEAN, against
+ * a simulated NOR flash sector. Power can be cut at any erase or program, a
+ * program that is cut leaves a torn page behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvm-cow.h"
+
+#define SECTOR_SIZE     (4096)
+#define PAGE_SIZE       (256)
+#define PAGE_COUNT      (SECTOR_SIZE / PAGE_SIZE)
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+static struct {
+    uint8_t data[SECTOR_SIZE];
+    uint32_t erases;
+    uint32_t erases_started;
+    uint32_t programs;
+
+    // erases and programs left before power is cut, -1 for no cut
+    int32_t power_budget;
+    bool power_lost;
+
+    // the next program fails, without losing power
+    bool program_error;
+} flash;
+
+static void flash_read(void* context, uint32_t offset, void* data, uint32_t size)
+{
+    memcpy(data, flash.data + offset, size);
+}
+
+static bool flash_power_cut(void)
+{
+    if (flash.power_lost) {
+        return true;
+    }
+
+    if (flash.power_budget == 0) {
+        flash.power_lost = true;
+        return true;
+    }
+
+    if (flash.power_budget > 0) {
+        flash.power_budget--;
+    }
+
+    return false;
+}
+
+static int flash_erase(void* context, uint32_t offset)
+{
+    TEST_ASSERT(offset == 0);
+
+    flash.erases_started++;
+
+    if (flash_power_cut()) {
+        // the sector is left half erased
+        memset(flash.data, 0xff, SECTOR_SIZE / 2);
+        return -1;
+    }
+
+    memset(flash.data, 0xff, SECTOR_SIZE);
+    flash.erases++;
+
+    return 0;
+}
+
+static int flash_program(void* context, uint32_t offset, const void* data, uint32_t size)
+{
+    const uint8_t* bytes = data;
+    uint32_t step = 1;
+
+    TEST_ASSERT((offset % PAGE_SIZE) == 0 && size == PAGE_SIZE);
+
+    if (flash.program_error) {
+        flash.program_error = false;
+        return -1;
+    }
+
+    if (flash_power_cut()) {
+        // a torn page, only every other byte made it
+        step = 2;
+    }
+
+    // programming can only clear bits
+    for (uint32_t i = 0; i < size; i += step) {
+        flash.data[offset + i] &= bytes[i];
+    }
+
+    flash.programs++;
+
+    return flash.power_lost ? -1 : 0;
+}
+
+static const struct nvm_journal_flash cow_flash = {
+    .sector_size = SECTOR_SIZE,
+    .page_size = PAGE_SIZE,
+    .sector_count = 1,
+    .context = NULL,
+    .read = flash_read,
+    .erase = flash_erase,
+    .program = flash_program
+};
+
+static struct nvm_cow cow;
+
+// what the image should read as
+static uint8_t reference[SECTOR_SIZE];
+
+static void flash_reset(void)
+{
+    memset(&flash, 0x00, sizeof(flash));
+    memset(flash.data, 0xff, sizeof(flash.data));
+
+    flash.power_budget = -1;
+}
+
+// powers up again, there is no RAM state, the image is what flash holds
+static void reboot(void)
+{
+    flash.power_budget = -1;
+    flash.power_lost = false;
+
+    // the page buffers are gone with the RAM they were in
+    for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+        free(cow.pages[page]);
+    }
+
+    TEST_ASSERT(nvm_cow_init(&cow, &cow_flash) == 0);
+}
+
+static void check_image(void)
+{
+    uint8_t data[SECTOR_SIZE];
+
+    nvm_cow_read(&cow, 0, data, sizeof(data));
+
+    TEST_ASSERT(memcmp(data, reference, sizeof(data)) == 0);
+}
+
+// writes that mostly clear bits, like counters counting down, with some that
+// set them and need an erase
+static void write_random(uint32_t writes, bool set_bits)
+{
+    for (uint32_t i = 0; i < writes; i++) {
+        uint8_t data[64];
+        uint32_t size = 1 + rand() % sizeof(data);
+        uint32_t offset = rand() % (SECTOR_SIZE - size);
+
+        for (uint32_t j = 0; j < size; j++) {
+            data[j] = set_bits ? rand() : (reference[offset + j] & rand());
+        }
+
+        TEST_ASSERT(nvm_cow_write(&cow, offset, data, size) == 0);
+
+        memcpy(reference + offset, data, size);
+    }
+}
+
+static void flush(void)
+{
+    TEST_ASSERT(nvm_cow_flush(&cow) == 0);
+
+    TEST_ASSERT(!nvm_cow_is_dirty(&cow));
+    TEST_ASSERT(cow.stats.buffer_bytes == 0);
+    TEST_ASSERT(memcmp(flash.data, reference, sizeof(reference)) == 0);
+}
+
+static void test_replay(void)
+{
+    flash_reset();
+    memset(reference, 0xff, sizeof(reference));
+    reboot();
+
+    // reads come from flash, nothing is buffered for them
+    check_image();
+    TEST_ASSERT(!nvm_cow_is_dirty(&cow));
+    TEST_ASSERT(cow.stats.max_buffer_bytes == 0);
+
+    for (int i = 0; i < 200; i++) {
+        write_random(1 + rand() % 4, (rand() % 4) == 0);
+        check_image();
+
+        flush();
+
+        reboot();
+        check_image();
+    }
+
+    // changes that were never flushed are lost, nothing else
+    write_random(4, true);
+    memcpy(reference, flash.data, sizeof(reference));
+    reboot();
+    check_image();
+}
+
+static void test_ram(void)
+{
+    uint8_t data[16];
+
+    flash_reset();
+    memset(reference, 0xff, sizeof(reference));
+    reboot();
+
+    // rewriting what flash already holds buffers nothing
+    memset(data, 0xff, sizeof(data));
+    TEST_ASSERT(nvm_cow_write(&cow, 100, data, sizeof(data)) == 0);
+    TEST_ASSERT(!nvm_cow_is_dirty(&cow));
+    TEST_ASSERT(cow.stats.buffer_bytes == 0);
+
+    // a change buffers the page it is in, only while the flush is pending
+    memset(data, 0x55, sizeof(data));
+    TEST_ASSERT(nvm_cow_write(&cow, 100, data, sizeof(data)) == 0);
+    memcpy(reference + 100, data, sizeof(data));
+    TEST_ASSERT(cow.stats.buffer_bytes == PAGE_SIZE);
+
+    // one that spans two pages buffers both
+    TEST_ASSERT(nvm_cow_write(&cow, 2 * PAGE_SIZE - 8, data, sizeof(data)) == 0);
+    memcpy(reference + 2 * PAGE_SIZE - 8, data, sizeof(data));
+    TEST_ASSERT(cow.stats.buffer_bytes == 3 * PAGE_SIZE);
+    check_image();
+
+    // blank flash, the pages are programmed without an erase
+    flush();
+    TEST_ASSERT(flash.erases == 0 && flash.programs == 3);
+    TEST_ASSERT(cow.stats.max_buffer_bytes == 3 * PAGE_SIZE);
+
+    // setting bits needs an erase, the other page that isn't blank is
+    // buffered for the duration of the flush
+    memset(data, 0xaa, sizeof(data));
+    TEST_ASSERT(nvm_cow_write(&cow, 100, data, sizeof(data)) == 0);
+    memcpy(reference + 100, data, sizeof(data));
+    TEST_ASSERT(cow.stats.buffer_bytes == PAGE_SIZE);
+
+    flush();
+    TEST_ASSERT(flash.erases == 1 && flash.programs == 6);
+    TEST_ASSERT(cow.stats.max_buffer_bytes == 3 * PAGE_SIZE);
+
+    // a change that is undone before the flush writes nothing
+    memset(data, 0x00, sizeof(data));
+    TEST_ASSERT(nvm_cow_write(&cow, 3000, data, sizeof(data)) == 0);
+    TEST_ASSERT(nvm_cow_write(&cow, 3000, reference + 3000, sizeof(data)) == 0);
+    TEST_ASSERT(nvm_cow_is_dirty(&cow));
+
+    flush();
+    TEST_ASSERT(flash.erases == 1 && flash.programs == 6);
+}
+
+static void test_retry(void)
+{
+    flash_reset();
+    memset(reference, 0xff, sizeof(reference));
+    reboot();
+
+    for (int i = 0; i < 200; i++) {
+        int result;
+
+        write_random(1 + rand() % 4, (rand() % 4) == 0);
+
+        // a flush that fails keeps the buffers, and the next one completes it
+        flash.program_error = true;
+        result = nvm_cow_flush(&cow);
+
+        TEST_ASSERT((result != 0) == !flash.program_error);
+        TEST_ASSERT(result == 0 || nvm_cow_is_dirty(&cow));
+        check_image();
+
+        flash.program_error = false;
+        flush();
+    }
+}
+
+static void test_power_loss(void)
+{
+    static uint8_t before[SECTOR_SIZE];
+    uint32_t power_losses = 0;
+
+    flash_reset();
+    memset(reference, 0xff, sizeof(reference));
+    reboot();
+
+    for (int i = 0; i < 5000; i++) {
+        uint32_t erases = flash.erases_started;
+        uint32_t torn = 0;
+
+        write_random(1 + rand() % 4, (rand() % 4) == 0);
+        memcpy(before, flash.data, sizeof(before));
+
+        if ((rand() % 10) == 0) {
+            flash.power_budget = rand() % 4;
+        }
+
+        if (nvm_cow_flush(&cow) == 0 && !flash.power_lost) {
+            TEST_ASSERT(memcmp(flash.data, reference, sizeof(reference)) == 0);
+
+            flash.power_budget = -1;
+            continue;
+        }
+
+        TEST_ASSERT(flash.power_lost);
+        power_losses++;
+
+        // every page holds what it held before, what it should hold now, or
+        // is blank if an erase was started, but the one page being programmed
+        for (uint32_t page = 0; page < PAGE_COUNT; page++) {
+            const uint8_t* data = flash.data + page * PAGE_SIZE;
+            bool blank = true;
+
+            for (uint32_t j = 0; j < PAGE_SIZE; j++) {
+                blank = blank && (data[j] == 0xff);
+            }
+
+            if (memcmp(data, before + page * PAGE_SIZE, PAGE_SIZE) != 0 &&
+                memcmp(data, reference + page * PAGE_SIZE, PAGE_SIZE) != 0 &&
+                !(blank && flash.erases_started != erases)) {
+                torn++;
+            }
+        }
+
+        TEST_ASSERT(torn <= 1);
+
+        // after the power loss, the image reads as flash holds it
+        reboot();
+        memcpy(reference, flash.data, sizeof(reference));
+        check_image();
+
+        // and the next flush writes over whatever was torn
+        write_random(1, true);
+        flush();
+    }
+
+    printf("power loss: %u power losses, %u erases, %u pages programmed\n", power_losses, flash.erases, flash.programs);
+
+    TEST_ASSERT(power_losses > 0);
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+
+    test_replay();
+    test_ram();
+    test_retry();
+    test_power_loss();
+
+    printf("nvm cow: all tests passed\n");
+
+    return 0;
+}
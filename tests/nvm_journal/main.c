@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the NVM journal, against a simulated NOR flash that counts
+ * erases per sector and keeps a virtual time of the erases and programs, so
+ * the latency of each flush can be measured. Power can be cut at any erase
+ * or program, a program that is cut leaves a torn page behind.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvm-journal.h"
+
+#define SECTOR_SIZE     (4096)
+#define PAGE_SIZE       (256)
+#define SECTOR_COUNT    (4)
+#define IMAGE_SIZE      (2048)
+
+// typical of the QSPI flash of RP2040 boards
+#define ERASE_TIME_US   (45000)
+#define PROGRAM_TIME_US (800)
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+static struct {
+    uint8_t data[SECTOR_SIZE * SECTOR_COUNT];
+    uint32_t sector_erases[SECTOR_COUNT];
+    uint32_t erases;
+    uint64_t time_us;
+
+    // erases and programs left before power is cut, -1 for no cut
+    int32_t power_budget;
+    bool power_lost;
+} flash;
+
+static void flash_read(void* context, uint32_t offset, void* data, uint32_t size)
+{
+    memcpy(data, flash.data + offset, size);
+}
+
+static bool flash_power_cut(void)
+{
+    if (flash.power_lost) {
+        return true;
+    }
+
+    if (flash.power_budget == 0) {
+        flash.power_lost = true;
+        return true;
+    }
+
+    if (flash.power_budget > 0) {
+        flash.power_budget--;
+    }
+
+    return false;
+}
+
+static int flash_erase(void* context, uint32_t offset)
+{
+    if (flash_power_cut()) {
+        // the sector is left half erased
+        memset(flash.data + offset, 0xff, SECTOR_SIZE / 2);
+        return -1;
+    }
+
+    memset(flash.data + offset, 0xff, SECTOR_SIZE);
+
+    flash.sector_erases[offset / SECTOR_SIZE]++;
+    flash.erases++;
+    flash.time_us += ERASE_TIME_US;
+
+    return 0;
+}
+
+static int flash_program(void* context, uint32_t offset, const void* data, uint32_t size)
+{
+    const uint8_t* bytes = data;
+    uint32_t step = 1;
+
+    if (flash_power_cut()) {
+        // a torn page, only every other byte made it
+        step = 2;
+    }
+
+    // programming can only clear bits
+    for (uint32_t i = 0; i < size; i += step) {
+        flash.data[offset + i] &= bytes[i];
+    }
+
+    flash.time_us += PROGRAM_TIME_US;
+
+    return flash.power_lost ? -1 : 0;
+}
+
+static const struct nvm_journal_flash journal_flash = {
+    .sector_size = SECTOR_SIZE,
+    .page_size = PAGE_SIZE,
+    .sector_count = SECTOR_COUNT,
+    .context = NULL,
+    .read = flash_read,
+    .erase = flash_erase,
+    .program = flash_program
+};
+
+static struct nvm_journal journal;
+static uint8_t image[IMAGE_SIZE];
+
+// last image a flush returned 0 for
+static uint8_t committed[IMAGE_SIZE];
+
+static void flash_reset(void)
+{
+    memset(&flash, 0x00, sizeof(flash));
+    memset(flash.data, 0xff, sizeof(flash.data));
+
+    flash.power_budget = -1;
+}
+
+// powers up again, the journal recovers the image from flash
+static int reboot(void)
+{
+    flash.power_budget = -1;
+    flash.power_lost = false;
+
+    memset(image, 0xff, sizeof(image));
+
+    return nvm_journal_init(&journal, &journal_flash, image, sizeof(image));
+}
+
+static void write_random(uint32_t writes)
+{
+    for (uint32_t i = 0; i < writes; i++) {
+        uint8_t data[16];
+        uint32_t size = 1 + rand() % sizeof(data);
+        uint32_t offset = rand() % (IMAGE_SIZE - size);
+
+        for (uint32_t j = 0; j < size; j++) {
+            data[j] = rand();
+        }
+
+        nvm_journal_write(&journal, offset, data, size);
+    }
+}
+
+static void flush(void)
+{
+    TEST_ASSERT(nvm_journal_flush(&journal) == 0);
+    TEST_ASSERT(!nvm_journal_is_dirty(&journal));
+
+    memcpy(committed, image, sizeof(image));
+}
+
+static void test_replay(void)
+{
+    flash_reset();
+
+    TEST_ASSERT(reboot() == 1);
+    TEST_ASSERT(!nvm_journal_is_dirty(&journal));
+
+    // the first flush writes a snapshot, the following ones delta records
+    write_random(8);
+    flush();
+    TEST_ASSERT(journal.stats.compactions == 1);
+
+    for (int i = 0; i < 20; i++) {
+        write_random(1 + rand() % 4);
+        flush();
+    }
+
+    TEST_ASSERT(journal.stats.compactions == 1);
+    TEST_ASSERT(journal.stats.records > 20);
+
+    // rewriting what the image holds changes nothing
+    nvm_journal_write(&journal, 100, image + 100, 32);
+    TEST_ASSERT(!nvm_journal_is_dirty(&journal));
+
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+    TEST_ASSERT(!nvm_journal_is_dirty(&journal));
+
+    // changes that were never flushed are lost, nothing else
+    write_random(4);
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+
+    // and the journal carries on appending after the replay
+    write_random(4);
+    flush();
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+}
+
+static void test_torn_tail(void)
+{
+    uint32_t compactions;
+
+    flash_reset();
+
+    TEST_ASSERT(reboot() == 1);
+
+    write_random(8);
+    flush();
+
+    for (int i = 0; i < 5; i++) {
+        write_random(2);
+        flush();
+    }
+
+    // power is lost while the next delta record is programmed
+    write_random(2);
+    flash.power_budget = 0;
+    TEST_ASSERT(nvm_journal_flush(&journal) != 0);
+
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+
+    // nothing is appended behind the torn record, the next flush compacts
+    TEST_ASSERT(journal.compact_pending);
+
+    compactions = journal.stats.compactions;
+    write_random(2);
+    flush();
+    TEST_ASSERT(journal.stats.compactions == compactions + 1);
+    TEST_ASSERT(!journal.compact_pending);
+
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+    TEST_ASSERT(!journal.compact_pending);
+
+    // power is lost while the snapshot of a compaction is programmed, the
+    // previous sector still holds the image
+    write_random(2);
+    flash.power_budget = 1;
+    journal.compact_pending = true;
+    TEST_ASSERT(nvm_journal_flush(&journal) != 0);
+
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+
+    write_random(2);
+    flush();
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+}
+
+static void test_compaction(void)
+{
+    uint32_t max_flush_us = 0;
+    uint32_t min_erases = UINT32_MAX;
+    uint32_t max_erases = 0;
+
+    flash_reset();
+
+    TEST_ASSERT(reboot() == 1);
+
+    write_random(8);
+    flush();
+
+    for (int i = 0; i < 5000; i++) {
+        uint64_t start;
+        uint32_t erases;
+
+        write_random(1 + rand() % 3);
+
+        start = flash.time_us;
+        erases = flash.erases;
+
+        flush();
+
+        // the next sector was erased ahead of time, flushes only program
+        TEST_ASSERT(flash.erases == erases);
+
+        if ((flash.time_us - start) > max_flush_us) {
+            max_flush_us = flash.time_us - start;
+        }
+
+        // idle time between uplinks
+        while (nvm_journal_process(&journal));
+    }
+
+    for (uint32_t sector = 0; sector < SECTOR_COUNT; sector++) {
+        if (flash.sector_erases[sector] < min_erases) {
+            min_erases = flash.sector_erases[sector];
+        }
+
+        if (flash.sector_erases[sector] > max_erases) {
+            max_erases = flash.sector_erases[sector];
+        }
+    }
+
+    printf("compaction: %u flushes, %u compactions, %u erases (%u to %u per sector), max flush %u us\n",
+        journal.stats.flushes, journal.stats.compactions, flash.erases, min_erases, max_erases, max_flush_us);
+
+    TEST_ASSERT(journal.stats.compactions > SECTOR_COUNT);
+    TEST_ASSERT(journal.stats.background_erases == flash.erases);
+
+    // the ring is worn evenly
+    TEST_ASSERT(max_erases - min_erases <= 1);
+
+    // a flush never waits for an erase, and a full sector rewrite takes
+    // ERASE_TIME_US plus 16 pages
+    TEST_ASSERT(max_flush_us < ERASE_TIME_US);
+
+    TEST_ASSERT(reboot() == 0);
+    TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0);
+}
+
+static void test_power_loss(void)
+{
+    // the image the interrupted flush was writing
+    static uint8_t attempted[IMAGE_SIZE];
+    uint32_t power_losses = 0;
+
+    flash_reset();
+
+    TEST_ASSERT(reboot() == 1);
+
+    write_random(8);
+    flush();
+
+    for (int i = 0; i < 20000; i++) {
+        int result;
+
+        write_random(1 + rand() % 3);
+        memcpy(attempted, image, sizeof(image));
+
+        if ((rand() % 50) == 0) {
+            flash.power_budget = rand() % 3;
+        }
+
+        result = nvm_journal_flush(&journal);
+
+        if (result == 0 && !flash.power_lost) {
+            memcpy(committed, image, sizeof(image));
+        }
+
+        if (!flash.power_lost && (rand() % 4) == 0) {
+            nvm_journal_process(&journal);
+        }
+
+        if (!flash.power_lost) {
+            flash.power_budget = -1;
+            continue;
+        }
+
+        power_losses++;
+
+        // either all of the flush made it, or none of it
+        TEST_ASSERT(reboot() == 0);
+        TEST_ASSERT(memcmp(image, committed, sizeof(image)) == 0 || memcmp(image, attempted, sizeof(image)) == 0);
+
+        memcpy(committed, image, sizeof(image));
+    }
+
+    printf("power loss: %u power losses, %u compactions\n", power_losses, journal.stats.compactions);
+
+    TEST_ASSERT(power_losses > 0);
+}
+
+int main(int argc, char** argv)
+{
+    srand(1);
+
+    test_replay();
+    test_torn_tail();
+    test_compaction();
+    test_power_loss();
+
+    printf("nvm journal: all tests passed\n");
+
+    return 0;
+}
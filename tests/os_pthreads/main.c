@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the MAC in a task of its own, on the POSIX threads OS adapter.
+ * A number of application threads call the API at the same time, sending
+ * uplinks and syncing the NVM, while the main thread waits for events. The
+ * simulated network server must receive every uplink of every thread, each
+ * with a new frame counter. Run it under ThreadSanitizer or helgrind to check
+ * the locking too.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pico/lorawan.h"
+#include "pico/time.h"
+
+#include "os-pthreads.h"
+#include "sx1276-sim.h"
+
+#define LORAWAN_REGION                  LORAMAC_REGION_US915
+#define LORAWAN_DEV_ADDR_STR            "26011BDA"
+#define LORAWAN_NETWORK_SESSION_KEY     "2B7E151628AED2A6ABF7158809CF4F3C"
+#define LORAWAN_APP_SESSION_KEY         "3C4FCF098815F7ABA6D2AE2816157E2B"
+
+#define NVM_PATH                        "os_pthreads.bin"
+
+// API calls into the MAC task fail after this long
+#define LORAWAN_OS_TIMEOUT_MS           5000
+
+#define THREADS                         4
+#define UPLINKS_PER_THREAD              25
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+// the SX1276 model does not care about pins, any distinct numbers do
+struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = spi0,
+        .mosi = 19,
+        .miso = 16,
+        .sck  = 18,
+        .nss  = 8
+    },
+    .reset = 9,
+    .dio0  = 7,
+    .dio1  = 10
+};
+
+const struct lorawan_abp_settings abp_settings = {
+    .device_address = LORAWAN_DEV_ADDR_STR,
+    .network_session_key = LORAWAN_NETWORK_SESSION_KEY,
+    .app_session_key = LORAWAN_APP_SESSION_KEY,
+    .channel_mask = NULL
+};
+
+// written by the radio model on the MAC task, read by the main thread
+static uint32_t uplinks_seen[THREADS];
+
+static uint32_t queue_full_retries = 0;
+
+// only seen by the MAC task
+static bool fcnt_seen = false;
+static uint16_t last_fcnt = 0;
+
+static void on_uplink(const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context)
+{
+    uint8_t fopts_len;
+    uint8_t port;
+    uint16_t fcnt;
+
+    // only look at data uplinks with a port
+    if (size < 12 || (buffer[0] & 0xe0) != 0x40) {
+        return;
+    }
+
+    fopts_len = buffer[5] & 0x0f;
+
+    if (size <= 12 + fopts_len) {
+        return;
+    }
+
+    // each uplink is sent once, with a new frame counter
+    fcnt = buffer[6] | (buffer[7] << 8);
+
+    TEST_ASSERT(!fcnt_seen || fcnt > last_fcnt);
+
+    fcnt_seen = true;
+    last_fcnt = fcnt;
+
+    // each sender has a port of its own, FPort follows the FOpts
+    port = buffer[8 + fopts_len];
+
+    TEST_ASSERT(port >= 1 && port <= THREADS);
+
+    __atomic_fetch_add(&uplinks_seen[port - 1], 1, __ATOMIC_RELAXED);
+}
+
+static uint32_t uplinks_received(void)
+{
+    uint32_t received = 0;
+
+    for (uint32_t i = 0; i < THREADS; i++) {
+        received += __atomic_load_n(&uplinks_seen[i], __ATOMIC_RELAXED);
+    }
+
+    return received;
+}
+
+static void* sender(void* arg)
+{
+    uint8_t thread = (uint8_t)(uintptr_t)arg;
+    uint8_t payload[2] = { thread, 0 };
+
+    for (uint32_t i = 0; i < UPLINKS_PER_THREAD; i++) {
+        payload[1] = (uint8_t)i;
+
+        // the queue is full while the MAC is busy, try again a little later
+        while (lorawan_send_unconfirmed(payload, sizeof(payload), 1 + thread) < 0) {
+            __atomic_fetch_add(&queue_full_retries, 1, __ATOMIC_RELAXED);
+            usleep(1000);
+        }
+    }
+
+    // handed to the MAC task like any other call
+    TEST_ASSERT(lorawan_nvm_sync() == 0);
+
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t threads[THREADS];
+    struct lorawan_uplink_queue_stats queue_stats;
+    uint32_t total = THREADS * UPLINKS_PER_THREAD;
+
+    unlink(NVM_PATH);
+    setenv("PICO_LORAWAN_HOST_EEPROM", NVM_PATH, 1);
+
+    SX1276SimSetTxHandler(on_uplink, NULL);
+
+    TEST_ASSERT(lorawan_os_init(&lorawan_os_pthreads, LORAWAN_OS_TIMEOUT_MS) == 0);
+    TEST_ASSERT(lorawan_init_abp(&sx1276_settings, LORAWAN_REGION, &abp_settings) == 0);
+
+    lorawan_join();
+
+    TEST_ASSERT(lorawan_wait_event(LORAWAN_EVENT_JOINED, LORAWAN_OS_TIMEOUT_MS) != 0);
+
+    for (uint32_t i = 0; i < THREADS; i++) {
+        TEST_ASSERT(pthread_create(&threads[i], NULL, sender, (void*)(uintptr_t)i) == 0);
+    }
+
+    for (uint32_t i = 0; i < THREADS; i++) {
+        TEST_ASSERT(pthread_join(threads[i], NULL) == 0);
+    }
+
+    // every uplink the queue accepted is sent eventually, and the last one
+    // is on air a little after the MAC took it
+    for (uint32_t i = 0; i < total; i++) {
+        lorawan_uplink_queue_get_stats(&queue_stats);
+
+        if (queue_stats.sent == total && uplinks_received() == total) {
+            break;
+        }
+
+        lorawan_wait_event(LORAWAN_EVENT_TX_DONE, 1000);
+    }
+
+    lorawan_uplink_queue_get_stats(&queue_stats);
+
+    printf("os pthreads: %u threads, %u uplinks sent, %u queue full retries (max depth %u), %.1f s virtual time\n",
+        THREADS, queue_stats.sent, __atomic_load_n(&queue_full_retries, __ATOMIC_RELAXED), queue_stats.max_depth,
+        to_us_since_boot(get_absolute_time()) / 1e6);
+
+    TEST_ASSERT(queue_stats.sent == total);
+    TEST_ASSERT(queue_stats.depth == 0);
+
+    // the network server received every uplink of every thread
+    for (uint32_t i = 0; i < THREADS; i++) {
+        TEST_ASSERT(__atomic_load_n(&uplinks_seen[i], __ATOMIC_RELAXED) == UPLINKS_PER_THREAD);
+    }
+
+    unlink(NVM_PATH);
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the LoRaMac timers across wraps of the 32-bit, 1 ms timer
+ * ticks of LoRaMac-node, about every 49.7 days. Virtual time starts a minute
+ * before the first wrap and is fast-forwarded past WRAPS of them between
+ * uplinks, with a WRAP_TIMER_MS LoRaMac timer pending. The timer must fire
+ * on time every period, and the uplinks keep going through the wraps.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/lorawan.h"
+
+#include "sim-clock.h"
+#include "sx1276-sim.h"
+#include "timer.h"
+
+#define LORAWAN_REGION                  LORAMAC_REGION_US915
+#define LORAWAN_DEV_ADDR_STR            "26011BDA"
+#define LORAWAN_NETWORK_SESSION_KEY     "2B7E151628AED2A6ABF7158809CF4F3C"
+#define LORAWAN_APP_SESSION_KEY         "3C4FCF098815F7ABA6D2AE2816157E2B"
+
+#define NVM_PATH                        "timer_wrap.bin"
+
+#define UPLINKS                         200
+#define UPLINK_CYCLE_MS                 3000
+#define WRAPS                           4
+
+// 1 ms ticks, 32 bits of them
+#define TICK_WRAP_US                    ((1ull << 32) * 1000)
+#define WRAP_TIMER_MS                   (17u * 24 * 60 * 60 * 1000)
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+// the SX1276 model does not care about pins, any distinct numbers do
+struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = spi0,
+        .mosi = 19,
+        .miso = 16,
+        .sck  = 18,
+        .nss  = 8
+    },
+    .reset = 9,
+    .dio0  = 7,
+    .dio1  = 10
+};
+
+const struct lorawan_abp_settings abp_settings = {
+    .device_address = LORAWAN_DEV_ADDR_STR,
+    .network_session_key = LORAWAN_NETWORK_SESSION_KEY,
+    .app_session_key = LORAWAN_APP_SESSION_KEY,
+    .channel_mask = NULL
+};
+
+// timer kept pending while time is fast-forwarded past tick wraps
+static TimerEvent_t wrap_timer;
+static uint64_t wrap_timer_deadline = 0;
+static uint32_t wrap_timer_fired = 0;
+
+static uint32_t uplinks_seen = 0;
+
+static void on_uplink(const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context)
+{
+    // only look at data uplinks
+    if (size < 12 || (buffer[0] & 0xe0) != 0x40) {
+        return;
+    }
+
+    uplinks_seen++;
+}
+
+static void on_wrap_timer(void* context)
+{
+    int64_t error = SimClockNow() - wrap_timer_deadline;
+
+    // within a tick either way
+    if (error < -1000 || error > 1000) {
+        printf("wrap timer off by %lld us after %u periods\n", (long long)error, wrap_timer_fired);
+    }
+
+    TEST_ASSERT(error >= -1000 && error <= 1000);
+
+    wrap_timer_fired++;
+    wrap_timer_deadline = SimClockNow() + WRAP_TIMER_MS * 1000ull;
+
+    TimerStart(&wrap_timer);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t sent = 0;
+    uint64_t wraps;
+
+    unlink(NVM_PATH);
+    setenv("PICO_LORAWAN_HOST_EEPROM", NVM_PATH, 1);
+
+    SX1276SimSetTxHandler(on_uplink, NULL);
+
+    // nothing is scheduled yet, so this only moves "boot" forward
+    SimClockAdvanceTo(TICK_WRAP_US - 60 * 1000 * 1000);
+
+    TEST_ASSERT(lorawan_init_abp(&sx1276_settings, LORAWAN_REGION, &abp_settings) == 0);
+
+    lorawan_join();
+
+    while (!lorawan_is_joined()) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    TimerInit(&wrap_timer, on_wrap_timer);
+    TimerSetValue(&wrap_timer, WRAP_TIMER_MS);
+    wrap_timer_deadline = SimClockNow() + WRAP_TIMER_MS * 1000ull;
+    TimerStart(&wrap_timer);
+
+    while (sent < UPLINKS) {
+        if (lorawan_send_unconfirmed(&sent, sizeof(sent), 2) == 0) {
+            sent++;
+        }
+
+        // run through the RX windows
+        lorawan_process_timeout_ms(UPLINK_CYCLE_MS);
+
+        // the MAC is idle after the RX windows, skip ahead, the wrap timer
+        // fires on the way
+        SimClockAdvanceTo(SimClockNow() + WRAPS * TICK_WRAP_US / UPLINKS);
+    }
+
+    wraps = SimClockNow() / TICK_WRAP_US;
+
+    printf("timer wrap: %llu tick wraps, wrap timer fired %u times, %u uplinks\n",
+        (unsigned long long)wraps, wrap_timer_fired, uplinks_seen);
+
+    TEST_ASSERT(wraps >= WRAPS);
+
+    // fired every period, a timer that stopped firing would still be due in
+    // the past
+    TEST_ASSERT(wrap_timer_fired >= (WRAPS * TICK_WRAP_US) / (WRAP_TIMER_MS * 1000ull) - 1);
+    TEST_ASSERT(wrap_timer_deadline > SimClockNow());
+
+    // and the MAC timers kept working through the wraps
+    TEST_ASSERT(uplinks_seen == UPLINKS);
+
+    unlink(NVM_PATH);
+
+    return 0;
+}
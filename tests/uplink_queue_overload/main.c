@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2021 Arm Limited and Contributors. All rights reserved.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ *
+ * Host test of the uplink queue under sustained overload. Every uplink cycle
+ * offers OVERLOAD more telemetry uplinks than the MAC can send, and an alarm
+ * every ALARM_INTERVAL cycles. The simulated network server checks that every
+ * alarm the queue accepted is received before its deadline, and the queue
+ * statistics must account for every uplink offered.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/lorawan.h"
+
+#include "sim-clock.h"
+#include "sx1276-sim.h"
+
+#define LORAWAN_REGION                  LORAMAC_REGION_US915
+#define LORAWAN_DEV_ADDR_STR            "26011BDA"
+#define LORAWAN_NETWORK_SESSION_KEY     "2B7E151628AED2A6ABF7158809CF4F3C"
+#define LORAWAN_APP_SESSION_KEY         "3C4FCF098815F7ABA6D2AE2816157E2B"
+
+#define NVM_PATH                        "uplink_queue_overload.bin"
+
+#define CYCLES                          200
+#define UPLINK_CYCLE_MS                 3000
+#define OVERLOAD                        3
+
+#define TELEMETRY_PORT                  2
+#define ALARM_PORT                      3
+#define ALARM_INTERVAL                  10
+#define ALARM_DEADLINE_MS               30000
+
+#define TEST_ASSERT(cond) \
+    do { \
+        if (!(cond)) { \
+            printf("%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            exit(1); \
+        } \
+    } while (0)
+
+// the SX1276 model does not care about pins, any distinct numbers do
+struct lorawan_sx1276_settings sx1276_settings = {
+    .spi = {
+        .inst = spi0,
+        .mosi = 19,
+        .miso = 16,
+        .sck  = 18,
+        .nss  = 8
+    },
+    .reset = 9,
+    .dio0  = 7,
+    .dio1  = 10
+};
+
+const struct lorawan_abp_settings abp_settings = {
+    .device_address = LORAWAN_DEV_ADDR_STR,
+    .network_session_key = LORAWAN_NETWORK_SESSION_KEY,
+    .app_session_key = LORAWAN_APP_SESSION_KEY,
+    .channel_mask = NULL
+};
+
+// virtual time each accepted alarm was queued at, they are sent in order
+static uint64_t alarm_queue_times[CYCLES / ALARM_INTERVAL + 1];
+static uint32_t alarms_queued = 0;
+static uint32_t alarms_seen = 0;
+static uint32_t telemetry_seen = 0;
+
+static void on_uplink(const uint8_t* buffer, uint8_t size, uint32_t frequency, void* context)
+{
+    uint8_t fopts_len;
+
+    // only look at data uplinks with a port
+    if (size < 12 || (buffer[0] & 0xe0) != 0x40) {
+        return;
+    }
+
+    fopts_len = buffer[5] & 0x0f;
+
+    if (size <= 12 + fopts_len) {
+        return;
+    }
+
+    // FPort follows the FOpts
+    if (buffer[8 + fopts_len] == ALARM_PORT) {
+        TEST_ASSERT(alarms_seen < alarms_queued);
+        TEST_ASSERT(SimClockNow() - alarm_queue_times[alarms_seen] <= ALARM_DEADLINE_MS * 1000ull);
+
+        alarms_seen++;
+    } else if (buffer[8 + fopts_len] == TELEMETRY_PORT) {
+        telemetry_seen++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    struct lorawan_uplink_queue_stats stats;
+    uint32_t offered = 0;
+    uint32_t refused = 0;
+
+    unlink(NVM_PATH);
+    setenv("PICO_LORAWAN_HOST_EEPROM", NVM_PATH, 1);
+
+    SX1276SimSetTxHandler(on_uplink, NULL);
+
+    TEST_ASSERT(lorawan_init_abp(&sx1276_settings, LORAWAN_REGION, &abp_settings) == 0);
+
+    lorawan_join();
+
+    while (!lorawan_is_joined()) {
+        lorawan_process_timeout_ms(1000);
+    }
+
+    for (uint32_t cycle = 0; cycle < CYCLES; cycle++) {
+        // one more than the MAC can send in a cycle
+        for (uint32_t i = 0; i < 1 + OVERLOAD; i++) {
+            offered++;
+
+            if (lorawan_send_unconfirmed(&cycle, sizeof(cycle), TELEMETRY_PORT) < 0) {
+                refused++;
+            }
+        }
+
+        if ((cycle % ALARM_INTERVAL) == 0) {
+            offered++;
+
+            if (lorawan_send_unconfirmed_queued(&cycle, sizeof(cycle), ALARM_PORT,
+                                                LORAWAN_UPLINK_PRIORITY_ALARM, ALARM_DEADLINE_MS) == 0) {
+                alarm_queue_times[alarms_queued++] = SimClockNow();
+            } else {
+                refused++;
+            }
+        }
+
+        lorawan_uplink_queue_get_stats(&stats);
+        TEST_ASSERT(stats.depth <= PICO_LORAWAN_UPLINK_QUEUE_SIZE);
+
+        // run through the RX windows, or wait for the MAC to become free
+        lorawan_process_timeout_ms(UPLINK_CYCLE_MS);
+    }
+
+    // drain what is still queued, every uplink offered was then either sent
+    // or dropped
+    for (int i = 0; i < 100; i++) {
+        lorawan_uplink_queue_get_stats(&stats);
+
+        if (stats.depth == 0) {
+            break;
+        }
+
+        lorawan_process_timeout_ms(UPLINK_CYCLE_MS);
+    }
+
+    printf("uplink queue overload: %u offered, %u queued (%u sent, max depth %u), dropped %u full, %u expired, %u rejected\n",
+        offered, stats.queued, stats.sent, stats.max_depth, stats.dropped_full, stats.dropped_expired, stats.dropped_rejected);
+    printf("uplink queue overload: %u of %u alarms received, %u telemetry uplinks\n", alarms_seen, alarms_queued, telemetry_seen);
+
+    TEST_ASSERT(stats.depth == 0);
+    TEST_ASSERT(stats.max_depth <= PICO_LORAWAN_UPLINK_QUEUE_SIZE);
+
+    // the queue did overflow, and telemetry was dropped for it
+    TEST_ASSERT(stats.dropped_full > 0);
+
+    // every uplink offered is accounted for
+    TEST_ASSERT(stats.queued + refused == stats.sent + stats.dropped_full + stats.dropped_expired + stats.dropped_rejected);
+    TEST_ASSERT(refused + stats.queued == offered);
+
+    // no alarm the queue accepted was lost
+    TEST_ASSERT(alarms_queued > 0);
+    TEST_ASSERT(alarms_seen == alarms_queued);
+
+    unlink(NVM_PATH);
+
+    return 0;
+}